@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define TCA8418_DEFAULT_ADDR 0x34
+#define TCA8418_REG_CFG 0x01
+#define TCA8418_REG_INT_STAT 0x02
+#define TCA8418_REG_KEY_LCK_EC 0x03
+#define TCA8418_REG_KEY_EVENT_A 0x04
+
+// Key events come from nativeKeypadEvent() instead of the I2C bus, nativeKeypadTransactions
+// counts what would have gone over it.
+class Adafruit_TCA8418 {
+ public:
+  bool begin(uint8_t address, TwoWire* wire) { return true; }
+  bool matrix(uint8_t rows, uint8_t columns) { return true; }
+  void flush();
+  uint8_t available();
+  uint8_t getEvent();
+  uint8_t readRegister(uint8_t reg);
+  void writeRegister(uint8_t reg, uint8_t value);
+  void enableInterrupts() {}
+  void disableInterrupts() {}
+};
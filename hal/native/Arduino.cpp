@@ -0,0 +1,333 @@
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "native.hpp"
+#include "internal.hpp"
+
+const int NATIVE_PINS = 64;
+
+struct NativePin {
+  int mode;
+  int value;
+  void (*handler)();
+  int interruptMode;
+};
+
+NativePin nativePins[NATIVE_PINS];
+void (*nativePinWriteHook)(int pin, int value) = NULL;
+
+std::chrono::steady_clock::time_point nativeStartTime() {
+  static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return start;
+}
+
+std::recursive_mutex& nativeInterruptLock() {
+  static std::recursive_mutex lock;
+  return lock;
+}
+
+bool nativeVirtualTime = false;
+std::atomic<unsigned long> nativeVirtualMicros(0);
+
+void nativeUseVirtualTime() {
+  nativeVirtualTime = true;
+}
+
+bool nativeVirtualTimeUsed() {
+  return nativeVirtualTime;
+}
+
+void nativeAdvanceMicros(unsigned long us) {
+  nativeVirtualMicros += us;
+}
+
+void (*nativeVirtualWaitHook)() = NULL;
+bool nativeInWaitHook = false;
+
+// Lets the hook move the clock instead of jumping it, waits inside the hook itself jump.
+void nativeVirtualWait(unsigned long us) {
+  if (nativeVirtualWaitHook == NULL || nativeInWaitHook) {
+    nativeAdvanceMicros(us);
+    return;
+  }
+  unsigned long startUs = nativeVirtualMicros;
+  do {
+    nativeVirtualYield();
+  } while (nativeVirtualMicros - startUs < us);
+}
+
+void nativeVirtualYield() {
+  if (nativeVirtualWaitHook == NULL || nativeInWaitHook) return;
+  nativeInWaitHook = true;
+  nativeVirtualWaitHook();
+  nativeInWaitHook = false;
+}
+
+unsigned long micros() {
+  if (nativeVirtualTime) return nativeVirtualMicros;
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - nativeStartTime()).count();
+}
+
+unsigned long millis() {
+  return micros() / 1000;
+}
+
+void delay(unsigned long ms) {
+  if (nativeVirtualTime) {
+    nativeVirtualWait(ms * 1000);
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (nativeVirtualTime) {
+    nativeVirtualWait(us);
+    return;
+  }
+  // Busy-wait like the real one, sleeping for a few microseconds takes ~50us on Linux.
+  unsigned long startUs = micros();
+  while (micros() - startUs < us) {
+  }
+}
+
+NativePin* nativePin(int pin) {
+  return pin >= 0 && pin < NATIVE_PINS ? &nativePins[pin] : NULL;
+}
+
+void pinMode(int pin, int mode) {
+  NativePin* p = nativePin(pin);
+  if (p == NULL) return;
+  p->mode = mode;
+  if (mode == INPUT_PULLUP) p->value = HIGH;
+}
+
+void digitalWrite(int pin, int value) {
+  NativePin* p = nativePin(pin);
+  if (p != NULL) p->value = value;
+  if (nativePinWriteHook != NULL) nativePinWriteHook(pin, value);
+}
+
+int digitalRead(int pin) {
+  NativePin* p = nativePin(pin);
+  return p == NULL ? LOW : p->value;
+}
+
+void attachInterrupt(int pin, void (*handler)(), int mode) {
+  NativePin* p = nativePin(pin);
+  if (p == NULL) return;
+  std::lock_guard<std::recursive_mutex> lock(nativeInterruptLock());
+  p->handler = handler;
+  p->interruptMode = mode;
+}
+
+void detachInterrupt(int pin) {
+  attachInterrupt(pin, NULL, 0);
+}
+
+void nativeSetPin(int pin, int value) {
+  NativePin* p = nativePin(pin);
+  if (p == NULL) return;
+  std::lock_guard<std::recursive_mutex> lock(nativeInterruptLock());
+  int old = p->value;
+  p->value = value;
+  bool rising = old == LOW && value != LOW;
+  bool falling = old != LOW && value == LOW;
+  if (p->handler != NULL && ((rising && p->interruptMode != FALLING) || (falling && p->interruptMode != RISING))) {
+    p->handler();
+  }
+}
+
+void noInterrupts() {
+  nativeInterruptLock().lock();
+}
+
+void interrupts() {
+  nativeInterruptLock().unlock();
+}
+
+void tone(int pin, unsigned int frequency, unsigned long durationMs) {
+}
+
+// Print
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(const char* s) {
+  return write(s);
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t) c);
+}
+
+size_t Print::print(const String& s) {
+  return write(s.c_str());
+}
+
+size_t printNumber(Print* p, unsigned long long value, bool negative, int base) {
+  char buffer[72];
+  char* s = &buffer[sizeof(buffer) - 1];
+  *s = 0;
+  if (base < 2) base = 10;
+  do {
+    int digit = value % base;
+    *--s = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value > 0);
+  if (negative) *--s = '-';
+  return p->write(s);
+}
+
+size_t Print::print(long long value, int base) {
+  if (base == 10 && value < 0) return printNumber(this, -(unsigned long long) value, true, base);
+  return printNumber(this, value, false, base);
+}
+
+size_t Print::print(unsigned long long value, int base) {
+  return printNumber(this, value, false, base);
+}
+
+size_t Print::print(int value, int base) {
+  return print((long long) value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return print((unsigned long long) value, base);
+}
+
+size_t Print::print(long value, int base) {
+  return print((long long) value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return print((unsigned long long) value, base);
+}
+
+size_t Print::print(double value, int digits) {
+  if (isnan(value)) return write("nan");
+  if (isinf(value)) return write("inf");
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+  return write(buffer);
+}
+
+size_t Print::println() {
+  return write("\r\n");
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return n <= 0 ? 0 : write((const uint8_t*) buffer, min(size_t(n), sizeof(buffer) - 1));
+}
+
+// String
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t index = s.find(c, from);
+  return index == std::string::npos ? -1 : index;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= s.length()) return String();
+  return String(s.substr(from, min(to, s.length()) - from));
+}
+
+void String::trim() {
+  size_t start = s.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos) {
+    s.clear();
+    return;
+  }
+  s = s.substr(start, s.find_last_not_of(" \t\r\n") - start + 1);
+}
+
+void String::toUpperCase() {
+  for (char& c : s) c = toupper(c);
+}
+
+// Serial
+
+HardwareSerial Serial;
+std::mutex nativeSerialLock;
+std::deque<uint8_t> nativeSerialInput;
+
+void nativeSerialReader() {
+  int c;
+  while ((c = getchar()) != EOF) {
+    std::lock_guard<std::mutex> lock(nativeSerialLock);
+    nativeSerialInput.push_back(c);
+  }
+}
+
+int HardwareSerial::available() {
+  static std::once_flag started;
+  std::call_once(started, [] { std::thread(nativeSerialReader).detach(); });
+  std::lock_guard<std::mutex> lock(nativeSerialLock);
+  return nativeSerialInput.size();
+}
+
+int HardwareSerial::read() {
+  std::lock_guard<std::mutex> lock(nativeSerialLock);
+  if (nativeSerialInput.empty()) return -1;
+  int c = nativeSerialInput.front();
+  nativeSerialInput.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  fwrite(buffer, 1, size, stdout);
+  fflush(stdout);
+  return size;
+}
+
+// ESP
+
+EspClass ESP;
+
+// Always the host clock: virtual time stands still during a motion cycle, profiling needs
+// to see how long the code took.
+uint32_t EspClass::getCycleCount() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - nativeStartTime()).count() * 240 / 1000;
+}
+
+void nativeExit(int code) {
+  fflush(stdout);
+  // Other threads are still running, skip the destructors of globals they use.
+  _exit(code);
+}
+
+// H4_NATIVE_RUN_MS=N stops the process after N milliseconds, for unattended runs.
+struct NativeRunLimit {
+  NativeRunLimit() {
+    nativeStartTime();
+    const char* runMs = getenv("H4_NATIVE_RUN_MS");
+    if (runMs != NULL) {
+      unsigned long ms = strtoul(runMs, NULL, 10);
+      std::thread([ms] {
+        delay(ms);
+        nativeExit(0);
+      }).detach();
+    }
+  }
+};
+NativeRunLimit nativeRunLimit;
@@ -0,0 +1,210 @@
+#pragma once
+
+// Stand-in for the parts of the Arduino-ESP32 core and FreeRTOS that the firmware uses,
+// so that the motion, G-code and mode logic builds and runs on Linux, see [env:native].
+// Tasks are threads, interrupts run on the thread that triggers them under one lock.
+// Hooks for driving the inputs from host code are in native.hpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include <string>
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 1
+#define OUTPUT 2
+#define INPUT_PULLUP 5
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+
+#define PI 3.1415926535897932
+#define HALF_PI 1.5707963267948966
+
+#define B00000 0
+#define B00001 1
+#define B00100 4
+#define B00101 5
+#define B01001 9
+#define B01110 14
+#define B10000 16
+#define B10001 17
+#define B10010 18
+#define B10100 20
+#define B10101 21
+#define B11010 26
+#define B11111 31
+
+#define bitRead(value, bit) (((value) >> (bit)) & 1)
+#define bitWrite(value, bit, b) ((b) ? ((value) |= (1UL << (bit))) : ((value) &= ~(1UL << (bit))))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToInterrupt(p) (p)
+
+typedef uint8_t byte;
+
+template <class A, class B> auto min(A a, B b) -> typename std::common_type<A, B>::type { return a < b ? a : b; }
+template <class A, class B> auto max(A a, B b) -> typename std::common_type<A, B>::type { return a > b ? a : b; }
+using std::abs;
+
+unsigned long micros(); // since start, 64 bits on the host so it never wraps
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+void attachInterrupt(int pin, void (*handler)(), int mode);
+void detachInterrupt(int pin);
+void noInterrupts();
+void interrupts();
+void tone(int pin, unsigned int frequency, unsigned long durationMs);
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+class String;
+
+class Print {
+ public:
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* s) { return write((const uint8_t*) s, strlen(s)); }
+  size_t write(const char* buffer, size_t size) { return write((const uint8_t*) buffer, size); }
+  size_t print(const char* s);
+  size_t print(char c);
+  size_t print(const String& s);
+  size_t print(int value, int base = 10);
+  size_t print(unsigned int value, int base = 10);
+  size_t print(long value, int base = 10);
+  size_t print(unsigned long value, int base = 10);
+  size_t print(long long value, int base = 10);
+  size_t print(unsigned long long value, int base = 10);
+  size_t print(double value, int digits = 2);
+  size_t println();
+  template <class T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  template <class T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+  size_t printf(const char* format, ...);
+  virtual void flush() {}
+  virtual ~Print() {}
+};
+
+class String {
+ public:
+  String(const char* value = "") : s(value) {}
+  String(const std::string& value) : s(value) {}
+  explicit String(char c) : s(1, c) {}
+  explicit String(int value) : s(std::to_string(value)) {}
+  explicit String(long value) : s(std::to_string(value)) {}
+  explicit String(unsigned long value) : s(std::to_string(value)) {}
+  unsigned int length() const { return s.length(); }
+  char charAt(unsigned int index) const { return index < s.length() ? s[index] : 0; }
+  int indexOf(char c, unsigned int from = 0) const;
+  String substring(unsigned int from) const { return substring(from, s.length()); }
+  String substring(unsigned int from, unsigned int to) const;
+  void trim();
+  void toUpperCase();
+  float toFloat() const { return atof(s.c_str()); }
+  long toInt() const { return atol(s.c_str()); }
+  const char* c_str() const { return s.c_str(); }
+  bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+  bool operator==(const String& other) const { return s == other.s; }
+  bool operator==(const char* other) const { return s == other; }
+  bool operator!=(const String& other) const { return s != other.s; }
+  String& operator=(char c) { s.assign(1, c); return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  String& operator+=(const String& other) { s += other.s; return *this; }
+  friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+
+ private:
+  std::string s;
+};
+
+// Output goes to stdout, input comes from stdin.
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud) {}
+  int available();
+  int read();
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+ public:
+  uint32_t getCycleCount(); // derived from the host clock at 240MHz
+  uint32_t getHeapSize() { return 327680; }
+  uint32_t getFreeHeap() { return 262144; }
+  uint32_t getMinFreeHeap() { return 262144; }
+  uint32_t getMaxAllocHeap() { return 262144; }
+};
+extern EspClass ESP;
+
+// FreeRTOS
+
+typedef void* SemaphoreHandle_t;
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+typedef struct { void* unused; } StaticTask_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define configMAX_PRIORITIES 25
+#define pdMS_TO_TICKS(ms) (ms)
+
+void taskYIELD();
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task); // NULL ends the calling task
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskCreatePinnedToCore(void (*code)(void*), const char* name, uint32_t stackSize, void* param, UBaseType_t priority,
+    TaskHandle_t* handle, BaseType_t core);
+// Threads get a large host stack regardless, stackBytes only sets what the high-water mark is taken from.
+TaskHandle_t xTaskCreateStaticPinnedToCore(void (*code)(void*), const char* name, uint32_t stackBytes, void* param,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* tcb, BaseType_t core);
+// Bytes of the stack that were never used, measured on the host stack of the thread.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken);
+inline void portYIELD_FROM_ISR(BaseType_t higherPriorityTaskWoken = pdFALSE) {}
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higherPriorityTaskWoken);
+
+// All critical sections and interrupt handlers share one recursive lock.
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+void portENTER_CRITICAL(portMUX_TYPE* mux);
+void portEXIT_CRITICAL(portMUX_TYPE* mux);
+#define portENTER_CRITICAL_ISR portENTER_CRITICAL
+#define portEXIT_CRITICAL_ISR portEXIT_CRITICAL
+
+// Hardware timers, each one with its own thread calling the handler.
+typedef struct hw_timer_s hw_timer_t;
+hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp);
+void timerAttachInterrupt(hw_timer_t* timer, void (*handler)(), bool edge);
+void timerAlarmWrite(hw_timer_t* timer, uint64_t alarmValue, bool autoreload);
+void timerWrite(hw_timer_t* timer, uint64_t value);
+void timerAlarmEnable(hw_timer_t* timer);
+void timerAlarmDisable(hw_timer_t* timer);
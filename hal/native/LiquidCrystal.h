@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+// HD44780 display RAM only, read back with nativeLcdRow().
+class LiquidCrystal : public Print {
+ public:
+  LiquidCrystal(uint8_t rs, uint8_t rw, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3, uint8_t d4, uint8_t d5, uint8_t d6,
+      uint8_t d7);
+  LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3, uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7);
+  void begin(uint8_t cols, uint8_t rows);
+  void clear();
+  void setCursor(uint8_t col, uint8_t row);
+  void createChar(uint8_t location, uint8_t charmap[]) {}
+  void command(uint8_t value) {}
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  char ddram[128];
+  uint8_t address = 0;
+  uint8_t cols = 16;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// In-memory NVS. Longs are kept at host width, the firmware relies on
+// LONG_MAX and LONG_MIN defaults coming back unchanged.
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false);
+  void end() {}
+  bool clear();
+  int32_t getInt(const char* key, int32_t defaultValue = 0) { return get(key, defaultValue); }
+  long getLong(const char* key, long defaultValue = 0) { return get(key, defaultValue); }
+  bool getBool(const char* key, bool defaultValue = false) { return get(key, defaultValue); }
+  float getFloat(const char* key, float defaultValue = NAN) { return get(key, defaultValue); }
+  size_t putInt(const char* key, int32_t value) { return put(key, value); }
+  size_t putLong(const char* key, long value) { return put(key, value); }
+  size_t putBool(const char* key, bool value) { return put(key, value); }
+  size_t putFloat(const char* key, float value) { return put(key, value); }
+
+ private:
+  std::map<std::string, std::vector<uint8_t>>* values = NULL;
+
+  template <class T> T get(const char* key, T defaultValue) {
+    if (values == NULL || values->count(key) == 0 || (*values)[key].size() != sizeof(T)) return defaultValue;
+    T value;
+    memcpy(&value, (*values)[key].data(), sizeof(T));
+    return value;
+  }
+
+  template <class T> size_t put(const char* key, T value) {
+    if (values == NULL) return 0;
+    (*values)[key].assign((const uint8_t*) &value, (const uint8_t*) &value + sizeof(T));
+    return sizeof(T);
+  }
+};
@@ -0,0 +1,113 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <LiquidCrystal.h>
+#include <Adafruit_TCA8418.h>
+#include <Preferences.h>
+#include <deque>
+#include <mutex>
+#include "native.hpp"
+
+TwoWire Wire;
+
+// LiquidCrystal
+
+LiquidCrystal* nativeLcd = NULL;
+
+LiquidCrystal::LiquidCrystal(uint8_t rs, uint8_t rw, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3, uint8_t d4,
+    uint8_t d5, uint8_t d6, uint8_t d7) {
+  memset(ddram, ' ', sizeof(ddram));
+  nativeLcd = this;
+}
+
+LiquidCrystal::LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3, uint8_t d4, uint8_t d5,
+    uint8_t d6, uint8_t d7) : LiquidCrystal(rs, 255, enable, d0, d1, d2, d3, d4, d5, d6, d7) {
+}
+
+void LiquidCrystal::begin(uint8_t c, uint8_t r) {
+  cols = c;
+  clear();
+}
+
+void LiquidCrystal::clear() {
+  memset(ddram, ' ', sizeof(ddram));
+  address = 0;
+}
+
+// Same row addresses as the Arduino library: rows 2 and 3 continue rows 0 and 1.
+uint8_t nativeLcdRowAddress(uint8_t cols, int row) {
+  return (row % 2 == 0 ? 0x00 : 0x40) + (row >= 2 ? cols : 0);
+}
+
+void LiquidCrystal::setCursor(uint8_t col, uint8_t row) {
+  address = nativeLcdRowAddress(cols, row) + col;
+}
+
+size_t LiquidCrystal::write(uint8_t c) {
+  ddram[address & 0x7f] = c;
+  address++;
+  return 1;
+}
+
+std::string nativeLcdRow(int row) {
+  if (nativeLcd == NULL) return "";
+  uint8_t address = nativeLcdRowAddress(nativeLcd->cols, row);
+  return std::string(&nativeLcd->ddram[address & 0x7f], nativeLcd->cols);
+}
+
+// Adafruit_TCA8418
+
+std::mutex nativeKeypadLock;
+std::deque<uint8_t> nativeKeypadEvents;
+unsigned long nativeKeypadTransactions = 0;
+
+void nativeKeypadEvent(uint8_t event) {
+  std::lock_guard<std::mutex> lock(nativeKeypadLock);
+  nativeKeypadEvents.push_back(event);
+}
+
+void Adafruit_TCA8418::flush() {
+  std::lock_guard<std::mutex> lock(nativeKeypadLock);
+  nativeKeypadEvents.clear();
+}
+
+uint8_t Adafruit_TCA8418::available() {
+  std::lock_guard<std::mutex> lock(nativeKeypadLock);
+  nativeKeypadTransactions++;
+  return min(nativeKeypadEvents.size(), size_t(10)); // the chip's FIFO holds 10 events
+}
+
+uint8_t Adafruit_TCA8418::getEvent() {
+  std::lock_guard<std::mutex> lock(nativeKeypadLock);
+  nativeKeypadTransactions++;
+  if (nativeKeypadEvents.empty()) return 0;
+  uint8_t event = nativeKeypadEvents.front();
+  nativeKeypadEvents.pop_front();
+  return event;
+}
+
+uint8_t Adafruit_TCA8418::readRegister(uint8_t reg) {
+  std::lock_guard<std::mutex> lock(nativeKeypadLock);
+  nativeKeypadTransactions++;
+  return 0;
+}
+
+void Adafruit_TCA8418::writeRegister(uint8_t reg, uint8_t value) {
+  std::lock_guard<std::mutex> lock(nativeKeypadLock);
+  nativeKeypadTransactions++;
+}
+
+// Preferences
+
+std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nativePreferences;
+std::mutex nativePreferencesLock;
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  std::lock_guard<std::mutex> lock(nativePreferencesLock);
+  values = &nativePreferences[name];
+  return true;
+}
+
+bool Preferences::clear() {
+  if (values != NULL) values->clear();
+  return true;
+}
@@ -0,0 +1,165 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <driver/pcnt.h>
+#include <hal/brownout_hal.h>
+#include <soc/rtc_cntl_reg.h>
+#include "native.hpp"
+#include "internal.hpp"
+
+// Flash partitions from partitions.csv that the firmware opens. Starts erased, or
+// H4_NATIVE_FLASH names a file that keeps the contents between runs.
+
+const uint32_t NATIVE_STATE_SIZE = 0x10000;
+uint8_t nativeStateFlash[NATIVE_STATE_SIZE];
+const esp_partition_t nativeStatePartition = {0x3e0000, NATIVE_STATE_SIZE, "state"};
+
+void nativeFlashSave() {
+  const char* path = getenv("H4_NATIVE_FLASH");
+  FILE* f = path == NULL ? NULL : fopen(path, "wb");
+  if (f == NULL) return;
+  fwrite(nativeStateFlash, 1, NATIVE_STATE_SIZE, f);
+  fclose(f);
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+  if (type != ESP_PARTITION_TYPE_DATA || subtype != 0x40 || strcmp(label, nativeStatePartition.label) != 0) {
+    return NULL;
+  }
+  memset(nativeStateFlash, 0xff, NATIVE_STATE_SIZE);
+  const char* path = getenv("H4_NATIVE_FLASH");
+  FILE* f = path == NULL ? NULL : fopen(path, "rb");
+  if (f != NULL) {
+    fread(nativeStateFlash, 1, NATIVE_STATE_SIZE, f);
+    fclose(f);
+  }
+  return &nativeStatePartition;
+}
+
+bool nativeFlashInRange(const esp_partition_t* p, size_t offset, size_t size) {
+  return p == &nativeStatePartition && offset <= p->size && size <= p->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* p, size_t offset, void* dst, size_t size) {
+  if (!nativeFlashInRange(p, offset, size)) return ESP_ERR_INVALID_ARG;
+  memcpy(dst, &nativeStateFlash[offset], size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* p, size_t offset, const void* src, size_t size) {
+  if (!nativeFlashInRange(p, offset, size)) return ESP_ERR_INVALID_ARG;
+  // NOR flash can only clear bits, erasing sets them back.
+  for (size_t i = 0; i < size; i++) nativeStateFlash[offset + i] &= ((const uint8_t*) src)[i];
+  nativeFlashSave();
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* p, size_t offset, size_t size) {
+  if (!nativeFlashInRange(p, offset, size) || offset % 4096 != 0 || size % 4096 != 0) return ESP_ERR_INVALID_ARG;
+  memset(&nativeStateFlash[offset], 0xff, size);
+  nativeFlashSave();
+  return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int i = 0; i < 8; i++) crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+  }
+  return ~crc;
+}
+
+void (*nativeRestartHook)() = NULL;
+
+void esp_restart(void) {
+  if (nativeRestartHook != NULL) {
+    nativeRestartHook();
+    return;
+  }
+  nativeExit(0);
+}
+
+// Pulse counter: only the count and its limits, the channels are fed by nativePcntAdd().
+
+struct NativePcntUnit {
+  int16_t count;
+  int16_t highLimit;
+  int16_t lowLimit;
+  bool paused;
+};
+
+NativePcntUnit nativePcntUnits[PCNT_UNIT_MAX];
+
+esp_err_t pcnt_unit_config(const pcnt_config_t* config) {
+  if (config->unit < 0 || config->unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  nativePcntUnits[config->unit].highLimit = config->counter_h_lim;
+  nativePcntUnits[config->unit].lowLimit = config->counter_l_lim;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t value) {
+  return ESP_OK;
+}
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit) {
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit) {
+  nativePcntUnits[unit].paused = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit) {
+  nativePcntUnits[unit].count = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit) {
+  nativePcntUnits[unit].paused = false;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t* count) {
+  *count = __atomic_load_n(&nativePcntUnits[unit].count, __ATOMIC_RELAXED);
+  return ESP_OK;
+}
+
+void nativePcntAdd(int unit, int counts) {
+  NativePcntUnit* u = &nativePcntUnits[unit];
+  std::lock_guard<std::recursive_mutex> lock(nativeInterruptLock());
+  if (u->paused) return;
+  for (; counts != 0; counts += counts > 0 ? -1 : 1) {
+    int16_t count = u->count + (counts > 0 ? 1 : -1);
+    __atomic_store_n(&u->count, count == u->highLimit || count == u->lowLimit ? 0 : count, __ATOMIC_RELAXED);
+  }
+}
+
+// Brownout detector: configuration is ignored, nativeSetBrownout() raises its flag.
+
+uint32_t nativeRtcIntRaw = 0;
+
+void brownout_hal_config(const brownout_hal_config_t* cfg) {
+}
+
+void brownout_hal_intr_enable(bool enable) {
+}
+
+void brownout_hal_intr_clear(void) {
+  __atomic_and_fetch(&nativeRtcIntRaw, ~RTC_CNTL_BROWN_OUT_INT_RAW, __ATOMIC_RELAXED);
+}
+
+void nativeSetBrownout(bool value) {
+  if (value) {
+    __atomic_or_fetch(&nativeRtcIntRaw, RTC_CNTL_BROWN_OUT_INT_RAW, __ATOMIC_RELAXED);
+  } else {
+    brownout_hal_intr_clear();
+  }
+}
+
+uint32_t nativeRegRead(uint32_t reg) {
+  return reg == RTC_CNTL_INT_RAW_REG ? __atomic_load_n(&nativeRtcIntRaw, __ATOMIC_RELAXED) : 0;
+}
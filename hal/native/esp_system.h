@@ -0,0 +1,3 @@
+#pragma once
+
+void esp_restart(void); // ends the process, see nativeExit()
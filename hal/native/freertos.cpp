@@ -0,0 +1,296 @@
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <pthread.h>
+#include <string.h>
+#include "internal.hpp"
+
+// Thrown by vTaskDelete(NULL) to unwind the task's thread.
+struct NativeTaskExit {};
+
+struct NativeTask {
+  std::string name;
+  std::mutex lock;
+  std::condition_variable notified;
+  uint32_t notifications = 0;
+  uint32_t stackBytes = 0; // as requested by the firmware
+  uint8_t* stack = NULL; // host stack, filled with NATIVE_STACK_FILL
+  uint8_t* stackTop = NULL; // where the task function's frame starts
+};
+
+// Host stacks are larger than any firmware one, their untouched bottom shows how deep the task got.
+const size_t NATIVE_STACK_BYTES = 1 << 20;
+const uint8_t NATIVE_STACK_FILL = 0xa5;
+
+thread_local NativeTask* nativeCurrentTask = NULL;
+
+NativeTask* nativeTaskOfThisThread() {
+  // Threads that weren't created as tasks, like the one running setup(), get one on first use.
+  if (nativeCurrentTask == NULL) nativeCurrentTask = new NativeTask();
+  return nativeCurrentTask;
+}
+
+// Waits until ready() or the ticks pass, returns ready().
+template <class Predicate> bool nativeWait(std::unique_lock<std::mutex>& lock, std::condition_variable& cv, TickType_t ticks, Predicate ready) {
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+}
+
+void taskYIELD() {
+  if (nativeVirtualTimeUsed()) {
+    nativeVirtualYield();
+    return;
+  }
+  std::this_thread::yield();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  if (nativeVirtualTimeUsed()) {
+    delay(ticks * portTICK_PERIOD_MS);
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task != NULL && task != nativeCurrentTask) {
+    return; // not used by the firmware
+  }
+  if (nativeCurrentTask != NULL && !nativeCurrentTask->name.empty()) {
+    throw NativeTaskExit();
+  }
+  // The Arduino loop task deletes itself, park the main thread instead of ending the process.
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::hours(1));
+  }
+}
+
+TickType_t xTaskGetTickCount() {
+  return millis() / portTICK_PERIOD_MS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return nativeTaskOfThisThread();
+}
+
+struct NativeTaskStart {
+  NativeTask* task;
+  void (*code)(void*);
+  void* param;
+};
+
+void* nativeRunTask(void* arg) {
+  NativeTaskStart start = *(NativeTaskStart*) arg;
+  delete (NativeTaskStart*) arg;
+  nativeCurrentTask = start.task;
+  start.task->stackTop = (uint8_t*) __builtin_frame_address(0);
+  try {
+    start.code(start.param);
+  } catch (const NativeTaskExit&) {
+  }
+  return NULL;
+}
+
+NativeTask* nativeStartTask(void (*code)(void*), const char* name, uint32_t stackBytes, void* param) {
+  NativeTask* task = new NativeTask();
+  task->name = name;
+  task->stackBytes = stackBytes;
+  task->stack = new uint8_t[NATIVE_STACK_BYTES];
+  memset(task->stack, NATIVE_STACK_FILL, NATIVE_STACK_BYTES);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, task->stack, NATIVE_STACK_BYTES);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_t thread;
+  pthread_create(&thread, &attr, nativeRunTask, new NativeTaskStart{task, code, param});
+  pthread_attr_destroy(&attr);
+  return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*code)(void*), const char* name, uint32_t stackSize, void* param, UBaseType_t priority,
+    TaskHandle_t* handle, BaseType_t core) {
+  NativeTask* task = nativeStartTask(code, name, stackSize, param);
+  if (handle != NULL) *handle = task;
+  return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(void (*code)(void*), const char* name, uint32_t stackBytes, void* param,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* tcb, BaseType_t core) {
+  return nativeStartTask(code, name, stackBytes, param);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+  NativeTask* task = handle == NULL ? nativeTaskOfThisThread() : (NativeTask*) handle;
+  if (task->stack == NULL || task->stackTop == NULL) return 0;
+  uint8_t* deepest = task->stack;
+  while (deepest < task->stackTop && *deepest == NATIVE_STACK_FILL) deepest++;
+  long used = task->stackTop - deepest;
+  return used < task->stackBytes ? task->stackBytes - used : 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  NativeTask* task = nativeTaskOfThisThread();
+  std::unique_lock<std::mutex> lock(task->lock);
+  nativeWait(lock, task->notified, ticks, [task] { return task->notifications > 0; });
+  uint32_t value = task->notifications;
+  if (value > 0) task->notifications = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+  NativeTask* task = (NativeTask*) handle;
+  {
+    std::lock_guard<std::mutex> lock(task->lock);
+    task->notifications++;
+  }
+  task->notified.notify_all();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t* higherPriorityTaskWoken) {
+  if (handle != NULL) xTaskNotifyGive(handle);
+}
+
+// Semaphores. Unlike std::mutex, a FreeRTOS mutex taken by one task can be given by another.
+
+struct NativeSemaphore {
+  std::mutex lock;
+  std::condition_variable given;
+  int count;
+};
+
+SemaphoreHandle_t nativeSemaphoreCreate(int count) {
+  NativeSemaphore* semaphore = new NativeSemaphore();
+  semaphore->count = count;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return nativeSemaphoreCreate(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return nativeSemaphoreCreate(0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+  NativeSemaphore* semaphore = (NativeSemaphore*) handle;
+  std::unique_lock<std::mutex> lock(semaphore->lock);
+  if (!nativeWait(lock, semaphore->given, ticks, [semaphore] { return semaphore->count > 0; })) {
+    return pdFALSE;
+  }
+  semaphore->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+  NativeSemaphore* semaphore = (NativeSemaphore*) handle;
+  {
+    std::lock_guard<std::mutex> lock(semaphore->lock);
+    if (semaphore->count > 0) return pdFALSE;
+    semaphore->count = 1;
+  }
+  semaphore->given.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t handle, BaseType_t* higherPriorityTaskWoken) {
+  return xSemaphoreGive(handle);
+}
+
+void portENTER_CRITICAL(portMUX_TYPE* mux) {
+  nativeInterruptLock().lock();
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+  nativeInterruptLock().unlock();
+}
+
+// Timers count at 80MHz / divider.
+
+struct hw_timer_s {
+  std::mutex lock;
+  std::condition_variable changed;
+  uint16_t divider;
+  uint64_t alarmValue = 0;
+  bool enabled = false;
+  void (*handler)() = NULL;
+  std::chrono::steady_clock::time_point startTime;
+  bool started = false;
+};
+
+std::chrono::nanoseconds nativeTimerPeriod(hw_timer_t* timer) {
+  return std::chrono::nanoseconds(timer->alarmValue * timer->divider * 1000 / 80);
+}
+
+void nativeTimerThread(hw_timer_t* timer) {
+  std::unique_lock<std::mutex> lock(timer->lock);
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  while (true) {
+    timer->changed.wait(lock, [timer] { return timer->enabled && timer->handler != NULL && timer->alarmValue > 0; });
+    if (timer->started) {
+      timer->started = false;
+      next = timer->startTime;
+    }
+    next += nativeTimerPeriod(timer);
+    if (timer->changed.wait_until(lock, next, [timer] { return timer->started || !timer->enabled; })) {
+      continue;
+    }
+    void (*handler)() = timer->handler;
+    lock.unlock();
+    {
+      std::lock_guard<std::recursive_mutex> interruptLock(nativeInterruptLock());
+      handler();
+    }
+    lock.lock();
+  }
+}
+
+hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp) {
+  // Can run before main(), see tasks.cpp, so don't start threads yet.
+  hw_timer_t* timer = new hw_timer_t();
+  timer->divider = divider;
+  return timer;
+}
+
+void timerAttachInterrupt(hw_timer_t* timer, void (*handler)(), bool edge) {
+  std::lock_guard<std::mutex> lock(timer->lock);
+  if (timer->handler == NULL) std::thread(nativeTimerThread, timer).detach();
+  timer->handler = handler;
+  timer->changed.notify_all();
+}
+
+void timerAlarmWrite(hw_timer_t* timer, uint64_t alarmValue, bool autoreload) {
+  std::lock_guard<std::mutex> lock(timer->lock);
+  timer->alarmValue = alarmValue;
+  timer->changed.notify_all();
+}
+
+void timerWrite(hw_timer_t* timer, uint64_t value) {
+  std::lock_guard<std::mutex> lock(timer->lock);
+  timer->startTime = std::chrono::steady_clock::now() - std::chrono::nanoseconds(value * timer->divider * 1000 / 80);
+  timer->started = true;
+  timer->changed.notify_all();
+}
+
+void timerAlarmEnable(hw_timer_t* timer) {
+  std::lock_guard<std::mutex> lock(timer->lock);
+  if (!timer->enabled) {
+    timer->startTime = std::chrono::steady_clock::now();
+    timer->started = true;
+  }
+  timer->enabled = true;
+  timer->changed.notify_all();
+}
+
+void timerAlarmDisable(hw_timer_t* timer) {
+  std::lock_guard<std::mutex> lock(timer->lock);
+  timer->enabled = false;
+  timer->changed.notify_all();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+  int threshold;
+  bool enabled;
+  bool reset_enabled;
+  bool flash_power_down;
+  bool rf_power_down;
+} brownout_hal_config_t;
+
+void brownout_hal_config(const brownout_hal_config_t* cfg);
+void brownout_hal_intr_enable(bool enable);
+void brownout_hal_intr_clear(void);
@@ -0,0 +1,11 @@
+#pragma once
+
+// Shared between the native stand-ins, not for firmware or host code.
+
+#include <mutex>
+
+// Held by critical sections, noInterrupts() and while interrupt handlers run.
+std::recursive_mutex& nativeInterruptLock();
+bool nativeVirtualTimeUsed();
+// Runs nativeVirtualWaitHook once, unless called from within it.
+void nativeVirtualYield();
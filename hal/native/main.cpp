@@ -0,0 +1,13 @@
+#include <Arduino.h>
+
+void setup();
+void loop();
+
+// The Arduino core's entry point. Host programs that drive the firmware code
+// themselves, like the simulator, leave this file out and bring their own.
+int main() {
+  setup();
+  while (true) {
+    loop();
+  }
+}
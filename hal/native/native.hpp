@@ -0,0 +1,33 @@
+#pragma once
+
+// Hooks for host code driving the native build: simulated machine, benchmarks, tests.
+
+#include <Arduino.h>
+
+// Sets an input pin and runs its interrupt handler if the change matches its mode.
+void nativeSetPin(int pin, int value);
+// Called after every digitalWrite(), e.g. to count step pulses. Runs on the writing thread.
+extern void (*nativePinWriteHook)(int pin, int value);
+// Adds counts to a pulse counter unit, resetting it at its limits like the hardware does.
+void nativePcntAdd(int unit, int counts);
+// Queues a TCA8418 key event: key number, plus 0x80 for pressed.
+void nativeKeypadEvent(uint8_t event);
+// TCA8418 register reads and writes so far, each one an I2C transaction on the lathe.
+extern unsigned long nativeKeypadTransactions;
+// Raises the brownout flag that powerFailDetected() polls.
+void nativeSetBrownout(bool value);
+// Row of the 20x4 screen as shown, row is 0 to 3.
+std::string nativeLcdRow(int row);
+// Makes micros() and all delays use a clock that only nativeAdvanceMicros() moves, for
+// driving the motion code cycle by cycle from a single thread. Call before anything else.
+void nativeUseVirtualTime();
+void nativeAdvanceMicros(unsigned long us);
+// With virtual time, run by taskYIELD() and repeatedly by delays until the clock passes
+// their end. Lets firmware code that waits for the motion task run on the thread that
+// drives it, the hook runs a motion cycle. Not re-entered: waits inside it jump the clock.
+extern void (*nativeVirtualWaitHook)();
+// Stops the process, run by esp_restart() too.
+void nativeExit(int code);
+// If set, esp_restart() runs this and returns instead of stopping the process, lets a test
+// boot the firmware again from what it saved.
+extern void (*nativeRestartHook)();
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#define RTC_CNTL_INT_RAW_REG 0x6000803c
+#define RTC_CNTL_BROWN_OUT_INT_RAW (1u << 9)
+
+// No memory mapped registers on the host, reads go to the stand-ins instead.
+uint32_t nativeRegRead(uint32_t reg);
+#define REG_READ(reg) nativeRegRead(reg)
+#define REG_GET_BIT(reg, bit) (nativeRegRead(reg) & (bit))
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "config.hpp"
+
+// Heap allocation counting for the benchmarks and for checking that steady-state code
+// doesn't allocate. Built with -D ALLOC_COUNTER=true, malloc, calloc and realloc must be
+// wrapped by the linker: -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc. Frees aren't counted.
+
+const int ALLOC_TAGS = 16; // tag 0 is everything not tagged, e.g. setup() and system tasks
+
+struct AllocationStats {
+  unsigned long count;
+  unsigned long bytes; // requested in total, not what's still allocated
+};
+
+// Allocations since boot in all tasks, -1 if not counted.
+long getAllocationCount();
+// Counts allocations of the calling task under tag from now on, see startTask().
+void setAllocationTag(int tag);
+AllocationStats getAllocationStats(int tag);
@@ -2,8 +2,6 @@
 #include <Arduino.h>
 
 struct Axis {
-  SemaphoreHandle_t mutex;
-
   char name;
   bool active;
   bool rotational;
@@ -11,31 +9,22 @@ struct Axis {
   float screwPitch; // lead screw pitch in deci-microns (10^-7 of a meter)
 
   long pos; // relative position of the tool in stepper motor steps
-  long savedPos; // value saved in Preferences
   float fractionalPos; // fractional distance in steps that we meant to travel but couldn't
   long originPos; // relative position of the stepper motor to origin, in steps
-  long savedOriginPos; // originPos saved in Preferences
   long posGlobal; // global position of the motor in steps
-  long savedPosGlobal; // posGlobal saved in Preferences
   int pendingPos; // steps of the stepper motor that we should make as soon as possible
   long motorPos; // position of the motor in stepper motor steps, same as pos unless moving back, then differs by backlashSteps
-  long savedMotorPos; // motorPos saved in Preferences
   bool continuous; // whether current movement is expected to continue until an unknown position
 
   long leftStop; // left stop value of pos
-  long savedLeftStop; // value saved in Preferences
-  long nextLeftStop; // left stop value that should be applied asap
-  bool nextLeftStopFlag; // whether nextLeftStop required attention
 
   long rightStop; // right stop value of pos
-  long savedRightStop; // value saved in Preferences
-  long nextRightStop; // right stop value that should be applied asap
-  bool nextRightStopFlag; // whether nextRightStop requires attention
 
   long speed; // motor speed in steps / second
   long speedStart; // Initial speed of a motor, steps / second.
   long speedMax; // To limit max speed e.g. for manual moves
   long speedManualMove; // Maximum speed of a motor during manual move, steps / second.
+  long speedFollow; // Speed needed to keep up with the spindle, steps / second. Set every cycle by modes following it, 0 otherwise.
   long acceleration; // Acceleration of a motor, steps / second ^ 2.
   long decelerateSteps; // Number of steps before the end position the deceleration should start.
 
@@ -44,7 +33,6 @@ struct Axis {
   unsigned long stepStartUs;
   int stepperEnableCounter;
   bool disabled;
-  bool savedDisabled;
 
   bool invertStepper; // change (true/false) if the carriage moves e.g. "left" when you press "right".
   bool needsRest; // set to false for closed-loop drivers, true for open-loop.
@@ -95,5 +83,5 @@ long getMoveStepForAxis(Axis* a);
 long getStepMaxSpeed(Axis* a);
 void waitForStep(Axis* a);
 int getAndResetPulses(Axis* a);
-// Calculates stepper position from spindle position.
-long posFromSpindle(Axis* a, long s, bool respectStops);
\ No newline at end of file
+// Calculates stepper position from spindle position s plus a fraction of an encoder step.
+long posFromSpindle(Axis* a, long s, float fraction, bool respectStops);
\ No newline at end of file
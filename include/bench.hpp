@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// Microbenchmarks of the firmware hot paths with representative inputs, run with $B over
+// serial when built with -D BENCH=true, on the ESP32 (env:bench) or on the host (env:native).
+// Prints one [BN:name,iterations,ns per op,allocations] line per benchmark, the time includes
+// the loop around the call, see the "empty" line. tools/benchcmp.py compares two runs.
+// Then [LCD:frames,bytes sent per frame,bytes per frame if changed lines were rewritten in full]
+// for all frames since boot.
+// Refused while on. Axes aren't moved: Z is disabled while its step pin is toggled.
+// With ALLOC_COUNTER, any benchmark that allocates is an error and $B doesn't answer "ok".
+
+const int BENCH_RESULTS = 16;
+
+struct BenchResult {
+  const char* name;
+  unsigned long iterations;
+  float nsPerOp;
+  long allocations; // heap allocations during all iterations, -1 unless built with ALLOC_COUNTER
+};
+
+// Only to be called from the motion task, for MOTION_CMD_BENCH. Stalls it until done,
+// restores the motion state it changed afterwards.
+void runMotionBenchmarks();
+// Only to be called from taskDisplay: runs the display and save benchmarks if $B asked for them.
+void runRequestedDisplayBenchmarks();
+// Only to be called from the G-code task. Runs everything and prints the results.
+bool runBenchmarks();
@@ -3,12 +3,21 @@
 /* Change values in this section to suit your hardware. */
 
 // Define your hardware parameters here.
-const int ENCODER_STEPS_INT = 1024; // 600 step spindle optical rotary encoder. Fractional values not supported.
+const int ENCODER_PPR = 1024; // Lines of the spindle optical rotary encoder, pulses per revolution on each channel.
+const bool ENCODER_PCNT = true; // Count every edge of both channels in the pulse counter, false counts falling edges of ENC_A in an interrupt.
+const int ENCODER_STEPS_INT = ENCODER_PCNT ? 4 * ENCODER_PPR : ENCODER_PPR; // Spindle positions per revolution. Fractional values not supported.
+const int ENCODER_FILTER_CYCLES = 100; // Pulse counter ignores pulses shorter than this many 80MHz cycles, max 1023. Edges at max RPM must be further apart.
 const int ENCODER_BACKLASH = 0; // was 3 Number of impulses encoder can issue without movement of the spindle
 
 // Spindle rotary encoder pins. Swap values if the rotation direction is wrong.
 #define ENC_A 7
 #define ENC_B 15
+// Encoder index (Z) output, one pulse per revolution. Wire it to a free GPIO and put its
+// number here to keep the spindle phase exact for threading. -1 if not connected. The phase
+// is set by the first pulse after boot that comes while off.
+#ifndef ENC_Z
+#define ENC_Z -1
+#endif
 
 // Main lead screw (Z) parameters.
 const long SCREW_Z_DU = 5386; // was 5386 8 TPI lead 2:1 gearbox 3:1 pulleys in deci-microns (10^-7 of a meter)
@@ -40,3 +49,19 @@ const char NAME_X = 'X'; // Text shown on screen before axis position value, GCo
 const long STEP_TIME_MS = 500; // Time in milliseconds it should take to make 1 manual step.
 const long DELAY_BETWEEN_STEPS_MS = 80; // Time in milliseconds to wait between steps.
 
+// Cycle counter profiling of the motion loop and interrupts, dumped with $P over serial.
+// Costs a few dozen cycles per zone, so it's off unless built with -D PROFILER=true.
+#ifndef PROFILER
+#define PROFILER false
+#endif
+
+// Microbenchmarks of the hot paths run with $B over serial, see bench.hpp. They stall the
+// motion task for about a second, so they're left out unless built with -D BENCH=true.
+#ifndef BENCH
+#define BENCH false
+#endif
+
+// Heap allocation counting, see alloc.hpp. Needs the linker flags of env:bench.
+#ifndef ALLOC_COUNTER
+#define ALLOC_COUNTER false
+#endif
@@ -7,7 +7,6 @@ extern bool splashScreen;
 
 // === Used in main
 
-extern long savedMoveStep; // moveStep saved in Preferences
 
 void updateDisplay();
 void displayEstop();
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Spindle rotary encoder input. With ENCODER_PCNT the pulse counter peripheral counts
+// every edge of both channels (4 counts per line) without any interrupts, otherwise
+// spinEnc() counts falling edges of ENC_A (1 count per line). Both report through the
+// same two calls so that a host build can provide its own counts instead.
+
+// Starts counting, called once from core 0.
+void encoderSetup();
+// Counts since the previous call, positive in the forward direction.
+// Only called by the motion task.
+long encoderTakeDelta();
+// Returns true if an index pulse came since the previous call and sets countsSinceIndex to
+// the counts from the pulse to the reading encoderTakeDelta() returned. Only called by the motion task.
+bool encoderTakeIndex(long* countsSinceIndex);
@@ -1,3 +1,7 @@
 #pragma once
 
+#include <Arduino.h>
+
+// Process one command, return ok flag.
+bool handleGcodeCommand(const char* command);
 void taskGcode(void *param);
\ No newline at end of file
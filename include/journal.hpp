@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define JOURNAL_PARTITION_LABEL "state" // see partitions.csv
+#define JOURNAL_PARTITION_SUBTYPE 0x40 // first custom data subtype
+
+const int JOURNAL_SECTOR_SIZE = 4096; // flash erase unit
+const int JOURNAL_SLOT_SIZE = 256; // every record takes one slot, 16 per sector
+const int JOURNAL_DATA_MAX = JOURNAL_SLOT_SIZE - 16; // slot minus header and CRC
+
+// Records are appended one slot after another and wrap around the partition. Once a
+// record starts a sector, journalEraseAhead() erases the one after it while the machine
+// is idle, so that a blank slot is always ready and a save is only ever a slot write.
+// An erase stops code running from flash on both cores for tens of ms.
+//
+// Wear: the 64KB partition holds 256 slots, so each sector is erased once per 256
+// saves. Saves only happen after SAVE_DELAY_US of quiet, i.e. at most 720 per hour
+// of constant fiddling. 8 hours of that a day is 5760 saves = 23 erases per sector,
+// 100000 rated erase cycles would last ~12 years. Real use saves far less often.
+
+struct JournalStats {
+  unsigned long saves; // records written since boot
+  unsigned long erases; // sectors erased since boot
+  unsigned long worstWriteUs; // longest record write, interrupts that aren't in IRAM are blocked for this long
+  unsigned long worstEraseUs; // longest sector erase, same but happens once per 16 saves and never while saving
+};
+
+// Finds the partition and the latest record, returns false if there's no partition.
+bool journalSetup();
+// Copies up to maxSize bytes of the latest valid record, returns its size or -1 if there's none.
+int journalLoad(void* data, int maxSize);
+// Writes data as a new record without erasing, returns false if it couldn't.
+bool journalAppend(const void* data, int size);
+// Erases the sector the journal gets to next if it's due and not blank yet, returns true if it erased.
+bool journalEraseAhead();
+JournalStats getJournalStats();
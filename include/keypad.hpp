@@ -24,7 +24,16 @@ extern unsigned long keypadTimeUs;
 
 bool keypadSetup();
 bool keypadAvailable();
+// Handles one TCA8418 event: key code plus 0x80 if pressed.
+void processKeypadEvent(int event);
+// Handles all events queued in the TCA8418 FIFO in one burst.
+void processKeypadEvents();
 void taskKeypad(void *param);
 void setMeasure(int value);
-bool stepToFinal(Axis* a, long newPos);
-bool stepToContinuous(Axis* a, long newPos);
\ No newline at end of file
+// Must be called from the motion task, use the FromTask variants from other tasks.
+void stepTo(Axis* a, long newPos, bool continuous);
+void stepToFinal(Axis* a, long newPos);
+void stepToContinuous(Axis* a, long newPos);
+// Has the motion task apply the move and waits for it, returns false if motion is stopped.
+bool stepToFinalFromTask(Axis* a, long newPos);
+bool stepToContinuousFromTask(Axis* a, long newPos);
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+#include <LiquidCrystal.h>
+
+#define LCD_COLS 20
+#define LCD_ROWS 4
+#define LCD_BYTES_PER_SLICE 4 // Each byte takes ~0.2ms in 4-bit mode, don't hold the calling task longer than ~1ms
+
+// Text buffer the display code renders into instead of writing to the screen directly.
+// lcdFlush() then sends only the characters that differ from what's on the screen.
+class LcdFrame : public Print {
+ public:
+  char cells[LCD_ROWS][LCD_COLS];
+
+  void clear();
+  void setCursor(int col, int row);
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+ private:
+  int col = 0;
+  int row = 0;
+};
+
+extern LcdFrame lcd; // what should be on the screen
+extern LiquidCrystal lcdScreen; // the physical screen, only to be written to by lcdFlush() and lcdSetup()
+extern unsigned long lcdBusWrites; // number of bytes sent to the screen, including cursor moves
+extern unsigned long lcdFrames; // frames counted by lcdFrameRendered()
+extern unsigned long lcdLineWrites; // bytes that rewriting every changed line in full would have sent instead
+
+// Must be called after lcdScreen.clear() to keep track of what's shown.
+void lcdScreenCleared();
+// Counts a frame fully rendered into lcd, call before flushing it.
+void lcdFrameRendered();
+// Writes up to maxBytes of changed characters to the screen, returns true if the screen is up to date.
+bool lcdFlush(int maxBytes);
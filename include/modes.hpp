@@ -14,18 +14,17 @@
 #define MODE_A1 10
 
 extern volatile int mode; // mode of operation (ELS, multi-start ELS, asynchronous)
-extern int nextMode; // mode value that should be applied asap
-extern bool nextModeFlag; // whether nextMode needs attention
-extern int savedMode; // mode saved in Preferences
 
 extern bool isOn;
-extern bool nextIsOn; // isOn value that should be applied asap
-extern bool nextIsOnFlag; // whether nextIsOn requires attention
 
 bool isPassMode();
 long getPassModeZStart();
 long getPassModeXStart();
 int getLastSetupIndex();
+long getPassModePasses();
+Axis* getSpindleFollowingAxis();
+long getMaxRpm(long duprValue, int startsValue);
+long getResumableOpIndex();
 void setModeFromTask(int value);
 
 // Used in keypad
@@ -39,10 +38,13 @@ void setStarts(int value);
 void setConeRatio(float value);
 void setModeFromLoop(int value);
 void setIsOnFromLoop(bool on);
+// Must be called from the motion task, use setStarts() from other tasks.
+void applyStarts(int value);
 // Loose the thread and mark current physical positions of
 // encoder and stepper as a new 0. To be called when dupr changes
 // or ELS is turned on/off. Without this, changing dupr will
 // result in stepper rushing across the lathe to the new position.
-// Must be called while holding motionMutex.
+// Must be called from the motion task, post MOTION_CMD_MARK_ORIGIN from other tasks.
 void markOrigin();
+// Must be called from the motion task, post MOTION_CMD_ASYNC_DIRECTION from other tasks.
 void updateAsyncTimerSettings();
\ No newline at end of file
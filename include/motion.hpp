@@ -0,0 +1,136 @@
+#pragma once
+
+#include <Arduino.h>
+#include "axis.hpp"
+
+#define MOTION_CMD_MARK_ORIGIN 1 // markOrigin()
+#define MOTION_CMD_SPINDLE_SHIFT 2 // add value to spindle position, then catch up with value2
+#define MOTION_CMD_SPINDLE_CATCH_UP 3 // add value to spindle position until it's past value2
+#define MOTION_CMD_DUPR 4 // set dupr to value
+#define MOTION_CMD_STARTS 5 // set starts to value
+#define MOTION_CMD_CONE_RATIO 6 // set coneRatio to ratio
+#define MOTION_CMD_MODE 7 // set mode to value
+#define MOTION_CMD_IS_ON 8 // set isOn to value
+#define MOTION_CMD_LEFT_STOP 9 // set leftStop of axis to value
+#define MOTION_CMD_RIGHT_STOP 10 // set rightStop of axis to value
+#define MOTION_CMD_RESET_FOLLOWING 11 // clear FollowingStats of all axes
+#define MOTION_CMD_RESET_PROFILE 12 // clear profiler zones, see profiler.hpp
+#define MOTION_CMD_BENCH 13 // runMotionBenchmarks(), see bench.hpp
+#define MOTION_CMD_ASYNC_DIRECTION 14 // updateAsyncTimerSettings(), e.g. after a manual move
+#define MOTION_CMD_STEP_TO 15 // stepTo() axis to value, continuous if value2 isn't 0
+
+const int MOTION_QUEUE_SIZE = 32; // Commands that can wait for the motion task, must be a power of 2
+// Motion task runs one cycle every this many microseconds. Has to stay above the worst case of
+// motionCycle() on the ESP32-S3. Nothing in a cycle waits for other tasks, the only waits are
+// DIRECTION_SETUP_DELAY_US per reversing axis, 15us if Z, X and A1 reverse together, plus the
+// mode math and encoder interrupts on the same core. Not measured on a lathe yet: busyMax of Cyc
+// in the ? status is the longest cycle since boot and has to stay below this.
+const unsigned long MOTION_CYCLE_US = 40;
+const unsigned long MOTION_STATS_CYCLES = 100000; // Cycle period statistics are published every this many cycles
+const int FOLLOWING_BUCKETS = 8; // Following error histogram buckets: 0, 1, 2-3, 4-7, ..., 64 steps and more
+
+// Request from another task for the motion task to do something between its cycles.
+struct MotionCommand {
+  int type;
+  Axis* axis;
+  long value;
+  long value2;
+  float ratio;
+};
+
+// Statistics of the time between starts of consecutive motion cycles.
+struct MotionCycleStats {
+  unsigned long minUs;
+  unsigned long avgUs;
+  unsigned long maxUs;
+  unsigned long overruns; // cycles that started at least half a MOTION_CYCLE_US late since boot
+  unsigned long busyMaxUs; // longest motionCycle() since boot, from taskMotion() only
+};
+
+// Following error of an axis, pendingPos steps that the axis trails the commanded position by,
+// sampled every motion cycle since boot or MOTION_CMD_RESET_FOLLOWING. Samples wrap after about 12 hours.
+struct FollowingStats {
+  unsigned long samples;
+  unsigned long maxSteps;
+  float rmsSteps; // published every MOTION_STATS_CYCLES
+  unsigned long buckets[FOLLOWING_BUCKETS];
+  unsigned long skippedCycles; // cycles in which a due step wasn't made, e.g. because the previous cycle ran late
+};
+
+// Copy of the axis fields that the motion task changes, see MotionSnapshot.
+struct AxisSnapshot {
+  long pos;
+  long originPos;
+  long posGlobal;
+  long motorPos;
+  long leftStop;
+  long rightStop;
+};
+
+// Consistent view of the motion state for other tasks, published by the motion task after every cycle.
+struct MotionSnapshot {
+  AxisSnapshot z;
+  AxisSnapshot x;
+  AxisSnapshot a1;
+  long spindlePos;
+  long spindlePosAvg;
+  long spindlePosGlobal;
+  int spindlePosSync;
+  long dupr;
+  int starts;
+  long opIndex;
+};
+
+// Queues a command for the motion task. Returns a ticket to wait for or 0 if the queue is full.
+unsigned long postMotionCommand(int type, Axis* axis, long value, long value2);
+// Queues a setting change for the motion task, waits for room if the queue is full.
+// Not to be called from the motion task itself.
+void postMotionSetting(int type, Axis* axis, long value, float ratio);
+// Waits until the motion task has processed the command, returns false if motion is stopped.
+bool waitForMotionCommand(unsigned long ticket);
+// Posts a command and waits for it to be processed, returns false if that didn't happen.
+bool runMotionCommand(int type, Axis* axis, long value, long value2);
+
+// Only to be called from the motion task: applies all queued commands in order.
+void applyMotionCommands();
+// Implemented by the motion loop, called by applyMotionCommands().
+void applyMotionCommand(const MotionCommand& command);
+// Implemented by the motion loop: one cycle of it, taskMotion() runs it every MOTION_CYCLE_US.
+void motionCycle();
+// Parts of motionCycle(), only to be called from the motion task. Exposed for the benchmarks.
+void moveAxis(Axis* a);
+void processSpindlePosDelta();
+void modeCone();
+void modeEllipse(Axis* main, Axis* aux);
+long spindleFromPos(Axis* a, long p);
+// Only to be called from the motion task at the start of every cycle.
+void recordMotionCycle(unsigned long startUs);
+// Only to be called from the motion task at the end of every cycle that started at startUs.
+void recordMotionCycleEnd(unsigned long startUs, unsigned long endUs);
+
+MotionCycleStats getMotionCycleStats();
+
+// Only to be called from moveAxis() of the motion task, in every cycle before making a step.
+void recordFollowingError(Axis* a);
+// Only to be called from the motion task after a step that was due lateUs ago.
+void recordStepLate(Axis* a, long lateUs);
+void resetFollowingStats();
+
+FollowingStats getFollowingStats(Axis* a);
+
+// Only to be called from the motion task, or from setup() before it starts.
+// Also marks saved state dirty for snapshot fields that changed.
+void publishMotionSnapshot();
+// Never blocks the motion task, retries if it was publishing at the same time.
+void readMotionSnapshot(MotionSnapshot* snapshot);
+// Waits for a snapshot that the motion task started publishing after this call, at most a couple of cycles.
+void readNextMotionSnapshot(MotionSnapshot* snapshot);
+const AxisSnapshot* getAxisSnapshot(const MotionSnapshot* snapshot, Axis* a);
+
+inline long getAxisPosDu(Axis* a, const AxisSnapshot* s) { return stepsToDu(a, s->pos + s->originPos); }
+
+inline long getAxisStopDiffDu(Axis* a, const AxisSnapshot* s) {
+  if (s->leftStop == LONG_MAX || s->rightStop == LONG_MIN)
+    return 0;
+  return stepsToDu(a, s->leftStop - s->rightStop);
+}
@@ -11,6 +11,10 @@
 #define BUZZ 4
 #define SCL 5
 #define SDA 6
+// TCA8418 INT# output. It isn't routed to the ESP32 on the H4 PCB: wire it to a free
+// GPIO and put its number here to read keys on interrupt. -1 polls the keypad every
+// KEYPAD_POLL_MS (10ms) instead, which delays a key press by up to 10ms.
+#define KEY_INT -1
 
 #define A11 9
 #define A12 10
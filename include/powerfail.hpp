@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Brownout detector threshold, 0..7. The highest one trips earliest while the supply
+// is still falling and leaves the most time to write state before the chip shuts down.
+const int POWER_FAIL_BROWNOUT_LEVEL = 7;
+
+// Replaces the default brownout reset with saving state first, then restarting.
+void powerFailSetup();
+// Called by the motion task every cycle, returns true once the supply is going down.
+bool powerFailDetected();
+// Wakes up the task that saves state and restarts, called after motion is stopped.
+void powerFailSave();
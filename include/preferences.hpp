@@ -1,4 +1,47 @@
 #pragma once
 
+#include <atomic>
+#include <stdint.h>
+
+struct Axis;
+extern Axis z;
+extern Axis x;
+extern Axis a1;
+
+// Dirty bits of the saved state, see SAVED_STATE_FIELDS in preferences.cpp.
+// Code that changes a saved value sets its bit right after the change.
+#define SAVED_AXIS_POS 0x1 // pos, motorPos and posGlobal, shifted by savedAxisBits()
+#define SAVED_AXIS_STOPS 0x2 // leftStop and rightStop
+#define SAVED_AXIS_ORIGIN 0x4 // originPos
+#define SAVED_AXIS_DISABLED 0x8 // disabled
+#define SAVED_SPINDLE (1 << 12) // spindlePos, spindlePosAvg, spindlePosSync and spindlePosGlobal
+#define SAVED_DUPR (1 << 13)
+#define SAVED_STARTS (1 << 14)
+#define SAVED_MODE (1 << 15)
+#define SAVED_CONE_RATIO (1 << 16)
+#define SAVED_TURN_PASSES (1 << 17)
+#define SAVED_AUX_FORWARD (1 << 18)
+#define SAVED_MOVE_STEP (1 << 19)
+#define SAVED_MEASURE (1 << 20)
+#define SAVED_SHOW (1 << 21) // showAngle and showTacho
+#define SAVED_OP (1 << 22) // opIndex and opDupr of the last multi-pass operation
+
+extern std::atomic<uint32_t> savedStateDirty; // changes that haven't been saved yet
+
+// Z, X and A1 each get 4 bits starting from bit 0, 4 and 8.
+inline uint32_t savedAxisBits(Axis* a, uint32_t bits) {
+  return bits << (a == &z ? 0 : (a == &x ? 4 : 8));
+}
+
+// Cheap enough for the motion task and interrupts, skips the atomic write if already set.
+inline void markSavedDirty(uint32_t bits) {
+  if ((savedStateDirty.load(std::memory_order_relaxed) & bits) != bits) {
+    savedStateDirty.fetch_or(bits, std::memory_order_release);
+  }
+}
+
 void setPreferences();
 bool savePreferences();
+// Erases flash that the next saves write to, blocking code that runs from flash for tens of ms.
+// Only call while the machine is idle, returns true if it erased.
+bool erasePreferencesAhead();
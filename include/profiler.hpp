@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.hpp"
+
+// Cycle counter instrumentation of the hot code paths. Build with -D PROFILER=true to
+// enable, otherwise PROFILE_ZONE() expands to nothing and costs nothing.
+
+#define PROFILE_MOTION_CYCLE 0 // whole motionCycle()
+#define PROFILE_MOTION_COMMANDS 1 // applyMotionCommands()
+#define PROFILE_SPINDLE_DELTA 2 // processSpindlePosDelta()
+#define PROFILE_MODE_GEARBOX 3
+#define PROFILE_MODE_TURN 4 // also face and thread
+#define PROFILE_MODE_CUT 5
+#define PROFILE_MODE_CONE 6
+#define PROFILE_MODE_ELLIPSE 7
+#define PROFILE_MOVE_AXIS 8 // moveAxis(), once per axis
+#define PROFILE_SNAPSHOT 9 // publishMotionSnapshot()
+#define PROFILE_ASYNC_TIMER 10 // onAsyncTimer() interrupt
+#define PROFILE_SPIN_ENC 11 // spinEnc() interrupt
+#define PROFILE_INDEX_ISR 12 // encoderIndexIsr() interrupt
+
+const int PROFILE_ZONES = 13;
+
+// Timing of one zone since boot or resetProfileZones(), in CPU cycles.
+struct ProfileZoneStats {
+  unsigned long count;
+  unsigned long minCycles;
+  unsigned long avgCycles;
+  unsigned long maxCycles;
+};
+
+// Host builds count host time in 240MHz cycles, even with virtual time, see hal/native.
+inline __attribute__((always_inline)) uint32_t profilerCycles() { return ESP.getCycleCount(); }
+
+// Only to be called from the context that owns the zone, the motion task or one interrupt.
+void IRAM_ATTR recordProfileZone(int zone, uint32_t startCycles);
+// Only to be called from the motion task. Interrupt zones may keep a sample taken meanwhile.
+void resetProfileZones();
+ProfileZoneStats getProfileZoneStats(int zone);
+const char* getProfileZoneName(int zone);
+
+// Times the rest of the enclosing block.
+struct ProfileScope {
+  int zone;
+  uint32_t startCycles;
+  inline __attribute__((always_inline)) ProfileScope(int zone) : zone(zone), startCycles(profilerCycles()) {}
+  inline __attribute__((always_inline)) ~ProfileScope() { recordProfileZone(zone, startCycles); }
+};
+
+#if PROFILER
+#define PROFILE_ZONE_NAME(line) profileScope##line
+#define PROFILE_ZONE_LINE(zone, line) ProfileScope PROFILE_ZONE_NAME(line)(zone)
+#define PROFILE_ZONE(zone) PROFILE_ZONE_LINE(zone, __LINE__)
+#else
+#define PROFILE_ZONE(zone)
+#endif
@@ -4,23 +4,21 @@
 #include "config.hpp"
 
 extern unsigned long spindleEncTime; // micros() of the previous spindle update
-extern unsigned long spindleEncTimeDiffBulk; // micros() between RPM_BULK spindle updates
-extern unsigned long spindleEncTimeAtIndex0; // micros() when spindleEncTimeIndex was 0
-extern int spindleEncTimeIndex; // counter going between 0 and RPM_BULK - 1
+extern std::atomic<float> spindleVelocity; // Encoder steps per second, negative in reverse. Always kept up to date by the motion task.
+extern std::atomic<float> spindleAcceleration; // Encoder steps per second^2
 extern long spindlePos; // Spindle position
 extern long spindlePosAvg; // Spindle position accounting for encoder backlash
-extern long savedSpindlePosAvg; // spindlePosAvg saved in Preferences
-extern long savedSpindlePos; // spindlePos value saved in Preferences
+extern float spindlePosFraction; // Part of an encoder step turned since the last count, add to spindlePosAvg for a smooth position
 extern std::atomic<long> spindlePosDelta; // Unprocessed encoder ticks. see https://forum.arduino.cc/t/does-c-std-atomic-work-with-dual-core-esp32/690214
 extern int spindlePosSync; // Non-zero if gearbox is on and a soft limit was removed while axis was on it
-extern int savedSpindlePosSync; // spindlePosSync saved in Preferences
 extern long spindlePosGlobal; // global spindle position that is unaffected by e.g. zeroing
-extern long savedSpindlePosGlobal; // spindlePosGlobal saved in Preferences
+extern bool spindleIndexed; // Whether spindlePosGlobal has been lined up with the encoder index pulse since boot
+extern long spindleIndexDrift; // Encoder steps corrected at the last index pulse after the first one
+extern unsigned long spindleSyncWaitUs; // How long the last thread pass waited for the spindle to reach its phase
+extern unsigned long spindleSyncWaitMaxUs; // Longest such wait since boot
 
 extern bool showAngle; // Whether to show 0-359 spindle angle on screen
 extern bool showTacho; // Whether to show spindle RPM on screen
-extern bool savedShowAngle; // showAngle value saved in Preferences
-extern bool savedShowTacho; // showTacho value saved in Preferences
 extern int shownRpm;
 extern unsigned long shownRpmTime; // micros() when shownRpm was set
 
@@ -29,6 +27,23 @@ const float ENCODER_STEPS_FLOAT = ENCODER_STEPS_INT; // Convenience float versio
 extern volatile int pulse1Delta; // Outstanding pulses generated by pulse generator on terminal A1.
 extern volatile int pulse2Delta; // Outstanding pulses generated by pulse generator on terminal A2.
 
+// Spindle velocity and acceleration are fitted to a ring of (time, encoder count) samples.
+// Samples are taken on encoder changes at least SPINDLE_SAMPLE_US apart: at speed the
+// ring spans 32ms, at low speed every count is a sample and only
+// the ones newer than SPINDLE_WINDOW_US are used. With no counts coming the velocity
+// can't be more than one count over the time since the last one and drops to 0 after
+// SPINDLE_STOP_US, which is below 0.1 RPM with a 1024 line encoder.
+const int SPINDLE_SAMPLES = 16;
+const unsigned long SPINDLE_SAMPLE_US = 2000;
+const unsigned long SPINDLE_WINDOW_US = 250000;
+const unsigned long SPINDLE_STOP_US = 500000;
+const float SPINDLE_FRACTION_MAX = 0.99; // spindlePosFraction limit, the next count takes over from there
+
+// Called by the motion task every cycle with the encoder steps it just got.
+void updateSpindleVelocity(unsigned long microsNow, long delta);
+// Called by the motion task in cycles without encoder counts.
+void updateSpindlePosFraction(unsigned long microsNow);
+float getSpindleRpm(); // signed, not smoothed for display
 int getApproxRpm();
 long spindleModulo(long value);
 void zeroSpindlePos();
@@ -4,9 +4,42 @@
 #include "axis.hpp"
 
 #define ESTOP_OFF_MANUAL_MOVE 5
+#define ESTOP_POWER_FAIL 6
 
 extern hw_timer_t *async_timer;
 
+// All tasks of the firmware. Stacks are static so they don't take heap. Their sizes in bytes
+// come from the native build, deepest use after G-code, $F and $B roughly doubled for the
+// Xtensa windowed ABI, and are NOT measured on the device yet: run every mode, $F and $B on
+// the lathe, then $S, and resize from its never used bytes (uxTaskGetStackHighWaterMark).
+// $S flags tasks with less than TASK_STACK_LOW_BYTES left. TASK_STACK_BUDGET caps the total.
+// taskPowerFail writes flash during a brownout and only runs once, $S can't show its use before
+// that happens: it gets 2 KB more than the ~3.4 KB it took on the host.
+// F(task function, stack bytes, priority, core)
+#define TASKS(F) \
+  F(taskDisplay,          6144, 0,                        0) \
+  F(taskKeypad,           5120, 0,                        0) \
+  F(taskMoveZ,            4096, 0,                        0) \
+  F(taskMoveX,            4096, 0,                        0) \
+  F(taskMoveA1,           4096, 0,                        0) \
+  F(taskAttachInterrupts, 2048, 0,                        0) \
+  F(taskGcode,            6144, 0,                        0) \
+  F(taskPowerFail,        6144, configMAX_PRIORITIES - 1, 0) \
+  F(taskMotion,           5120, configMAX_PRIORITIES - 1, 1)
+
+#define TASK_ID(function, stackBytes, priority, core) TASK_##function,
+enum TaskId { TASKS(TASK_ID) TASK_COUNT };
+
+const unsigned long TASK_STACK_BUDGET = 49152; // bytes for all stacks together, they used to take 90000 from the heap
+const unsigned long TASK_STACK_LOW_BYTES = 512; // never used stack below this is too close to overflowing
+
+// Starts a task from TASKS() on its static stack. Its allocations are tagged with id + 1.
+TaskHandle_t startTask(int id, TaskFunction_t function);
+// Ends the calling task, instead of vTaskDelete(NULL) so that $S still knows its stack use.
+void endTask();
+// Prints stack and heap use of every task for $S, and a warning for stacks that are low.
+void printTaskStats();
+
 void setEmergencyStop(int kind);
 void setAsyncTimerEnable(bool value);
 void setIsOnFromTask(bool on);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Timestamped motion events in a RAM ring for finding out why a thread came out wrong.
+// Only the motion task records (and setup() before it starts), so a record is a plain
+// store plus one atomic increment. Keypad events go into a ring of their own for the same
+// reason, only the keypad task records those. Dumped with $T over serial, see tools/trace2csv.py.
+
+#define TRACE_STEP 1 // arg axis name, value motorPos after the step
+#define TRACE_DIR 2 // arg axis name, value new direction
+#define TRACE_SPINDLE_DELTA 3 // value encoder counts read in one motion cycle
+#define TRACE_MODE 4 // value new mode
+#define TRACE_MARK_ORIGIN 5 // value spindlePos before zeroing
+#define TRACE_SYNC 6 // value new spindlePosSync, 0 when cleared
+#define TRACE_SETTING 7 // arg MOTION_CMD_* type, value its value
+#define TRACE_KEY 8 // value keypad event as passed to processKeypadEvent(), only in the key ring
+
+// Events kept, must be a power of 2. Steps at full speed fill it in ~20ms. Captures for
+// replay/replay.cpp need more, e.g. -D TRACE_EVENTS=16384 for about 200KB of RAM.
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 2048
+#endif
+// Keypad events kept, must be a power of 2. Keys come seldom, this covers a long capture.
+#ifndef TRACE_KEY_EVENTS
+#define TRACE_KEY_EVENTS 256
+#endif
+const uint8_t TRACE_DUMP_VERSION = 1;
+
+// 12 bytes, written to the dump as is (little endian).
+struct TraceEvent {
+  uint32_t timeUs; // micros()
+  uint8_t type;
+  uint8_t arg;
+  uint16_t reserved;
+  int32_t value;
+};
+
+// Dump header, followed by count TraceEvents.
+struct TraceDumpHeader {
+  char magic[4]; // "H4TR" for the motion ring, "H4KY" for the key ring
+  uint8_t version;
+  uint8_t eventSize;
+  uint16_t reserved;
+  uint32_t firstIndex; // index of the first event since boot, older ones were overwritten
+  uint32_t count;
+};
+
+// Only to be called from the motion task.
+void traceEvent(uint8_t type, uint8_t arg, int32_t value);
+// Only to be called from the keypad task.
+void traceKey(int event);
+// Writes the motion ring and then the key ring to Serial, each with its header and all events
+// still in it, while recording goes on.
+void traceDump();
@@ -32,13 +32,18 @@ const int STARTS_MAX = 124; // No more than 124-start thread
 const long SAFE_DISTANCE_DU = 5000; // Step back 0.5mm from the material when moving between cuts in automated modes
 const long SAVE_DELAY_US = 5000000; // Wait 5s after last save and last change of saveable data before saving again
 const long DIRECTION_SETUP_DELAY_US = 5; // Stepper driver needs some time to adjust to direction change
+const float SPEED_FOLLOW_MARGIN = 1.05; // Axis following the spindle may step this much faster than the spindle requires to catch up
+const float MAX_RPM_WARNING = 0.9; // Beep once the spindle reaches this share of getMaxRpm(), feed held above it continues below this
+const float FOLLOW_CATCH_UP_TURNS = 1; // Axis started into a turning spindle has to be in sync with it after this many turns
 const long STEPPED_ENABLE_DELAY_MS = 100; // Delay after stepper is enabled and before issuing steps
 // GCode-related constants.
 const float LINEAR_INTERPOLATION_PRECISION = 0.1; // 0 < x <= 1, smaller values make for quicker G0 and G1 moves
 const long GCODE_WAIT_EPSILON_STEPS = 10;
-const long RPM_BULK = ENCODER_STEPS_INT; // Measure RPM averaged over this number of encoder pulses
 const long GCODE_FEED_DEFAULT_DU_SEC = 20000; // Default feed in du/sec in GCode mode
 const float GCODE_FEED_MIN_DU_SEC = 167; // Minimum feed in du/sec in GCode mode - F1
+const int GCODE_COMMAND_MAX = 128; // Longest G-code command without comments, longer ones stop with an error
+const int GCODE_VALUE_MAX = 16; // Longest number in a G-code command
+const int SYSTEM_COMMAND_MAX = 16; // Longest $ command
 
 #define MOVE_STEP_1 10000 // 1mm
 #define MOVE_STEP_2 1000 // 0.1mm
@@ -57,20 +62,9 @@ const float GCODE_FEED_MIN_DU_SEC = 167; // Minimum feed in du/sec in GCode mode
 
 extern int emergencyStop;
 extern bool beepFlag; // allows time-critical code to ask for a beep on another core
-extern long savedDupr; // dupr saved in Preferences
-extern long nextDupr; // dupr value that should be applied asap
-extern bool nextDuprFlag; // whether nextDupr requires attention
-extern SemaphoreHandle_t motionMutex; // controls blocks of code where variables affecting the motion loop() are changed
-extern int savedStarts; // starts saved in Preferences
-extern int nextStarts; // number of starts that should be used asap
-extern bool nextStartsFlag; // whether nextStarts requires attention
+extern bool maxRpmExceeded; // Feed held because the spindle went faster than the axis could follow, see checkMaxRpm()
+extern bool savedStateReset; // Saved positions couldn't be loaded and were reset, shown until a key is pressed
 extern unsigned long saveTime; // micros() of the previous Prefs write
-extern int savedMeasure; // measure value saved in Preferences
-extern float savedConeRatio; // value of coneRatio saved in Preferences
-extern float nextConeRatio; // coneRatio that should be applied asap
-extern bool nextConeRatioFlag; // whether nextConeRatio requires attention
-extern int savedTurnPasses; // value of turnPasses saved in Preferences
-extern bool savedAuxForward; // value of auxForward saved in Preferences
 extern long opSubIndex; // Sub-index of an automation operation
 extern int opDuprSign; // 1 if dupr was positive when operation started, -1 if negative
 extern long opDupr; // dupr that the multi-pass operation started with
@@ -81,13 +75,15 @@ extern bool gcodeInBrace;
 extern bool gcodeInSemicolon;
 extern bool timerAttached;
 
-extern String gcodeCommand;
+extern char gcodeCommand[GCODE_COMMAND_MAX + 1]; // G-code command being received, 0-terminated
+extern int gcodeCommandLength;
 extern bool auxForward; // True for external, false for external thread
 extern int starts; // number of starts in a multi-start thread
 extern long dupr; // pitch, tenth of a micron per rotation
 extern float coneRatio; // In cone mode, how much X moves for 1 step of Z
 extern int turnPasses; // In turn mode, how many turn passes to make
 extern long opIndex; // Index of an automation operation
+extern long resumeOpIndex; // Pass to continue a stopped operation from, 0 to start over
 
 extern long setupIndex; // Index microsof automation setup step
 
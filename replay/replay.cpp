@@ -0,0 +1,203 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <vector>
+#include "native.hpp"
+#include "config.hpp"
+#include "pcb.hpp"
+#include "vars.hpp"
+#include "axis.hpp"
+#include "modes.hpp"
+#include "motion.hpp"
+#include "keypad.hpp"
+#include "encoder.hpp"
+#include "preferences.hpp"
+#include "plant.hpp"
+
+// Replays encoder counts and keypad events recorded on a lathe through the motion core,
+// deterministically and in virtual time, and writes the steps it makes. Comparing them
+// with a golden run of an earlier build shows whether a change altered motion behavior.
+//
+// Capture: build with -D TRACE_EVENTS=16384 (or more), send $T once or repeatedly, then
+// tools/trace2csv.py capture.bin capture.csv. Only spindle_delta and key events are used.
+// The replay boots with fresh settings, or with the state partition read from the lathe
+// (esptool.py read_flash) passed in H4_NATIVE_FLASH, so start capturing before setting up.
+//
+// Usage: replay capture.csv [out=steps.csv] [golden=steps.csv] [tolerance=us] [tail=ms]
+//
+// Everything runs on one thread: keys are handled between cycles and whatever their
+// handling waits for runs motion cycles through nativeVirtualWaitHook. Jogging with the
+// arrow keys and handwheels isn't replayed, those run in taskMoveZ/X on the lathe.
+
+struct ReplayEvent {
+  unsigned long timeUs;
+  bool key; // keypad event, encoder counts otherwise
+  long value;
+};
+
+struct ReplayStep {
+  unsigned long timeUs;
+  char axis;
+  long motorPos;
+};
+
+std::vector<ReplayEvent> events;
+size_t nextEvent = 0;
+std::vector<ReplayStep> steps;
+long lastMotorPosZ, lastMotorPosX, lastMotorPosA1;
+unsigned long cycles = 0;
+
+bool readCapture(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long index, timeUs;
+    char event[32], arg[32];
+    long value;
+    if (sscanf(line, "%lu,%lu,%31[^,],%31[^,],%ld", &index, &timeUs, event, arg, &value) != 5) continue;
+    if (strcmp(event, "spindle_delta") == 0) {
+      events.push_back({timeUs, false, value});
+    } else if (strcmp(event, "key") == 0) {
+      events.push_back({timeUs, true, value});
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+void recordStep(Axis* a, long* lastMotorPos) {
+  if (a->motorPos == *lastMotorPos) return;
+  *lastMotorPos = a->motorPos;
+  steps.push_back({micros(), a->name, a->motorPos});
+}
+
+// One motion cycle with the encoder counts that were due by its start.
+void replayCycle() {
+  nativeAdvanceMicros(MOTION_CYCLE_US);
+  for (; nextEvent < events.size() && !events[nextEvent].key && events[nextEvent].timeUs <= micros(); nextEvent++) {
+    feedEncoder(events[nextEvent].value);
+  }
+  recordMotionCycle(micros());
+  motionCycle();
+  cycles++;
+  recordStep(&z, &lastMotorPosZ);
+  recordStep(&x, &lastMotorPosX);
+  if (a1.active) recordStep(&a1, &lastMotorPosA1);
+}
+
+bool writeSteps(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "time_us,axis,motor_pos\n");
+  for (const ReplayStep& s : steps) fprintf(f, "%lu,%c,%ld\n", s.timeUs, s.axis, s.motorPos);
+  fclose(f);
+  return true;
+}
+
+bool readSteps(const char* path, std::vector<ReplayStep>* out) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    ReplayStep s;
+    if (sscanf(line, "%lu,%c,%ld", &s.timeUs, &s.axis, &s.motorPos) == 3) out->push_back(s);
+  }
+  fclose(f);
+  return true;
+}
+
+// Same steps in the same order are required, their times may differ by up to toleranceUs.
+bool compareSteps(const std::vector<ReplayStep>& golden, unsigned long toleranceUs) {
+  size_t n = min(golden.size(), steps.size());
+  size_t mismatch = n;
+  unsigned long maxDiffUs = 0;
+  double sumDiffUs = 0;
+  size_t late = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (golden[i].axis != steps[i].axis || golden[i].motorPos != steps[i].motorPos) {
+      mismatch = i;
+      break;
+    }
+    unsigned long diffUs = labs(long(steps[i].timeUs - golden[i].timeUs));
+    maxDiffUs = max(maxDiffUs, diffUs);
+    sumDiffUs += diffUs;
+    if (diffUs > toleranceUs) late++;
+  }
+  printf("golden: %zu steps, replay: %zu steps, timing max %lu us, mean %.2f us, %zu beyond %lu us\n", golden.size(), steps.size(),
+      maxDiffUs, mismatch == 0 ? 0 : sumDiffUs / mismatch, late, toleranceUs);
+  if (mismatch < n) {
+    printf("first different step #%zu: golden %lu us %c %ld, replay %lu us %c %ld\n", mismatch, golden[mismatch].timeUs,
+        golden[mismatch].axis, golden[mismatch].motorPos, steps[mismatch].timeUs, steps[mismatch].axis, steps[mismatch].motorPos);
+  } else if (golden.size() != steps.size()) {
+    printf("first different step #%zu: one run has no more steps\n", n);
+  }
+  return mismatch == n && golden.size() == steps.size() && late == 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: replay capture.csv [out=steps.csv] [golden=steps.csv] [tolerance=us] [tail=ms]\n");
+    return 2;
+  }
+  const char* outPath = "steps.csv";
+  const char* goldenPath = NULL;
+  unsigned long toleranceUs = 0;
+  unsigned long tailMs = 1000;
+  for (int i = 2; i < argc; i++) {
+    if (strncmp(argv[i], "out=", 4) == 0) outPath = argv[i] + 4;
+    else if (strncmp(argv[i], "golden=", 7) == 0) goldenPath = argv[i] + 7;
+    else if (strncmp(argv[i], "tolerance=", 10) == 0) toleranceUs = atol(argv[i] + 10);
+    else if (strncmp(argv[i], "tail=", 5) == 0) tailMs = atol(argv[i] + 5);
+    else {
+      fprintf(stderr, "unknown argument %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (!readCapture(argv[1])) return 2;
+
+  nativeUseVirtualTime();
+  initAxis(&z, NAME_Z, true, false, MOTOR_STEPS_Z, SCREW_Z_DU, SPEED_START_Z, SPEED_MANUAL_MOVE_Z, ACCELERATION_Z, INVERT_Z, NEEDS_REST_Z, MAX_TRAVEL_MM_Z, BACKLASH_DU_Z, Z_ENA, Z_DIR, Z_STEP);
+  initAxis(&x, NAME_X, true, false, MOTOR_STEPS_X, SCREW_X_DU, SPEED_START_X, SPEED_MANUAL_MOVE_X, ACCELERATION_X, INVERT_X, NEEDS_REST_X, MAX_TRAVEL_MM_X, BACKLASH_DU_X, X_ENA, X_DIR, X_STEP);
+  initAxis(&a1, NAME_A1, ACTIVE_A1, ROTARY_A1, MOTOR_STEPS_A1, SCREW_A1_DU, SPEED_START_A1, SPEED_MANUAL_MOVE_A1, ACCELERATION_A1, INVERT_A1, NEEDS_REST_A1, MAX_TRAVEL_MM_A1, BACKLASH_DU_A1, A11, A12, A13);
+  setPreferences();
+  isOn = false;
+  encoderSetup();
+  publishMotionSnapshot();
+  lastMotorPosZ = z.motorPos;
+  lastMotorPosX = x.motorPos;
+  lastMotorPosA1 = a1.motorPos;
+  nativeVirtualWaitHook = replayCycle;
+
+  unsigned long keys = 0;
+  unsigned long endUs = (events.empty() ? 0 : events.back().timeUs) + tailMs * 1000;
+  while (micros() < endUs && emergencyStop == ESTOP_NONE) {
+    if (nextEvent < events.size() && events[nextEvent].key && events[nextEvent].timeUs <= micros()) {
+      processKeypadEvent(events[nextEvent++].value);
+      keys++;
+    } else {
+      replayCycle();
+    }
+  }
+
+  unsigned long stepsZ = 0, stepsX = 0;
+  for (const ReplayStep& s : steps) {
+    if (s.axis == z.name) stepsZ++;
+    else if (s.axis == x.name) stepsX++;
+  }
+  printf("replayed %zu events (%lu keys) in %lu cycles, %.3f s: %lu Z steps, %lu X steps, estop %d\n", events.size(), keys, cycles,
+      micros() / 1000000.0, stepsZ, stepsX, emergencyStop);
+  if (!writeSteps(outPath)) return 2;
+  if (goldenPath == NULL) return 0;
+  std::vector<ReplayStep> golden;
+  if (!readSteps(goldenPath, &golden)) return 2;
+  return compareSteps(golden, toleranceUs) ? 0 : 1;
+}
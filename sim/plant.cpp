@@ -0,0 +1,114 @@
+#include <Arduino.h>
+#include <driver/pcnt.h>
+#include "native.hpp"
+#include "config.hpp"
+#include "spindle.hpp"
+#include "plant.hpp"
+
+double spindleRevs = 0;
+float spindleRpm = 0;
+float plantSeconds = 0;
+long spindleCounts = 0; // encoder counts already fed to the firmware
+Carriage carriageZ;
+Carriage carriageX;
+
+void addSpindleProfilePoint(SpindleProfile* profile, float seconds, float rpm) {
+  if (profile->points >= SPINDLE_PROFILE_POINTS) return;
+  profile->seconds[profile->points] = seconds;
+  profile->rpm[profile->points] = rpm;
+  profile->points++;
+}
+
+float getProfileRpm(const SpindleProfile* profile, float seconds) {
+  float rpm = 0;
+  if (profile->points > 0) rpm = profile->rpm[profile->points - 1];
+  for (int i = 0; i < profile->points; i++) {
+    if (seconds < profile->seconds[i]) {
+      if (i == 0) {
+        rpm = profile->rpm[0];
+      } else {
+        float t = (seconds - profile->seconds[i - 1]) / (profile->seconds[i] - profile->seconds[i - 1]);
+        rpm = profile->rpm[i - 1] + t * (profile->rpm[i] - profile->rpm[i - 1]);
+      }
+      break;
+    }
+  }
+  if (profile->dipEverySeconds > 0 && seconds >= profile->dipEverySeconds) {
+    // Triangle: the load slows the spindle down and the motor brings it back up.
+    float inDip = fmod(seconds, profile->dipEverySeconds) / profile->dipSeconds;
+    if (inDip < 1) rpm *= 1 - profile->dipDepth * (1 - fabs(2 * inDip - 1));
+  }
+  return rpm;
+}
+
+void stepCarriage(Carriage* c, bool forward) {
+  c->steps++;
+  // Same contact model as the firmware's backlash compensation: the screw pushes the
+  // carriage when moving forward and has to take up the backlash after reversing.
+  if (forward) {
+    c->motorPos++;
+    if (c->motorPos > c->pos) c->pos = c->motorPos;
+  } else {
+    c->motorPos--;
+    if (c->motorPos < c->pos - c->backlashSteps) c->pos = c->motorPos + c->backlashSteps;
+  }
+}
+
+void plantPinWrite(int pin, int value) {
+  // Drivers step on the falling edge, see DLOW(a->step) in moveAxis().
+  if (value != LOW) return;
+  if (pin == carriageZ.axis->step) {
+    stepCarriage(&carriageZ, digitalRead(carriageZ.axis->dir) ^ carriageZ.axis->invertStepper);
+  } else if (pin == carriageX.axis->step) {
+    stepCarriage(&carriageX, digitalRead(carriageX.axis->dir) ^ carriageX.axis->invertStepper);
+  }
+}
+
+void initCarriage(Carriage* c, Axis* a, long backlashDu) {
+  c->axis = a;
+  c->motorPos = 0;
+  c->pos = 0;
+  c->backlashSteps = backlashDu * a->motorSteps / a->screwPitch;
+  c->steps = 0;
+}
+
+void plantSetup(long backlashDuZ, long backlashDuX) {
+  // Spindle standing still at time 0, also when booting again.
+  spindleRevs = 0;
+  spindleRpm = 0;
+  plantSeconds = 0;
+  spindleCounts = 0;
+  initCarriage(&carriageZ, &z, backlashDuZ);
+  initCarriage(&carriageX, &x, backlashDuX);
+  nativePinWriteHook = plantPinWrite;
+  pinMode(ENC_A, INPUT_PULLUP);
+  pinMode(ENC_B, INPUT_PULLUP);
+}
+
+// Generates the edges the encoder would for counts, in the direction of their sign.
+void feedEncoder(long counts) {
+  if (ENCODER_PCNT) {
+    nativePcntAdd(PCNT_UNIT_0, counts);
+    return;
+  }
+  // spinEnc() counts falling edges of A, B high means reverse.
+  for (long i = 0; i < abs(counts); i++) {
+    nativeSetPin(ENC_B, counts < 0 ? HIGH : LOW);
+    nativeSetPin(ENC_A, HIGH);
+    nativeSetPin(ENC_A, LOW);
+  }
+}
+
+void plantAdvance(const SpindleProfile* profile, unsigned long us) {
+  plantSeconds += us / 1000000.0;
+  spindleRpm = getProfileRpm(profile, plantSeconds);
+  double before = spindleRevs;
+  spindleRevs += spindleRpm / 60.0 * us / 1000000.0;
+  long counts = floor(spindleRevs * ENCODER_STEPS_INT);
+  feedEncoder(counts - spindleCounts);
+  spindleCounts = counts;
+  if (ENC_Z >= 0 && floor(spindleRevs) != floor(before)) {
+    nativeSetPin(ENC_Z, HIGH);
+    nativeSetPin(ENC_Z, LOW);
+  }
+}
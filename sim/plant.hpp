@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+#include "axis.hpp"
+
+// Models of the lathe that the firmware drives in the simulator: a spindle turning the
+// encoder, and steppers turning lead screws with backlash that move the carriages.
+
+const int SPINDLE_PROFILE_POINTS = 16;
+
+// Spindle RPM over time, linear between points and held after the last one. Negative
+// RPM turns in reverse. Load dips periodically slow the spindle down by dipDepth.
+struct SpindleProfile {
+  int points;
+  float seconds[SPINDLE_PROFILE_POINTS];
+  float rpm[SPINDLE_PROFILE_POINTS];
+  float dipEverySeconds; // 0 for no dips
+  float dipSeconds;
+  float dipDepth; // fraction of the RPM lost at the bottom of a dip
+};
+
+// Physical carriage driven by an axis. Positions are in motor steps.
+struct Carriage {
+  Axis* axis;
+  long motorPos; // counted from step pulses
+  long pos; // where the tool is, lags motorPos by up to backlashSteps after a reversal
+  long backlashSteps;
+  long steps; // pulses seen
+};
+
+extern double spindleRevs; // true spindle angle in revolutions, not quantized by the encoder
+extern float spindleRpm;
+extern Carriage carriageZ;
+extern Carriage carriageX;
+
+void addSpindleProfilePoint(SpindleProfile* profile, float seconds, float rpm);
+float getProfileRpm(const SpindleProfile* profile, float seconds);
+
+// Stops the spindle and starts watching step pulses of the axes, call after initAxis().
+void plantSetup(long backlashDuZ, long backlashDuX);
+// Passes encoder counts to the firmware the way the hardware would, through PCNT or ENC_A/ENC_B.
+void feedEncoder(long counts);
+// Turns the spindle for us microseconds at the profile's RPM, feeding the encoder.
+void plantAdvance(const SpindleProfile* profile, unsigned long us);
+inline float carriageDu(const Carriage* c) { return c->pos * c->axis->screwPitch / c->axis->motorSteps; }
@@ -0,0 +1,214 @@
+#include <Arduino.h>
+#include <chrono>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "native.hpp"
+#include "config.hpp"
+#include "pcb.hpp"
+#include "vars.hpp"
+#include "axis.hpp"
+#include "modes.hpp"
+#include "motion.hpp"
+#include "spindle.hpp"
+#include "encoder.hpp"
+#include "plant.hpp"
+
+// Runs the unmodified motion code against the plant models cycle by cycle in virtual
+// time and reports how well each automated mode follows the spindle.
+//
+// Usage: sim [mode=turn|cone|cut|ellipse|all] [rpm=N] [dupr=du] [starts=N] [passes=N]
+//            [accelz=steps/s^2] [accelx=steps/s^2] [speedz=steps/s] [speedx=steps/s] [dips=0|1] [seconds=N]
+
+struct Scenario {
+  const char* name;
+  int mode;
+  long dupr;
+  int starts;
+  int passes;
+  float coneRatio;
+  bool stopsZ;
+  long zLeftDu, zRightDu;
+  bool stopsX;
+  long xLeftDu, xRightDu;
+  float seconds; // 0 runs until the mode turns itself off
+  SpindleProfile profile;
+};
+
+// Settings shared by all scenarios, changed from the command line.
+float simRpm = 300;
+long simDupr = 0; // 0 keeps the scenario's own
+int simStarts = 0;
+int simPasses = 0;
+long simAccelZ = ACCELERATION_Z;
+long simAccelX = ACCELERATION_X;
+long simSpeedZ = SPEED_MANUAL_MOVE_Z;
+long simSpeedX = SPEED_MANUAL_MOVE_X;
+bool simDips = true;
+float simMaxSeconds = 120;
+
+struct SimStats {
+  unsigned long cycles;
+  unsigned long long cycleNsTotal;
+  unsigned long cycleNsMax;
+  unsigned long leadSamples;
+  double leadReference;
+  double leadErrorMax; // du
+  double leadErrorSquares;
+};
+
+long duToSteps(Axis* a, long du) {
+  return du * a->motorSteps / a->screwPitch;
+}
+
+void simCommand(int type, Axis* a, long value, float ratio) {
+  MotionCommand command = {type, a, value, 0, ratio};
+  applyMotionCommand(command);
+}
+
+// Whether the mode is cutting in sync with the spindle right now.
+bool isCutting(int m) {
+  if (m == MODE_TURN || m == MODE_FACE || m == MODE_THREAD) return opIndex >= 1 && opSubIndex == 2;
+  if (m == MODE_CUT) return opIndex >= 1 && opSubIndex == 1;
+  if (m == MODE_CONE) return true;
+  return false; // ellipse follows a curve, there's no lead to compare against
+}
+
+// Carriage position minus where the true spindle angle says it should be, taken
+// modulo the pitch so that every pass and start is compared against the same groove.
+void sampleLeadError(SimStats* stats, Carriage* c) {
+  double pitchDu = fabs(dupr);
+  double error = carriageDu(c) - spindleRevs * dupr * starts;
+  if (stats->leadSamples == 0) stats->leadReference = error;
+  error -= stats->leadReference;
+  error -= round(error / pitchDu) * pitchDu;
+  stats->leadSamples++;
+  stats->leadErrorMax = max(stats->leadErrorMax, fabs(error));
+  stats->leadErrorSquares += error * error;
+}
+
+void runScenario(Scenario* s) {
+  nativeUseVirtualTime();
+  initAxis(&z, NAME_Z, true, false, MOTOR_STEPS_Z, SCREW_Z_DU, SPEED_START_Z, simSpeedZ, simAccelZ, INVERT_Z, NEEDS_REST_Z, MAX_TRAVEL_MM_Z, BACKLASH_DU_Z, Z_ENA, Z_DIR, Z_STEP);
+  initAxis(&x, NAME_X, true, false, MOTOR_STEPS_X, SCREW_X_DU, SPEED_START_X, simSpeedX, simAccelX, INVERT_X, NEEDS_REST_X, MAX_TRAVEL_MM_X, BACKLASH_DU_X, X_ENA, X_DIR, X_STEP);
+  initAxis(&a1, NAME_A1, false, ROTARY_A1, MOTOR_STEPS_A1, SCREW_A1_DU, SPEED_START_A1, SPEED_MANUAL_MOVE_A1, ACCELERATION_A1, INVERT_A1, NEEDS_REST_A1, MAX_TRAVEL_MM_A1, BACKLASH_DU_A1, A11, A12, A13);
+  plantSetup(BACKLASH_DU_Z, BACKLASH_DU_X);
+  encoderSetup();
+  publishMotionSnapshot();
+
+  turnPasses = simPasses > 0 ? simPasses : s->passes;
+  z.leftStop = s->stopsZ ? duToSteps(&z, s->zLeftDu) : LONG_MAX;
+  z.rightStop = s->stopsZ ? duToSteps(&z, s->zRightDu) : LONG_MIN;
+  x.leftStop = s->stopsX ? duToSteps(&x, s->xLeftDu) : LONG_MAX;
+  x.rightStop = s->stopsX ? duToSteps(&x, s->xRightDu) : LONG_MIN;
+  simCommand(MOTION_CMD_MODE, NULL, s->mode, 0);
+  simCommand(MOTION_CMD_DUPR, NULL, simDupr != 0 ? simDupr : s->dupr, 0);
+  simCommand(MOTION_CMD_STARTS, NULL, simStarts > 0 ? simStarts : s->starts, 0);
+  simCommand(MOTION_CMD_CONE_RATIO, NULL, 0, s->coneRatio);
+  simCommand(MOTION_CMD_IS_ON, NULL, true, 0);
+  resetFollowingStats();
+
+  SimStats stats = {};
+  Axis* following = getSpindleFollowingAxis();
+  Carriage* carriage = following == &x ? &carriageX : &carriageZ;
+  float seconds = s->seconds > 0 ? min(s->seconds, simMaxSeconds) : simMaxSeconds;
+  unsigned long maxCycles = seconds * 1000000 / MOTION_CYCLE_US;
+  while (isOn && emergencyStop == ESTOP_NONE && stats.cycles < maxCycles) {
+    plantAdvance(&s->profile, MOTION_CYCLE_US);
+    nativeAdvanceMicros(MOTION_CYCLE_US);
+    recordMotionCycle(micros());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    motionCycle();
+    unsigned long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    stats.cycles++;
+    stats.cycleNsTotal += ns;
+    stats.cycleNsMax = max(stats.cycleNsMax, ns);
+    if (isCutting(s->mode)) sampleLeadError(&stats, carriage);
+  }
+
+  FollowingStats followingStats = getFollowingStats(following);
+  Axis* other = following == &x ? &z : &x;
+  FollowingStats otherStats = getFollowingStats(other);
+  char lead[32] = "-";
+  char leadRms[32] = "-";
+  if (stats.leadSamples > 0) {
+    snprintf(lead, sizeof(lead), "%.1f", stats.leadErrorMax / 10);
+    snprintf(leadRms, sizeof(leadRms), "%.1f", sqrt(stats.leadErrorSquares / stats.leadSamples) / 10);
+  }
+  printf("%-8s %5s %7.2f %6ld %9s %9s %4c %7lu %8.2f %7lu %8.2f %7lu %8llu %8lu\n", s->name, isOn ? "limit" : "done",
+      stats.cycles * MOTION_CYCLE_US / 1000000.0, opIndex, lead, leadRms, following->name, followingStats.maxSteps,
+      followingStats.rmsSteps, otherStats.maxSteps, otherStats.rmsSteps, followingStats.skippedCycles + otherStats.skippedCycles,
+      stats.cycles == 0 ? 0 : stats.cycleNsTotal / stats.cycles, stats.cycleNsMax);
+}
+
+void initProfile(SpindleProfile* profile, bool reverse) {
+  *profile = {};
+  addSpindleProfilePoint(profile, 0, 0);
+  addSpindleProfilePoint(profile, 1, simRpm);
+  if (reverse) {
+    // Reversing makes the carriage take up the backlash of the lead screw.
+    addSpindleProfilePoint(profile, 4, simRpm);
+    addSpindleProfilePoint(profile, 5, -simRpm);
+    addSpindleProfilePoint(profile, 8, -simRpm);
+    addSpindleProfilePoint(profile, 9, 0);
+  }
+  if (simDips) {
+    profile->dipEverySeconds = 2.5;
+    profile->dipSeconds = 0.4;
+    profile->dipDepth = 0.2;
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* only = "all";
+  for (int i = 1; i < argc; i++) {
+    char key[32];
+    char value[32];
+    if (sscanf(argv[i], "%31[^=]=%31s", key, value) != 2) {
+      fprintf(stderr, "expected key=value, got %s\n", argv[i]);
+      return 1;
+    }
+    String k = key;
+    if (k == "mode") only = strdup(value);
+    else if (k == "rpm") simRpm = atof(value);
+    else if (k == "dupr") simDupr = atol(value);
+    else if (k == "starts") simStarts = atoi(value);
+    else if (k == "passes") simPasses = atoi(value);
+    else if (k == "accelz") simAccelZ = atol(value);
+    else if (k == "accelx") simAccelX = atol(value);
+    else if (k == "speedz") simSpeedZ = atol(value);
+    else if (k == "speedx") simSpeedX = atol(value);
+    else if (k == "dips") simDips = atoi(value) != 0;
+    else if (k == "seconds") simMaxSeconds = atof(value);
+    else {
+      fprintf(stderr, "unknown setting %s\n", key);
+      return 1;
+    }
+  }
+
+  // Sizes in deci-microns, 10000 is 1mm.
+  Scenario scenarios[] = {
+    {"turn", MODE_TURN, 15000, 1, 3, 0, true, 200000, 0, true, 10000, 0, 0},
+    {"cone", MODE_CONE, 2000, 1, 1, 0.5, false, 0, 0, false, 0, 0, 10}, // cone never finishes, stop with the spindle
+    {"cut", MODE_CUT, 500, 1, 2, 0, false, 0, 0, true, 20000, 0, 0},
+    {"ellipse", MODE_ELLIPSE, 1000, 1, 3, 0, true, 50000, 0, true, 20000, 0, 0},
+  };
+
+  printf("%-8s %5s %7s %6s %9s %9s %4s %7s %8s %7s %8s %7s %8s %8s\n", "mode", "end", "sim_s", "passes", "lead_um", "lead_rms",
+      "axis", "fe_max", "fe_rms", "aux_max", "aux_rms", "skipped", "cyc_ns", "cyc_max");
+  fflush(stdout);
+  for (Scenario& s : scenarios) {
+    if (strcmp(only, "all") != 0 && strcmp(only, s.name) != 0) continue;
+    initProfile(&s.profile, s.mode == MODE_CONE);
+    // Every scenario gets a freshly booted firmware.
+    pid_t pid = fork();
+    if (pid == 0) {
+      runScenario(&s);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+  }
+  return 0;
+}
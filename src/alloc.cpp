@@ -0,0 +1,73 @@
+#include <Arduino.h>
+#include <atomic>
+#include "alloc.hpp"
+
+#if ALLOC_COUNTER
+std::atomic<unsigned long> allocationCount(0);
+std::atomic<unsigned long> allocationTagCount[ALLOC_TAGS];
+std::atomic<unsigned long> allocationTagBytes[ALLOC_TAGS];
+// Plain thread-local so that reading it never allocates, unlike task lookups on the host.
+__thread int allocationTag = 0;
+
+void countAllocation(size_t bytes) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationTagCount[allocationTag].fetch_add(1, std::memory_order_relaxed);
+  allocationTagBytes[allocationTag].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  countAllocation(size);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  countAllocation(count * size);
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+  countAllocation(size);
+  return __real_realloc(p, size);
+}
+}
+
+// The host C++ runtime is a shared library that the linker can't wrap, so new goes
+// through the wrapped malloc here. Same on the ESP32, where it's linked statically anyway.
+void* operator new(size_t size) {
+  void* p = malloc(size);
+  if (p == NULL) abort();
+  return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t size) noexcept { free(p); }
+void operator delete[](void* p, size_t size) noexcept { free(p); }
+
+long getAllocationCount() {
+  return allocationCount.load(std::memory_order_relaxed);
+}
+
+void setAllocationTag(int tag) {
+  allocationTag = tag >= 0 && tag < ALLOC_TAGS ? tag : 0;
+}
+
+AllocationStats getAllocationStats(int tag) {
+  return {allocationTagCount[tag].load(std::memory_order_relaxed), allocationTagBytes[tag].load(std::memory_order_relaxed)};
+}
+#else
+long getAllocationCount() {
+  return -1;
+}
+
+void setAllocationTag(int tag) {}
+
+AllocationStats getAllocationStats(int tag) {
+  return {0, 0};
+}
+#endif
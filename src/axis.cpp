@@ -3,6 +3,8 @@
 #include "modes.hpp"
 #include "axis.hpp"
 #include "spindle.hpp"
+#include "preferences.hpp"
+#include "trace.hpp"
 
 Axis z;
 Axis x;
@@ -10,7 +12,6 @@ Axis a1;
 
 void initAxis(Axis* a, char name, bool active, bool rotational, float motorSteps, float screwPitch, long speedStart, long speedManualMove,
     long acceleration, bool invertStepper, bool needsRest, long maxTravelMm, long backlashDu, int ena, int dir, int step) {
-  a->mutex = xSemaphoreCreateMutex();
 
   a->name = name;
   a->active = active;
@@ -19,29 +20,22 @@ void initAxis(Axis* a, char name, bool active, bool rotational, float motorSteps
   a->screwPitch = screwPitch;
 
   a->pos = 0;
-  a->savedPos = 0;
   a->fractionalPos = 0.0;
   a->originPos = 0;
-  a->savedOriginPos = 0;
   a->posGlobal = 0;
-  a->savedPosGlobal = 0;
   a->pendingPos = 0;
   a->motorPos = 0;
-  a->savedMotorPos = 0;
   a->continuous = false;
 
   a->leftStop = 0;
-  a->savedLeftStop = 0;
-  a->nextLeftStopFlag = false;
 
   a->rightStop = 0;
-  a->savedRightStop = 0;
-  a->nextRightStopFlag = false;
 
   a->speed = speedStart;
   a->speedStart = speedStart;
   a->speedMax = LONG_MAX;
   a->speedManualMove = speedManualMove;
+  a->speedFollow = 0;
   a->acceleration = acceleration;
   a->decelerateSteps = 0;
   long s = speedManualMove;
@@ -55,7 +49,6 @@ void initAxis(Axis* a, char name, bool active, bool rotational, float motorSteps
   a->stepStartUs = 0;
   a->stepperEnableCounter = 0;
   a->disabled = false;
-  a->savedDisabled = false;
 
   a->invertStepper = invertStepper;
   a->needsRest = needsRest;
@@ -91,27 +84,21 @@ void updateEnable(Axis* a) {
 
 void reset() {
   z.leftStop = LONG_MAX;
-  z.nextLeftStopFlag = false;
   z.rightStop = LONG_MIN;
-  z.nextRightStopFlag = false;
   z.originPos = 0;
   z.posGlobal = 0;
   z.motorPos = 0;
   z.pendingPos = 0;
   z.disabled = false;
   x.leftStop = LONG_MAX;
-  x.nextLeftStopFlag = false;
   x.rightStop = LONG_MIN;
-  x.nextRightStopFlag = false;
   x.originPos = 0;
   x.posGlobal = 0;
   x.motorPos = 0;
   x.pendingPos = 0;
   x.disabled = false;
   a1.leftStop = LONG_MAX;
-  a1.nextLeftStopFlag = false;
   a1.rightStop = LONG_MIN;
-  a1.nextRightStopFlag = false;
   a1.originPos = 0;
   a1.posGlobal = 0;
   a1.motorPos = 0;
@@ -126,6 +113,8 @@ void reset() {
   showAngle = false;
   setConeRatio(1);
   auxForward = true;
+  markSavedDirty(savedAxisBits(&z, SAVED_AXIS_DISABLED) | savedAxisBits(&x, SAVED_AXIS_DISABLED) | savedAxisBits(&a1, SAVED_AXIS_DISABLED) |
+      SAVED_MOVE_STEP | SAVED_MEASURE | SAVED_SHOW | SAVED_AUX_FORWARD);
 }
 
 void stepperEnable(Axis* a, bool value) {
@@ -150,10 +139,6 @@ Axis* getAsyncAxis() {
 }
 
 void markAxisOrigin(Axis* a) {
-  bool hasSemaphore = xSemaphoreTake(a->mutex, 10) == pdTRUE;
-  if (!hasSemaphore) {
-    beepFlag = true;
-  }
   if (a->leftStop != LONG_MAX) {
     a->leftStop -= a->pos;
   }
@@ -165,9 +150,6 @@ void markAxisOrigin(Axis* a) {
   a->pos = 0;
   a->fractionalPos = 0;
   a->pendingPos = 0;
-  if (hasSemaphore) {
-    xSemaphoreGive(a->mutex);
-  }
 }
 
 void setDir(Axis* a, bool dir) {
@@ -176,6 +158,7 @@ void setDir(Axis* a, bool dir) {
     a->speed = a->speedStart;
     a->direction = dir;
     a->directionInitialized = true;
+    traceEvent(TRACE_DIR, a->name, dir);
     DWRITE(a->dir, dir ^ a->invertStepper);
     delayMicroseconds(DIRECTION_SETUP_DELAY_US);
   }
@@ -260,9 +243,18 @@ int getAndResetPulses(Axis* a) {
   return delta;
 }
 
-// Calculates stepper position from spindle position.
-long posFromSpindle(Axis* a, long s, bool respectStops) {
-  long newPos = s * a->motorSteps / a->screwPitch / ENCODER_STEPS_FLOAT * dupr * starts;
+// Calculates stepper position from spindle position. Whole counts are multiplied out in
+// 64 bits, a float only holds 2^24 counts (~4000 revolutions with a 4x decoded encoder)
+// and loses the fraction long before that. What's left of the division is below a step
+// and goes through float together with the fraction.
+long posFromSpindle(Axis* a, long s, float fraction, bool respectStops) {
+  int64_t numerator = int64_t(lroundf(a->motorSteps)) * dupr * starts;
+  int64_t denominator = int64_t(lroundf(a->screwPitch)) * ENCODER_STEPS_INT;
+  int64_t whole = s * numerator;
+  long newPos = whole / denominator;
+  float rest = ((whole % denominator) + fraction * numerator) / float(denominator);
+  // Truncated towards 0 like a float to long conversion would.
+  newPos += long(newPos + rest >= 0 ? floorf(rest) : ceilf(rest));
 
   // Respect left/right stops.
   if (respectStops) {
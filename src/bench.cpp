@@ -0,0 +1,266 @@
+#include <Arduino.h>
+#include <atomic>
+#include "vars.hpp"
+#include "axis.hpp"
+#include "modes.hpp"
+#include "motion.hpp"
+#include "spindle.hpp"
+#include "display.hpp"
+#include "preferences.hpp"
+#include "gcode.hpp"
+#include "alloc.hpp"
+#include "lcd.hpp"
+#include "bench.hpp"
+#ifndef ESP_PLATFORM
+#include <driver/pcnt.h>
+#include "native.hpp"
+#endif
+
+BenchResult benchResults[BENCH_RESULTS];
+int benchResultCount = 0;
+volatile long benchSink; // keeps results of the pure functions from being optimized away
+std::atomic<bool> displayBenchRequested(false);
+Axis benchAxis; // copy of Z that moveAxis() steps
+
+// Times iterations of body(i). A function pointer rather than a template so that every
+// benchmark pays the same loop overhead as "empty".
+void bench(const char* name, unsigned long iterations, void (*body)(unsigned long i)) {
+  long allocationsBefore = getAllocationCount();
+  unsigned long startUs = micros();
+  for (unsigned long i = 0; i < iterations; i++) {
+    body(i);
+  }
+  unsigned long us = micros() - startUs;
+  long allocations = getAllocationCount() - allocationsBefore;
+  if (benchResultCount >= BENCH_RESULTS) return;
+  BenchResult* r = &benchResults[benchResultCount++];
+  r->name = name;
+  r->iterations = iterations;
+  r->nsPerOp = us * 1000.0 / iterations;
+  r->allocations = allocationsBefore < 0 ? -1 : allocations;
+}
+
+void benchEmpty(unsigned long i) {
+  benchSink = i;
+}
+
+void benchPosFromSpindle(unsigned long i) {
+  benchSink = posFromSpindle(&z, (i & 4095) * 37, 0.7f, true);
+}
+
+void benchSpindleFromPos(unsigned long i) {
+  benchSink = spindleFromPos(&z, i & 4095);
+}
+
+// Nothing to step, the case of most cycles.
+void benchMoveAxisIdle(unsigned long i) {
+  moveAxis(&benchAxis);
+}
+
+// A step every call: as if the previous one was a second ago.
+void benchMoveAxisStep(unsigned long i) {
+  benchAxis.pendingPos = 1;
+  benchAxis.stepStartUs -= 1000000;
+  moveAxis(&benchAxis);
+}
+
+// An encoder count every call on the host, so that the position update runs and not only the
+// early-out of a standing spindle. On the lathe it depends on whether the spindle turns.
+void benchProcessSpindlePosDelta(unsigned long i) {
+#ifndef ESP_PLATFORM
+  if (ENCODER_PCNT) {
+    nativePcntAdd(PCNT_UNIT_0, 1);
+  } else {
+    spindlePosDelta++;
+  }
+#endif
+  processSpindlePosDelta();
+}
+
+void benchModeCone(unsigned long i) {
+  spindlePosAvg = i & 4095;
+  modeCone();
+}
+
+// Middle of the first pass. Axes never get there since nothing steps them, so it never completes.
+void benchModeEllipse(unsigned long i) {
+  opIndex = 1;
+  opSubIndex = 2;
+  spindlePosAvg = i & 1023;
+  modeEllipse(&z, &x);
+}
+
+void benchHandleGcodeCommand(unsigned long i) {
+  // Relative move by 0, parsed in full but doesn't move.
+  handleGcodeCommand("N10 G1 X0 Z0 F200");
+}
+
+void benchUpdateDisplay(unsigned long i) {
+  updateDisplay();
+}
+
+void benchSavePreferencesClean(unsigned long i) {
+  savePreferences();
+}
+
+// Journal write of an unchanged value.
+void benchSavePreferencesDirty(unsigned long i) {
+  markSavedDirty(SAVED_MOVE_STEP);
+  savePreferences();
+}
+
+long stepsFromDu(Axis* a, long du) {
+  return du * a->motorSteps / a->screwPitch;
+}
+
+void runMotionBenchmarks() {
+  Axis savedZ = z;
+  Axis savedX = x;
+  int savedMode = mode;
+  long savedDupr = dupr;
+  int savedStarts = starts;
+  float savedConeRatio = coneRatio;
+  int savedTurnPasses = turnPasses;
+  bool savedAuxForward = auxForward;
+  long savedOpIndex = opIndex;
+  long savedOpSubIndex = opSubIndex;
+  long savedOpDupr = opDupr;
+  int savedOpDuprSign = opDuprSign;
+  long savedSpindlePos = spindlePos;
+  long savedSpindlePosAvg = spindlePosAvg;
+  float savedSpindlePosFraction = spindlePosFraction;
+  long savedSpindlePosGlobal = spindlePosGlobal;
+
+  // 1.5mm pitch, stops 20mm apart, positions near 0 so that pendingPos stays small.
+  dupr = 15000;
+  starts = 1;
+  z.pos = z.motorPos = 0;
+  x.pos = x.motorPos = 0;
+  z.leftStop = stepsFromDu(&z, 200000);
+  z.rightStop = 0;
+  bench("empty", 20000, benchEmpty);
+  bench("posFromSpindle", 20000, benchPosFromSpindle);
+  bench("spindleFromPos", 20000, benchSpindleFromPos);
+
+  z.disabled = true;
+  updateEnable(&z);
+  benchAxis = savedZ;
+  benchAxis.name = 'B';
+  benchAxis.pendingPos = 0;
+  benchAxis.speed = benchAxis.speedStart;
+  benchAxis.speedFollow = 0;
+  bench("moveAxis.idle", 20000, benchMoveAxisIdle);
+  benchAxis.speedMax = benchAxis.speedManualMove;
+  benchAxis.continuous = true;
+  bench("moveAxis.step", 5000, benchMoveAxisStep);
+  z.disabled = savedZ.disabled;
+  updateEnable(&z);
+
+  bench("processSpindlePosDelta", 20000, benchProcessSpindlePosDelta);
+
+  dupr = 1000;
+  coneRatio = 1;
+  auxForward = true;
+  z.leftStop = x.leftStop = LONG_MAX;
+  z.rightStop = x.rightStop = LONG_MIN;
+  bench("modeCone", 5000, benchModeCone);
+
+  opDupr = dupr;
+  opDuprSign = 1;
+  turnPasses = 3;
+  z.leftStop = stepsFromDu(&z, 50000);
+  z.rightStop = 0;
+  x.leftStop = stepsFromDu(&x, 20000);
+  x.rightStop = 0;
+  bench("modeEllipse", 5000, benchModeEllipse);
+
+  z = savedZ;
+  x = savedX;
+  mode = savedMode;
+  dupr = savedDupr;
+  starts = savedStarts;
+  coneRatio = savedConeRatio;
+  turnPasses = savedTurnPasses;
+  auxForward = savedAuxForward;
+  opIndex = savedOpIndex;
+  opSubIndex = savedOpSubIndex;
+  opDupr = savedOpDupr;
+  opDuprSign = savedOpDuprSign;
+  spindlePos = savedSpindlePos;
+  spindlePosAvg = savedSpindlePosAvg;
+  spindlePosFraction = savedSpindlePosFraction;
+  // Counts made up by the benchmark aren't spindle turns, keep the thread phase.
+  spindlePosGlobal = savedSpindlePosGlobal;
+  // Steps of the bench axis went to the A1 counters and the stall shows up as an overrun.
+  resetFollowingStats();
+}
+
+void runRequestedDisplayBenchmarks() {
+  if (!displayBenchRequested.load(std::memory_order_acquire)) return;
+  bench("updateDisplay", 2000, benchUpdateDisplay);
+  bench("savePreferences.clean", 20000, benchSavePreferencesClean);
+  // Fewer than a sector of saves, the erase-ahead of the display task keeps that many slots blank.
+  bench("savePreferences.dirty", 15, benchSavePreferencesDirty);
+  displayBenchRequested.store(false, std::memory_order_release);
+}
+
+void printBenchResult(BenchResult* r) {
+  Serial.print("[BN:");
+  Serial.print(r->name);
+  Serial.print(",");
+  Serial.print(r->iterations);
+  Serial.print(",");
+  Serial.print(r->nsPerOp, 1);
+  Serial.print(",");
+  Serial.print(r->allocations);
+  Serial.println("]");
+}
+
+// Screen traffic since boot, not during the benchmark: updateDisplay() there renders the same frame over and over.
+void printLcdBusWrites() {
+  unsigned long frames = max(lcdFrames, 1UL);
+  Serial.print("[LCD:");
+  Serial.print(lcdFrames);
+  Serial.print(",");
+  Serial.print(float(lcdBusWrites) / frames, 2);
+  Serial.print(",");
+  Serial.print(float(lcdLineWrites) / frames, 2);
+  Serial.println("]");
+}
+
+bool runBenchmarks() {
+  if (isOn) {
+    Serial.println("error: turn off before $B");
+    return false;
+  }
+  benchResultCount = 0;
+  if (!runMotionCommand(MOTION_CMD_BENCH, NULL, 0, 0)) return false;
+
+  displayBenchRequested.store(true, std::memory_order_release);
+  while (displayBenchRequested.load(std::memory_order_acquire)) {
+    if (emergencyStop != ESTOP_NONE) return false;
+    taskYIELD();
+  }
+
+  bool savedAbsolutePositioning = gcodeAbsolutePositioning;
+  long savedFeed = gcodeFeedDuPerSec;
+  gcodeAbsolutePositioning = false;
+  bench("handleGcodeCommand", 2000, benchHandleGcodeCommand);
+  gcodeAbsolutePositioning = savedAbsolutePositioning;
+  gcodeFeedDuPerSec = savedFeed;
+
+  bool ok = true;
+  for (int i = 0; i < benchResultCount; i++) {
+    printBenchResult(&benchResults[i]);
+  }
+  printLcdBusWrites();
+  // All of these run over and over during a job, any allocation there fragments the heap over time.
+  for (int i = 0; i < benchResultCount; i++) {
+    if (benchResults[i].allocations > 0) {
+      Serial.print("error: allocates on the heap: ");
+      Serial.println(benchResults[i].name);
+      ok = false;
+    }
+  }
+  return ok;
+}
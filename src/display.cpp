@@ -1,5 +1,4 @@
 #include <Preferences.h>
-#include <LiquidCrystal.h>
 #include "vars.hpp"
 #include "pcb.hpp"
 #include "preferences.hpp"
@@ -8,8 +7,10 @@
 #include "keypad.hpp"
 #include "tasks.hpp"
 #include "display.hpp"
+#include "lcd.hpp"
+#include "motion.hpp"
+#include "bench.hpp"
 
-#define LCD_HASH_INITIAL -3845709 // Random number that's unlikely to naturally occur as an actual hash
 // To be incremented whenever a measurable improvement is made.
 #define SOFTWARE_VERSION 7
 // To be changed whenever a different PCB / encoder / stepper / ... design is used.
@@ -22,19 +23,15 @@ const int customCharLimLeftCode      = 3;
 const int customCharLimRightCode     = 4;
 const int customCharLimUpDownCode    = 5;
 const int customCharLimLeftRightCode = 6;
+const unsigned long SPLASH_SCREEN_US = 2000000; // How long to show the splash screen for
 // For MEASURE_TPI, round TPI to the nearest integer if it's within this range of it.
 // E.g. 80.02tpi would be shown as 80tpi but 80.04tpi would be shown as-is.
 const float TPI_ROUND_EPSILON = 0.03;
 
-LiquidCrystal lcd (21, 48, 47, 38, 39, 40, 41, 42, 2, 1);
-
 long setupIndex    = 0; // Index microsof automation setup step
-long savedMoveStep = 0; // moveStep saved in Preferences
-long lcdHashLine0  = LCD_HASH_INITIAL;
-long lcdHashLine1  = LCD_HASH_INITIAL;
-long lcdHashLine2  = LCD_HASH_INITIAL;
-long lcdHashLine3  = LCD_HASH_INITIAL;
 bool splashScreen  = false;
+unsigned long splashScreenTimeUs = 0; // micros() when splash screen was rendered, 0 if it's not shown
+MotionSnapshot shown; // motion state that the current frame is rendered from
 
 byte customCharMm[] = {
   B11010,
@@ -179,9 +176,9 @@ void printLcdSpaces(int charIndex) {
 int printAxisStopDiff(Axis* a, bool addTrailingSpace) {
   int count = 0;
   if (a->rotational) 
-    count = printDegrees(getAxisStopDiffDu(a));
+    count = printDegrees(getAxisStopDiffDu(a, getAxisSnapshot(&shown, a)));
   else
-    count = printDeciMicrons(getAxisStopDiffDu(a), 3);
+    count = printDeciMicrons(getAxisStopDiffDu(a, getAxisSnapshot(&shown, a)), 3);
   if (addTrailingSpace) 
     count += lcd.print(' ');
   return count;
@@ -189,8 +186,8 @@ int printAxisStopDiff(Axis* a, bool addTrailingSpace) {
 
 int printAxisPos(Axis* a) {
   if (a->rotational)
-    return printDegrees(getAxisPosDu(a));
-  return printDeciMicrons(getAxisPosDu(a), 3);
+    return printDegrees(getAxisPosDu(a, getAxisSnapshot(&shown, a)));
+  return printDeciMicrons(getAxisPosDu(a, getAxisSnapshot(&shown, a)), 3);
 }
 
 int printAxisPosWithName(Axis* a, bool addTrailingSpace) {
@@ -243,219 +240,228 @@ int printMode() {
   return 0;
 }
 
-void updateDisplay() {
-  int rpm = showTacho ? getApproxRpm() : 0;
+void printLine0() {
   int charIndex = 0;
+  lcd.setCursor(0, 0);
+  if (setupIndex == 0 || !isPassMode()) {
+    charIndex += printMode();
+    charIndex += lcd.print(isOn ? "ON " : "off ");
+    int beforeStops = charIndex;
+    if (shown.z.leftStop != LONG_MAX) {
+      charIndex += lcd.write(customCharLimLeftCode);
+    }
+    if (shown.x.leftStop != LONG_MAX && shown.x.rightStop != LONG_MIN) {
+      charIndex += lcd.write(customCharLimUpDownCode);
+    } else if (shown.x.leftStop != LONG_MAX) {
+      charIndex += lcd.write(customCharLimUpCode);
+    } else if (shown.x.rightStop != LONG_MIN) {
+      charIndex += lcd.write(customCharLimDownCode);
+    }
+    if (shown.z.rightStop != LONG_MIN) {
+      charIndex += lcd.write(customCharLimRightCode);
+    }
+    if (beforeStops != charIndex) {
+      charIndex += lcd.print(" ");
+    }
 
-  if (splashScreen) {
-    splashScreen = false;
-    lcd.clear();
-    lcd.setCursor(6, 1);
-    lcd.print("NanoEls");
-    lcd.setCursor(6, 2);
-    lcd.print("H" + String(HARDWARE_VERSION) + " V" + String(SOFTWARE_VERSION));
-    lcdHashLine0 = LCD_HASH_INITIAL;
-    lcdHashLine1 = LCD_HASH_INITIAL;
-    lcdHashLine2 = LCD_HASH_INITIAL;
-    lcdHashLine3 = LCD_HASH_INITIAL;
-    delay(2000);
+    if (shown.spindlePosSync && !isPassMode()) {
+      charIndex += lcd.print("SYN ");
+    }
+    if (mode == MODE_NORMAL && !shown.spindlePosSync) {
+      charIndex += lcd.print("step ");
+    }
+    charIndex += printDeciMicrons(moveStep, 5);
+  } else {
+    if (needZStops()) {
+      charIndex += lcd.write(customCharLimLeftRightCode);
+      charIndex += printAxisStopDiff(&z, true);
+      while (charIndex < 10) charIndex += lcd.print(" ");
+    } else {
+      charIndex += printMode();
+    }
+    charIndex += lcd.write(customCharLimUpDownCode);
+    charIndex += printAxisStopDiff(&x, false);
   }
-  if (lcdHashLine0 == LCD_HASH_INITIAL) {
-    // First run after reset.
-    lcd.clear();
-    lcdHashLine1 = LCD_HASH_INITIAL;
-    lcdHashLine2 = LCD_HASH_INITIAL;
-    lcdHashLine3 = LCD_HASH_INITIAL;
+  printLcdSpaces(charIndex);
+}
+
+void printLine1() {
+  int charIndex = 0;
+  lcd.setCursor(0, 1);
+  charIndex += lcd.print("Pitch ");
+  charIndex += printDupr(shown.dupr);
+  if (shown.starts != 1) {
+    charIndex += lcd.print(" x");
+    charIndex += lcd.print(shown.starts);
   }
+  long maxRpm = getMaxRpm(shown.dupr, shown.starts);
+  int maxRpmWidth = 5; // " max" and at least one digit
+  for (long r = maxRpm; r >= 10; r /= 10) maxRpmWidth++;
+  if (maxRpm > 0 && charIndex + maxRpmWidth <= LCD_COLS) {
+    charIndex += lcd.print(" max");
+    charIndex += lcd.print(maxRpm);
+  }
+  printLcdSpaces(charIndex);
+}
 
-  long newHashLine0 = isOn + (z.leftStop - z.rightStop) + (x.leftStop - x.rightStop) + spindlePosSync + moveStep + mode + measure + setupIndex;
-  if (lcdHashLine0 != newHashLine0) {
-    lcdHashLine0 = newHashLine0;
-    charIndex = 0;
-    lcd.setCursor(0, 0);
-    if (setupIndex == 0 || !isPassMode()) {
-      charIndex += printMode();
-      charIndex += lcd.print(isOn ? "ON " : "off ");
-      int beforeStops = charIndex;
-      if (z.leftStop != LONG_MAX) {
-        charIndex += lcd.write(customCharLimLeftCode);
-      }
-      if (x.leftStop != LONG_MAX && x.rightStop != LONG_MIN) {
-        charIndex += lcd.write(customCharLimUpDownCode);
-      } else if (x.leftStop != LONG_MAX) {
-        charIndex += lcd.write(customCharLimUpCode);
-      } else if (x.rightStop != LONG_MIN) {
-        charIndex += lcd.write(customCharLimDownCode);
-      }
-      if (z.rightStop != LONG_MIN) {
-        charIndex += lcd.write(customCharLimRightCode);
-      }
-      if (beforeStops != charIndex) {
-        charIndex += lcd.print(" ");
-      }
+void printLine2() {
+  int charIndex = 0;
+  lcd.setCursor(0, 2);
+  charIndex += printAxisPosWithName(&z, true);
+  while (charIndex < 10) charIndex += lcd.print(" ");
+  charIndex += printAxisPosWithName(&x, true);
+  printLcdSpaces(charIndex);
+}
 
-      if (spindlePosSync && !isPassMode()) {
-        charIndex += lcd.print("SYN ");
+void printLine3(int rpm) {
+  long numpadResult = getNumpadResult();
+  int charIndex = 0;
+  lcd.setCursor(0, 3);
+  if (savedStateReset && !isOn) {
+    charIndex += lcd.print("Positions reset");
+  } else if (maxRpmExceeded && isOn && !inNumpad) {
+    charIndex += lcd.print("Held, RPM over max");
+  } else if (mode == MODE_A1 && !inNumpad) {
+    if (shown.a1.leftStop != LONG_MAX && shown.a1.rightStop != LONG_MIN) {
+      charIndex += lcd.write(customCharLimUpDownCode);
+      charIndex += lcd.print(" ");
+    } else if (shown.a1.leftStop != LONG_MAX) {
+      charIndex += lcd.write(customCharLimDownCode);
+      charIndex += lcd.print(" ");
+    } else if (shown.a1.rightStop != LONG_MIN) {
+      charIndex += lcd.write(customCharLimUpCode);
+      charIndex += lcd.print(" ");
+    }
+    charIndex += printAxisPosWithName(&a1, false);
+  } else if (mode == MODE_GCODE) {
+    charIndex += lcd.write(gcodeCommand, strnlen(gcodeCommand, LCD_COLS));
+  } else if (isPassMode()) {
+    bool missingZStops = needZStops() && (shown.z.leftStop == LONG_MAX || shown.z.rightStop == LONG_MIN);
+    bool missingStops = missingZStops || shown.x.leftStop == LONG_MAX || shown.x.rightStop == LONG_MIN;
+    if (!inNumpad && missingStops) {
+      charIndex += lcd.print(needZStops() ? "Set all stops" : "Set X stops");
+    } else if (numpadResult != 0 && setupIndex == 1) {
+      long passes = min(PASSES_MAX, numpadResult);
+      charIndex += lcd.print(passes);
+      if (passes == 1) charIndex += lcd.print(" pass?");
+      else charIndex += lcd.print(" passes?");
+    } else if (!isOn && setupIndex == 1) {
+      charIndex += lcd.print(turnPasses);
+      if (turnPasses == 1) charIndex += lcd.print(" pass?");
+      else charIndex += lcd.print(" passes?");
+    } else if (!isOn && setupIndex == 2) {
+      if (mode == MODE_FACE) {
+        charIndex += lcd.print(auxForward ? "Right to left?" : "Left to right?");
+      } else if (mode == MODE_CUT) {
+        charIndex += lcd.print(shown.dupr >= 0 ? "Pitch > 0, external" : "Pitch < 0, internal");
+      } else {
+        charIndex += lcd.print(auxForward ? "External?" : "Internal?");
       }
-      if (mode == MODE_NORMAL && !spindlePosSync) {
-        charIndex += lcd.print("step ");
+    } else if (!isOn && setupIndex == 3 && resumeOpIndex > 0) {
+      charIndex += lcd.print("Resume pass ");
+      charIndex += lcd.print(resumeOpIndex);
+      charIndex += lcd.print("/");
+      charIndex += lcd.print(getPassModePasses());
+      charIndex += lcd.print("?");
+    } else if (!isOn && setupIndex == 3) {
+      long zOffset = getPassModeZStart() - shown.z.pos;
+      long xOffset = getPassModeXStart() - shown.x.pos;
+      charIndex += lcd.print("Go");
+      if (zOffset != 0) {
+        charIndex += lcd.print(" ");
+        charIndex += lcd.print(z.name);
+        charIndex += printDeciMicrons(stepsToDu(&z, zOffset), 2);
       }
-      charIndex += printDeciMicrons(moveStep, 5);
-    } else {
-      if (needZStops()) {
-        charIndex += lcd.write(customCharLimLeftRightCode);
-        charIndex += printAxisStopDiff(&z, true);
-        while (charIndex < 10) charIndex += lcd.print(" ");
-      } else {
-        charIndex += printMode();
+      if (xOffset != 0) {
+        charIndex += lcd.print(" ");
+        charIndex += lcd.print(x.name);
+        charIndex += printDeciMicrons(stepsToDu(&x, xOffset), 2);
       }
-      charIndex += lcd.write(customCharLimUpDownCode);
-      charIndex += printAxisStopDiff(&x, false);
+      charIndex += lcd.print("?");
+    } else if (isOn && numpadResult == 0) {
+      charIndex += lcd.print("Pass ");
+      charIndex += lcd.print(shown.opIndex);
+      charIndex += lcd.print(" of ");
+      charIndex += lcd.print(max(shown.opIndex, long(turnPasses * shown.starts)));
     }
-    printLcdSpaces(charIndex);
-  }
-
-  long newHashLine1 = dupr + starts + mode + measure + setupIndex;
-  if (lcdHashLine1 != newHashLine1) {
-    lcdHashLine1 = newHashLine1;
-    charIndex = 0;
-    lcd.setCursor(0, 1);
-    charIndex += lcd.print("Pitch ");
-    charIndex += printDupr(dupr);
-    if (starts != 1) {
-      charIndex += lcd.print(" x");
-      charIndex += lcd.print(starts);
+  } else if (mode == MODE_CONE) {
+    if (numpadResult != 0 && setupIndex == 1) {
+      charIndex += lcd.print("Use ratio ");
+      charIndex += lcd.print(numpadToConeRatio(), 5);
+      charIndex += lcd.print("?");
+    } else if (!isOn && setupIndex == 1) {
+      charIndex += lcd.print("Use ratio ");
+      charIndex += printNoTrailing0(coneRatio);
+      charIndex += lcd.print("?");
+    } else if (!isOn && setupIndex == 2) {
+      charIndex += lcd.print(auxForward ? "External?" : "Internal?");
+    } else if (!isOn && setupIndex == 3) {
+      charIndex += lcd.print("Go?");
+    } else if (isOn && numpadResult == 0) {
+      charIndex += lcd.print("Cone ratio ");
+      charIndex += printNoTrailing0(coneRatio);
     }
-    printLcdSpaces(charIndex);
   }
 
-  long zDisplayPos = z.pos + z.originPos;
-  long xDisplayPos = x.pos + x.originPos;
-  long a1DisplayPos = a1.pos + a1.originPos;
-  long newHashLine2 = zDisplayPos + xDisplayPos + a1DisplayPos + measure + z.disabled + x.disabled + mode;
-  if (lcdHashLine2 != newHashLine2) {
-    lcdHashLine2 = newHashLine2;
-    charIndex = 0;
-    lcd.setCursor(0, 2);
-    charIndex += printAxisPosWithName(&z, true);
-    while (charIndex < 10) charIndex += lcd.print(" ");
-    charIndex += printAxisPosWithName(&x, true);
-    printLcdSpaces(charIndex);
+  if (charIndex == 0 && inNumpad) { // Also show for 0 input to allow setting limits to 0.
+    charIndex += lcd.print("Use ");
+    charIndex += printDupr(numpadToDeciMicrons());
+    charIndex += lcd.print("?");
   }
 
-  long numpadResult = getNumpadResult();
-  long gcodeCommandHash = 0;
-  for (int i = 0; i < gcodeCommand.length(); i++) {
-    gcodeCommandHash += gcodeCommand.charAt(i);
-  }
-  long newHashLine3 = z.pos + (showAngle ? spindlePos : -1) + (showTacho ? rpm : -2) + measure + (numpadResult > 0 ? numpadResult : -1) + mode * 5 + dupr +
-      (mode == MODE_CONE ? round(coneRatio * 10000) : 0) + turnPasses + opIndex + setupIndex + (isOn ? 139 : -117) + (inNumpad ? 10 : 0) + (auxForward ? 17 : -31) +
-      (z.leftStop == LONG_MAX ? 123 : z.leftStop) + (z.rightStop == LONG_MIN ? 1234 : z.rightStop) +
-      (x.leftStop == LONG_MAX ? 1235 : x.leftStop) + (x.rightStop == LONG_MIN ? 123456 : x.rightStop) + gcodeCommandHash +
-      (mode == MODE_A1 ? a1.pos + a1.originPos + (a1.leftStop == LONG_MAX ? 123 : a1.leftStop) + (a1.rightStop == LONG_MIN ? 1234 : a1.rightStop) + a1.disabled : 0) + x.pos + z.pos;
-  if (lcdHashLine3 != newHashLine3) {
-    lcdHashLine3 = newHashLine3;
-    charIndex = 0;
-    lcd.setCursor(0, 3);
-    if (mode == MODE_A1 && !inNumpad) {
-      if (a1.leftStop != LONG_MAX && a1.rightStop != LONG_MIN) {
-        charIndex += lcd.write(customCharLimUpDownCode);
-        charIndex += lcd.print(" ");
-      } else if (a1.leftStop != LONG_MAX) {
-        charIndex += lcd.write(customCharLimDownCode);
-        charIndex += lcd.print(" ");
-      } else if (a1.rightStop != LONG_MIN) {
-        charIndex += lcd.write(customCharLimUpCode);
-        charIndex += lcd.print(" ");
-      }
-      charIndex += printAxisPosWithName(&a1, false);
-    } else if (mode == MODE_GCODE) {
-      charIndex += lcd.print(gcodeCommand.substring(0, 20));
-    } else if (isPassMode()) {
-      bool missingZStops = needZStops() && (z.leftStop == LONG_MAX || z.rightStop == LONG_MIN);
-      bool missingStops = missingZStops || x.leftStop == LONG_MAX || x.rightStop == LONG_MIN;
-      if (!inNumpad && missingStops) {
-        charIndex += lcd.print(needZStops() ? "Set all stops" : "Set X stops");
-      } else if (numpadResult != 0 && setupIndex == 1) {
-        long passes = min(PASSES_MAX, numpadResult);
-        charIndex += lcd.print(passes);
-        if (passes == 1) charIndex += lcd.print(" pass?");
-        else charIndex += lcd.print(" passes?");
-      } else if (!isOn && setupIndex == 1) {
-        charIndex += lcd.print(turnPasses);
-        if (turnPasses == 1) charIndex += lcd.print(" pass?");
-        else charIndex += lcd.print(" passes?");
-      } else if (!isOn && setupIndex == 2) {
-        if (mode == MODE_FACE) {
-          charIndex += lcd.print(auxForward ? "Right to left?" : "Left to right?");
-        } else if (mode == MODE_CUT) {
-          charIndex += lcd.print(dupr >= 0 ? "Pitch > 0, external" : "Pitch < 0, internal");
-        } else {
-          charIndex += lcd.print(auxForward ? "External?" : "Internal?");
-        }
-      } else if (!isOn && setupIndex == 3) {
-        long zOffset = getPassModeZStart() - z.pos;
-        long xOffset = getPassModeXStart() - x.pos;
-        charIndex += lcd.print("Go");
-        if (zOffset != 0) {
-          charIndex += lcd.print(" ");
-          charIndex += lcd.print(z.name);
-          charIndex += printDeciMicrons(stepsToDu(&z, zOffset), 2);
-        }
-        if (xOffset != 0) {
-          charIndex += lcd.print(" ");
-          charIndex += lcd.print(x.name);
-          charIndex += printDeciMicrons(stepsToDu(&x, xOffset), 2);
-        }
-        charIndex += lcd.print("?");
-      } else if (isOn && numpadResult == 0) {
-        charIndex += lcd.print("Pass ");
-        charIndex += lcd.print(opIndex);
-        charIndex += lcd.print(" of ");
-        charIndex += lcd.print(max(opIndex, long(turnPasses * starts)));
-      }
-    } else if (mode == MODE_CONE) {
-      if (numpadResult != 0 && setupIndex == 1) {
-        charIndex += lcd.print("Use ratio ");
-        charIndex += lcd.print(numpadToConeRatio(), 5);
-        charIndex += lcd.print("?");
-      } else if (!isOn && setupIndex == 1) {
-        charIndex += lcd.print("Use ratio ");
-        charIndex += printNoTrailing0(coneRatio);
-        charIndex += lcd.print("?");
-      } else if (!isOn && setupIndex == 2) {
-        charIndex += lcd.print(auxForward ? "External?" : "Internal?");
-      } else if (!isOn && setupIndex == 3) {
-        charIndex += lcd.print("Go?");
-      } else if (isOn && numpadResult == 0) {
-        charIndex += lcd.print("Cone ratio ");
-        charIndex += printNoTrailing0(coneRatio);
-      }
+  if (charIndex > 0) {
+    // No space for shared RPM/angle text.
+  } else if (showAngle) {
+    charIndex += lcd.print("Angle ");
+    charIndex += lcd.print(spindleModulo(shown.spindlePos) * 360 / ENCODER_STEPS_FLOAT, 2);
+    charIndex += lcd.print(char(223));
+  } else if (showTacho) {
+    charIndex += lcd.print("Tacho ");
+    charIndex += lcd.print(rpm);
+    if (shownRpm != rpm) {
+      shownRpm = rpm;
+      shownRpmTime = micros();
     }
+    charIndex += lcd.print("rpm");
+  }
+  printLcdSpaces(charIndex);
+}
 
-    if (charIndex == 0 && inNumpad) { // Also show for 0 input to allow setting limits to 0.
-      charIndex += lcd.print("Use ");
-      charIndex += printDupr(numpadToDeciMicrons());
-      charIndex += lcd.print("?");
-    }
+// Sends at most LCD_BYTES_PER_SLICE bytes to the screen and never waits, call repeatedly.
+void updateDisplay() {
+  // Keep sending the previous frame until it's fully on the screen.
+  if (!lcdFlush(LCD_BYTES_PER_SLICE)) {
+    return;
+  }
 
-    if (charIndex > 0) {
-      // No space for shared RPM/angle text.
-    } else if (showAngle) {
-      charIndex += lcd.print("Angle ");
-      charIndex += lcd.print(spindleModulo(spindlePos) * 360 / ENCODER_STEPS_FLOAT, 2);
-      charIndex += lcd.print(char(223));
-    } else if (showTacho) {
-      charIndex += lcd.print("Tacho ");
-      charIndex += lcd.print(rpm);
-      if (shownRpm != rpm) {
-        shownRpm = rpm;
-        shownRpmTime = micros();
-      }
-      charIndex += lcd.print("rpm");
+  if (splashScreen) {
+    splashScreen = false;
+    lcd.clear();
+    lcd.setCursor(6, 1);
+    lcd.print("NanoEls");
+    lcd.setCursor(6, 2);
+    lcd.print("H");
+    lcd.print(HARDWARE_VERSION);
+    lcd.print(" V");
+    lcd.print(SOFTWARE_VERSION);
+    splashScreenTimeUs = max(1UL, micros());
+    return;
+  }
+  if (splashScreenTimeUs != 0) {
+    if (micros() - splashScreenTimeUs < SPLASH_SCREEN_US) {
+      return;
     }
-    printLcdSpaces(charIndex);
+    splashScreenTimeUs = 0;
   }
+
+  // Every line is rendered in full, lcdFlush() only sends the characters that changed.
+  int rpm = showTacho ? getApproxRpm() : 0;
+  readMotionSnapshot(&shown);
+  printLine0();
+  printLine1();
+  printLine2();
+  printLine3(rpm);
+  lcdFrameRendered();
 }
 
 void displayEstop() {
@@ -483,38 +489,58 @@ void displayEstop() {
     lcd.print("Off during");
     lcd.setCursor(0, 2);
     lcd.print("manual move");
+  } else if (emergencyStop == ESTOP_POWER_FAIL) {
+    lcd.print("Power lost,");
+    lcd.setCursor(0, 2);
+    lcd.print("saving positions");
+  }
+  while (!lcdFlush(LCD_BYTES_PER_SLICE)) {
+    taskYIELD();
   }
 };
 
 void taskDisplay(void *param) {
   while (emergencyStop == ESTOP_NONE) {
-    updateDisplay();
+    // Time-critical checks go first, display output below only takes a short slice per iteration.
+    if (abs(z.pendingPos) > z.estopSteps || abs(x.pendingPos) > x.estopSteps) {
+      setEmergencyStop(ESTOP_POS);
+      break;
+    }
+    if (beepFlag) {
+      beepFlag = false;
+      beep();
+    }
     // Calling Preferences.commit() blocks all interrupts for 30ms, don't call saveIfChanged() if
     // encoder is likely to move soon.
     unsigned long now = micros();
+    // While on, this only saves once axes and spindle stood still for a while, e.g. between
+    // passes. What changes while cutting is saved by the power fail path, see powerFailSetup().
     if (!stepperIsRunning(&z) && !stepperIsRunning(&x) && (now > spindleEncTime + SAVE_DELAY_US) && (now < saveTime || now > saveTime + SAVE_DELAY_US) && (now < keypadTimeUs || now > keypadTimeUs + SAVE_DELAY_US)) {
-      if (savePreferences())
+      if (savePreferences()) {
         saveTime = now;
+      } else {
+        // Nothing to save, so the next saves won't have to wait for an erase.
+        erasePreferencesAhead();
+      }
     }
-    if (beepFlag) {
-      beepFlag = false;
-      beep();
-    }
-    if (abs(z.pendingPos) > z.estopSteps || abs(x.pendingPos) > x.estopSteps) 
-      setEmergencyStop(ESTOP_POS);
+    if (BENCH) runRequestedDisplayBenchmarks();
+    updateDisplay();
     taskYIELD();
   }
   displayEstop();
-  vTaskDelete(NULL);
+  endTask();
 }
 
 void lcdSetup() {
-  lcd.begin(20, 4);
-  lcd.createChar(customCharMmCode, customCharMm);
-  lcd.createChar(customCharLimLeftCode, customCharLimLeft);
-  lcd.createChar(customCharLimRightCode, customCharLimRight);
-  lcd.createChar(customCharLimUpCode, customCharLimUp);
-  lcd.createChar(customCharLimDownCode, customCharLimDown);
-  lcd.createChar(customCharLimUpDownCode, customCharLimUpDown);
-  lcd.createChar(customCharLimLeftRightCode, customCharLimLeftRight);
+  lcdScreen.begin(LCD_COLS, LCD_ROWS);
+  lcdScreen.createChar(customCharMmCode, customCharMm);
+  lcdScreen.createChar(customCharLimLeftCode, customCharLimLeft);
+  lcdScreen.createChar(customCharLimRightCode, customCharLimRight);
+  lcdScreen.createChar(customCharLimUpCode, customCharLimUp);
+  lcdScreen.createChar(customCharLimDownCode, customCharLimDown);
+  lcdScreen.createChar(customCharLimUpDownCode, customCharLimUpDown);
+  lcdScreen.createChar(customCharLimLeftRightCode, customCharLimLeftRight);
+  lcdScreen.clear();
+  lcdScreenCleared();
+  lcd.clear();
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include <Arduino.h>
+#include <atomic>
+#include <driver/pcnt.h>
+#include "config.hpp"
+#include "spindle.hpp"
+#include "encoder.hpp"
+#include "profiler.hpp"
+
+const pcnt_unit_t ENCODER_PCNT_UNIT = PCNT_UNIT_0;
+const int16_t ENCODER_PCNT_LIMIT = 30000; // counter goes back to 0 at +/- this value
+
+int16_t encoderLastCount = 0; // pulse counter value at the previous encoderTakeDelta()
+long encoderLastDelta = 0; // what the previous encoderTakeDelta() returned
+volatile int16_t encoderIndexCount = 0; // pulse counter value at the index pulse
+volatile long encoderIndexPending = 0; // spindlePosDelta at the index pulse, interrupt backend
+std::atomic<bool> encoderIndexSeen(false);
+
+// Reaching a limit resets the hardware counter to 0 instead of raising an interrupt.
+// Any jump over half the range is such a reset, which holds as long as counts are read
+// at least every ENCODER_PCNT_LIMIT / 2 counts - ~80ms at 3000 RPM.
+long encoderCountDiff(int16_t from, int16_t to) {
+  long diff = long(to) - from;
+  if (diff > ENCODER_PCNT_LIMIT / 2) {
+    diff -= ENCODER_PCNT_LIMIT;
+  } else if (diff < -ENCODER_PCNT_LIMIT / 2) {
+    diff += ENCODER_PCNT_LIMIT;
+  }
+  return diff;
+}
+
+// Called on a RISING interrupt for the encoder index pin, once per revolution.
+void IRAM_ATTR encoderIndexIsr() {
+  PROFILE_ZONE(PROFILE_INDEX_ISR);
+  if (ENCODER_PCNT) {
+    int16_t count;
+    pcnt_get_counter_value(ENCODER_PCNT_UNIT, &count);
+    encoderIndexCount = count;
+  } else {
+    encoderIndexPending = spindlePosDelta;
+  }
+  encoderIndexSeen.store(true, std::memory_order_release);
+}
+
+void encoderPcntSetup() {
+  // Quadrature with the same direction as spinEnc(): A falling while B is low counts up.
+  pcnt_config_t config = {};
+  config.unit = ENCODER_PCNT_UNIT;
+  config.counter_h_lim = ENCODER_PCNT_LIMIT;
+  config.counter_l_lim = -ENCODER_PCNT_LIMIT;
+
+  config.channel = PCNT_CHANNEL_0;
+  config.pulse_gpio_num = ENC_A;
+  config.ctrl_gpio_num = ENC_B;
+  config.pos_mode = PCNT_COUNT_INC;
+  config.neg_mode = PCNT_COUNT_DEC;
+  config.hctrl_mode = PCNT_MODE_KEEP;
+  config.lctrl_mode = PCNT_MODE_REVERSE;
+  pcnt_unit_config(&config);
+
+  config.channel = PCNT_CHANNEL_1;
+  config.pulse_gpio_num = ENC_B;
+  config.ctrl_gpio_num = ENC_A;
+  config.pos_mode = PCNT_COUNT_DEC;
+  config.neg_mode = PCNT_COUNT_INC;
+  pcnt_unit_config(&config);
+
+  pcnt_set_filter_value(ENCODER_PCNT_UNIT, ENCODER_FILTER_CYCLES);
+  pcnt_filter_enable(ENCODER_PCNT_UNIT);
+  pcnt_counter_pause(ENCODER_PCNT_UNIT);
+  pcnt_counter_clear(ENCODER_PCNT_UNIT);
+  pcnt_counter_resume(ENCODER_PCNT_UNIT);
+}
+
+void encoderSetup() {
+  spindlePosDelta = 0; // Unprocessed encoder ticks.
+  encoderLastCount = 0;
+  if (ENCODER_PCNT) {
+    encoderPcntSetup();
+  } else {
+    attachInterrupt(digitalPinToInterrupt(ENC_A), spinEnc, FALLING);
+  }
+  if (ENC_Z >= 0) {
+    pinMode(ENC_Z, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(ENC_Z), encoderIndexIsr, RISING);
+  }
+}
+
+long encoderTakeDelta() {
+  if (!ENCODER_PCNT) {
+    encoderLastDelta = spindlePosDelta;
+    spindlePosDelta -= encoderLastDelta;
+    return encoderLastDelta;
+  }
+  int16_t count;
+  pcnt_get_counter_value(ENCODER_PCNT_UNIT, &count);
+  long delta = encoderCountDiff(encoderLastCount, count);
+  encoderLastCount = count;
+  return delta;
+}
+
+bool encoderTakeIndex(long* countsSinceIndex) {
+  if (!encoderIndexSeen.load(std::memory_order_acquire)) {
+    return false;
+  }
+  encoderIndexSeen = false;
+  if (ENCODER_PCNT) {
+    *countsSinceIndex = encoderCountDiff(encoderIndexCount, encoderLastCount);
+  } else {
+    // Ticks that were pending at the pulse came before it.
+    *countsSinceIndex = encoderLastDelta - encoderIndexPending;
+  }
+  return true;
+}
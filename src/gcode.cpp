@@ -5,24 +5,28 @@
 #include "keypad.hpp"
 #include "tasks.hpp"
 #include "spindle.hpp"
+#include "motion.hpp"
+#include "journal.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "bench.hpp"
+#include "gcode.hpp"
 
-String getValueString(const String& command, char letter) {
-  int index = command.indexOf(letter);
-  if (index == -1) 
-    return "";
-  String valueString;
-  for (int i = index + 1; i < command.length(); i++) {
-    char c = command.charAt(i);
-    if (isDigit(c) || c == '.' || c == '-')
-      valueString += c;
-    else
-      break;
+// Copies the number following the letter into value, empty if there's no such letter.
+void getValueString(const char* command, char letter, char* value) {
+  int length = 0;
+  const char* c = strchr(command, letter);
+  if (c != NULL) {
+    for (c++; length < GCODE_VALUE_MAX && (isDigit(*c) || *c == '.' || *c == '-'); c++)
+      value[length++] = *c;
   }
-  return valueString;
+  value[length] = 0;
 }
 
-float getFloat(const String& command, char letter) {
-  return getValueString(command, letter).toFloat();
+float getFloat(const char* command, char letter) {
+  char value[GCODE_VALUE_MAX + 1];
+  getValueString(command, letter, value);
+  return atof(value);
 }
 
 void gcodeWaitEpsilon(int epsilon) {
@@ -66,13 +70,13 @@ void updateAxisSpeeds(long diffX, long diffZ, long diffA1) {
 }
 
 // Rapid positioning / linear interpolation.
-void G00_01(const String& command) {
+void G00_01(const char* command) {
   long xStart = x.pos;
   long zStart = z.pos;
   long a1Start = a1.pos;
-  long xEnd = command.indexOf(x.name) >= 0 ? mmOrInchToAbsolutePos(&x, getFloat(command, x.name)) : xStart;
-  long zEnd = command.indexOf(z.name) >= 0 ? mmOrInchToAbsolutePos(&z, getFloat(command, z.name)) : zStart;
-  long a1End = command.indexOf(a1.name) >= 0 ? mmOrInchToAbsolutePos(&a1, getFloat(command, a1.name)) : a1Start;
+  long xEnd = strchr(command, x.name) != NULL ? mmOrInchToAbsolutePos(&x, getFloat(command, x.name)) : xStart;
+  long zEnd = strchr(command, z.name) != NULL ? mmOrInchToAbsolutePos(&z, getFloat(command, z.name)) : zStart;
+  long a1End = strchr(command, a1.name) != NULL ? mmOrInchToAbsolutePos(&a1, getFloat(command, a1.name)) : a1Start;
   long xDiff = xEnd - xStart;
   long zDiff = zEnd - zStart;
   long a1Diff = a1End - a1Start;
@@ -81,23 +85,25 @@ void G00_01(const String& command) {
   for (long i = 0; i < chunks; i++) {
     if (!isOn) return;
     float scale = i / float(chunks);
-    stepToContinuous(&x, xStart + xDiff * scale);
-    stepToContinuous(&z, zStart + zDiff * scale);
-    if (ACTIVE_A1) stepToContinuous(&a1, a1Start + a1Diff * scale);
+    stepToContinuousFromTask(&x, xStart + xDiff * scale);
+    stepToContinuousFromTask(&z, zStart + zDiff * scale);
+    if (ACTIVE_A1) stepToContinuousFromTask(&a1, a1Start + a1Diff * scale);
     gcodeWaitNear();
   }
   // To avoid any rounding error, move to precise position.
-  stepToFinal(&x, xEnd);
-  stepToFinal(&z, zEnd);
-  if (ACTIVE_A1) stepToFinal(&a1, a1End);
+  stepToFinalFromTask(&x, xEnd);
+  stepToFinalFromTask(&z, zEnd);
+  if (ACTIVE_A1) stepToFinalFromTask(&a1, a1End);
   gcodeWaitStop();
 }
 
-int getInt(const String& command, char letter) {
-  return getValueString(command, letter).toInt();
+int getInt(const char* command, char letter) {
+  char value[GCODE_VALUE_MAX + 1];
+  getValueString(command, letter, value);
+  return atol(value);
 }
 
-bool handleGcode(const String& command) {
+bool handleGcode(const char* command) {
   int op = getInt(command, 'G');
   if (op == 0 || op == 1) { // 0 also covers X and Z commands without G.
     G00_01(command);
@@ -117,7 +123,7 @@ bool handleGcode(const String& command) {
   return true;
 }
 
-bool handleMcode(const String& command) {
+bool handleMcode(const char* command) {
   int op = getInt(command, 'M');
   if (op == 0 || op == 1 || op == 2 || op == 30) {
     setIsOnFromTask(false);
@@ -130,23 +136,34 @@ bool handleMcode(const String& command) {
   return true;
 }
 
-void setFeedRate(const String& command) {
+void setFeedRate(const char* command) {
   float feed = getFloat(command, 'F');
   if (feed <= 0) return;
   gcodeFeedDuPerSec = round(feed * (measure == MEASURE_METRIC ? 10000 : 254000) / 60.0);
 }
 
+// Copies source into a buffer of at least size + 1 bytes without surrounding spaces.
+void copyTrimmed(char* buffer, const char* source, int size) {
+  while (isspace(*source)) source++;
+  int length = strnlen(source, size);
+  while (length > 0 && isspace(source[length - 1])) length--;
+  memcpy(buffer, source, length);
+  buffer[length] = 0;
+}
+
 // Process one command, return ok flag.
-bool handleGcodeCommand(String command) {
-  command.trim();
-  if (command.length() == 0) return false;
+bool handleGcodeCommand(const char* source) {
+  char buffer[GCODE_COMMAND_MAX + 1];
+  copyTrimmed(buffer, source, GCODE_COMMAND_MAX);
+  const char* command = buffer;
+  if (command[0] == 0) return false;
 
   // Trim N.. prefix.
-  char code = command.charAt(0);
-  int spaceIndex = command.indexOf(' ');
-  if (code == 'N' && spaceIndex > 0) {
-    command = command.substring(spaceIndex + 1);
-    code = command.charAt(0);
+  char code = command[0];
+  const char* space = strchr(command, ' ');
+  if (code == 'N' && space != NULL) {
+    command = space + 1;
+    code = command[0];
   }
 
   // Update position for relative calculations right before performing them.
@@ -168,16 +185,110 @@ bool handleGcodeCommand(String command) {
   return false;
 }
 
+// Prints one [FE:...] line per axis: name, samples, max and RMS following error in steps,
+// histogram of the error in buckets 0/1/2-3/4-7/.../64+ steps, skipped cycles.
+void printFollowingStats(Axis* a) {
+  FollowingStats stats = getFollowingStats(a);
+  Serial.print("[FE:");
+  Serial.print(a->name);
+  Serial.print(",");
+  Serial.print(stats.samples);
+  Serial.print(",");
+  Serial.print(stats.maxSteps);
+  Serial.print(",");
+  Serial.print(stats.rmsSteps, 3);
+  Serial.print(",");
+  for (int i = 0; i < FOLLOWING_BUCKETS; i++) {
+    if (i > 0) Serial.print("/");
+    Serial.print(stats.buckets[i]);
+  }
+  Serial.print(",");
+  Serial.print(stats.skippedCycles);
+  Serial.println("]");
+}
+
+// Prints [PRF:zone,count,min,avg,max] with times in CPU cycles.
+void printProfileZone(int zone) {
+  ProfileZoneStats stats = getProfileZoneStats(zone);
+  Serial.print("[PRF:");
+  Serial.print(getProfileZoneName(zone));
+  Serial.print(",");
+  Serial.print(stats.count);
+  Serial.print(",");
+  Serial.print(stats.minCycles);
+  Serial.print(",");
+  Serial.print(stats.avgCycles);
+  Serial.print(",");
+  Serial.print(stats.maxCycles);
+  Serial.println("]");
+}
+
+// GRBL-style $ commands, accepted in all modes since they don't move anything.
+bool handleSystemCommand(const char* source) {
+  char command[SYSTEM_COMMAND_MAX + 1];
+  copyTrimmed(command, source, SYSTEM_COMMAND_MAX);
+  for (char* c = command; *c != 0; c++) *c = toupper(*c);
+  if (strcmp(command, "$F") == 0) {
+    printFollowingStats(&z);
+    printFollowingStats(&x);
+    if (ACTIVE_A1) printFollowingStats(&a1);
+    return true;
+  } else if (strcmp(command, "$FR") == 0) {
+    return runMotionCommand(MOTION_CMD_RESET_FOLLOWING, NULL, 0, 0);
+  } else if (strcmp(command, "$T") == 0) {
+    // Binary, the client finds each header by its magic and reads the count of events after it.
+    traceDump();
+    Serial.println();
+    return true;
+  } else if (PROFILER && strcmp(command, "$P") == 0) {
+    for (int i = 0; i < PROFILE_ZONES; i++) printProfileZone(i);
+    return true;
+  } else if (PROFILER && strcmp(command, "$PR") == 0) {
+    return runMotionCommand(MOTION_CMD_RESET_PROFILE, NULL, 0, 0);
+  } else if (strcmp(command, "$S") == 0) {
+    printTaskStats();
+    return true;
+  } else if (BENCH && strcmp(command, "$B") == 0) {
+    return runBenchmarks();
+  }
+  Serial.print("error: unsupported command ");
+  Serial.println(command);
+  return false;
+}
+
+char systemCommand[SYSTEM_COMMAND_MAX + 1] = ""; // $ command being received, empty if none
+int systemCommandLength = 0;
+void receiveSystemCommandChar(char receivedChar) {
+  if (int(receivedChar) < 32) {
+    if (systemCommandLength > 0 && handleSystemCommand(systemCommand)) Serial.println("ok");
+    systemCommandLength = 0;
+    systemCommand[0] = 0;
+  } else if ((systemCommandLength > 0 || receivedChar == '$') && systemCommandLength < SYSTEM_COMMAND_MAX) {
+    systemCommand[systemCommandLength++] = receivedChar;
+    systemCommand[systemCommandLength] = 0;
+  }
+}
+
+void setGcodeCommand(char c) {
+  gcodeCommandLength = c == 0 ? 0 : 1;
+  gcodeCommand[0] = c;
+  gcodeCommand[gcodeCommandLength] = 0;
+}
+
 void taskGcode(void *param) {
   while (emergencyStop == ESTOP_NONE) {
     if (mode != MODE_GCODE) {
       gcodeInitialized = false;
+      // Other input is only meant for G-code mode, drop it.
+      if (Serial.available() > 0) receiveSystemCommandChar(Serial.read());
       taskYIELD();
       continue;
     }
     if (!gcodeInitialized) {
       gcodeInitialized = true;
-      gcodeCommand = "";
+      setGcodeCommand(0);
+      systemCommandLength = 0;
+      systemCommand[0] = 0;
       gcodeAbsolutePositioning = true;
       gcodeFeedDuPerSec = GCODE_FEED_DEFAULT_DU_SEC;
       gcodeInBrace = false;
@@ -206,32 +317,69 @@ void taskGcode(void *param) {
         Serial.print(isOn ? "Run" : "Idle");
         Serial.print("|WPos:");
         float divisor = measure == MEASURE_METRIC ? 10000.0 : 254000.0;
-        Serial.print(getAxisPosDu(&x) / divisor, 3);
+        MotionSnapshot snapshot;
+        readMotionSnapshot(&snapshot);
+        Serial.print(getAxisPosDu(&x, &snapshot.x) / divisor, 3);
         Serial.print(",0.000,");
-        Serial.print(getAxisPosDu(&z) / divisor, 3);
+        Serial.print(getAxisPosDu(&z, &snapshot.z) / divisor, 3);
         Serial.print("|FS:");
         Serial.print(round(gcodeFeedDuPerSec * 60 / 10000.0));
         Serial.print(",");
-        Serial.print(getApproxRpm());
+        Serial.print(abs(getSpindleRpm()), 1);
+        Serial.print("|MaxRpm:");
+        Serial.print(getMaxRpm(snapshot.dupr, snapshot.starts));
+        Serial.print("|Sync:");
+        Serial.print(spindleSyncWaitUs);
+        Serial.print(",");
+        Serial.print(spindleSyncWaitMaxUs);
+        Serial.print(",");
+        Serial.print(spindleIndexDrift);
+        MotionCycleStats cycle = getMotionCycleStats();
+        Serial.print("|Cyc:");
+        Serial.print(cycle.minUs);
+        Serial.print(",");
+        Serial.print(cycle.avgUs);
+        Serial.print(",");
+        Serial.print(cycle.maxUs);
+        Serial.print(",");
+        Serial.print(cycle.overruns);
+        Serial.print(",");
+        Serial.print(cycle.busyMaxUs);
+        JournalStats journal = getJournalStats();
+        Serial.print("|Jrn:");
+        Serial.print(journal.saves);
+        Serial.print(",");
+        Serial.print(journal.erases);
+        Serial.print(",");
+        Serial.print(journal.worstWriteUs);
+        Serial.print(",");
+        Serial.print(journal.worstEraseUs);
         Serial.print(">"); // no new line to allow client to easily cut out the status response
+      } else if (systemCommandLength > 0 || (receivedChar == '$' && gcodeCommandLength == 0)) {
+        receiveSystemCommandChar(receivedChar);
       } else if (isOn) {
         if (gcodeInBrace && charCode < 32) {
           Serial.println("error: comment not closed");
           setIsOnFromTask(false);
-        } else if (charCode < 32 && gcodeCommand.length() > 1) {
+        } else if (charCode < 32 && gcodeCommandLength > 1) {
           if (handleGcodeCommand(gcodeCommand)) Serial.println("ok");
-          gcodeCommand = "";
+          setGcodeCommand(0);
           gcodeInSemicolon = false;
         } else if (charCode < 32) {
           Serial.println("ok");
-          gcodeCommand = "";
+          setGcodeCommand(0);
         } else if (charCode >= 32 && (charCode == 'G' || charCode == 'M')) {
           // Split consequent G and M commands on one line.
           // No "ok" for commands in the middle of the line.
           handleGcodeCommand(gcodeCommand);
-          gcodeCommand = receivedChar;
+          setGcodeCommand(receivedChar);
+        } else if (gcodeCommandLength >= GCODE_COMMAND_MAX) {
+          Serial.println("error: command too long");
+          setIsOnFromTask(false);
+          setGcodeCommand(0);
         } else if (charCode >= 32) {
-          gcodeCommand += receivedChar;
+          gcodeCommand[gcodeCommandLength++] = receivedChar;
+          gcodeCommand[gcodeCommandLength] = 0;
         }
       } else {
         // ignoring non-realtime command input when off
@@ -240,5 +388,5 @@ void taskGcode(void *param) {
     }
     taskYIELD();
   }
-  vTaskDelete(NULL);
+  endTask();
 }
\ No newline at end of file
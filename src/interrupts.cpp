@@ -4,10 +4,12 @@
 #include "modes.hpp"
 #include "axis.hpp"
 #include "vars.hpp"
+#include "profiler.hpp"
 
 // Only used for async movement in ASYNC and A1 modes.
 // Keep code in this method to absolute minimum to achieve high stepper speeds.
 void IRAM_ATTR onAsyncTimer() {
+  PROFILE_ZONE(PROFILE_ASYNC_TIMER);
   Axis* a = getAsyncAxis();
   if (!isOn || a->movingManually) {
     return;
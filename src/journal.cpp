@@ -0,0 +1,158 @@
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include "journal.hpp"
+
+#define JOURNAL_MAGIC 0x4a4c5301 // "JLS" + record layout version
+#define JOURNAL_BLANK 0xffffffff // what erased flash reads as
+
+const int JOURNAL_SLOTS_PER_SECTOR = JOURNAL_SECTOR_SIZE / JOURNAL_SLOT_SIZE;
+
+struct JournalSlot {
+  uint32_t magic;
+  uint32_t seq; // higher is newer
+  uint32_t size;
+  uint8_t data[JOURNAL_DATA_MAX];
+  uint32_t crc; // of everything above
+};
+static_assert(sizeof(JournalSlot) == JOURNAL_SLOT_SIZE, "JournalSlot must fill exactly one slot");
+
+const esp_partition_t* journalPartition = NULL;
+int journalSlots = 0; // number of slots in the partition
+int journalLatestSlot = -1; // slot of the latest valid record, -1 if there's none
+int journalNextSlot = 0; // slot the next record goes to
+uint32_t journalSeq = 0; // seq of the latest record
+int journalEraseDue = -1; // sector for journalEraseAhead() to get ready, -1 if none
+JournalStats journalStats = {0, 0, 0, 0};
+
+uint32_t journalCrc(const JournalSlot* slot) {
+  return esp_rom_crc32_le(0, (const uint8_t*) slot, offsetof(JournalSlot, crc));
+}
+
+bool journalReadSlot(int index, JournalSlot* slot) {
+  return esp_partition_read(journalPartition, index * JOURNAL_SLOT_SIZE, slot, JOURNAL_SLOT_SIZE) == ESP_OK;
+}
+
+bool journalSlotIsValid(const JournalSlot* slot) {
+  return slot->magic == JOURNAL_MAGIC && slot->size <= JOURNAL_DATA_MAX && slot->crc == journalCrc(slot);
+}
+
+bool journalSlotIsBlank(int index) {
+  uint32_t words[JOURNAL_SLOT_SIZE / 4];
+  if (esp_partition_read(journalPartition, index * JOURNAL_SLOT_SIZE, words, JOURNAL_SLOT_SIZE) != ESP_OK) {
+    return false;
+  }
+  for (int i = 0; i < JOURNAL_SLOT_SIZE / 4; i++) {
+    if (words[i] != JOURNAL_BLANK) return false;
+  }
+  return true;
+}
+
+// Sector following the one that holds slot.
+int journalSectorAfter(int slot) {
+  return (slot / JOURNAL_SLOTS_PER_SECTOR + 1) % (journalSlots / JOURNAL_SLOTS_PER_SECTOR);
+}
+
+void journalEraseSector(int sector) {
+  unsigned long startUs = micros();
+  esp_partition_erase_range(journalPartition, sector * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE);
+  unsigned long durationUs = micros() - startUs;
+  journalStats.erases++;
+  if (durationUs > journalStats.worstEraseUs) journalStats.worstEraseUs = durationUs;
+}
+
+bool journalSetup() {
+  journalPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, JOURNAL_PARTITION_SUBTYPE, JOURNAL_PARTITION_LABEL);
+  if (journalPartition == NULL) {
+    return false;
+  }
+  journalSlots = journalPartition->size / JOURNAL_SLOT_SIZE;
+  journalLatestSlot = -1;
+  journalSeq = 0;
+  JournalSlot slot;
+  for (int i = 0; i < journalSlots; i++) {
+    // Records with a broken CRC were interrupted mid-write, the one before them is still good.
+    if (journalReadSlot(i, &slot) && journalSlotIsValid(&slot) && (journalLatestSlot < 0 || slot.seq > journalSeq)) {
+      journalLatestSlot = i;
+      journalSeq = slot.seq;
+    }
+  }
+  journalNextSlot = (journalLatestSlot + 1) % journalSlots;
+  // Normally the next slot is blank. It isn't after a power loss before the erase-ahead, or
+  // when the partition held something else before. Erasing here is fine, nothing runs yet.
+  for (int tries = 0; tries <= journalSlots && !journalSlotIsBlank(journalNextSlot); tries++) {
+    if (journalNextSlot % JOURNAL_SLOTS_PER_SECTOR == 0) {
+      journalEraseSector(journalNextSlot / JOURNAL_SLOTS_PER_SECTOR);
+    } else {
+      journalNextSlot = (journalNextSlot + 1) % journalSlots;
+    }
+  }
+  journalEraseDue = journalSectorAfter(journalNextSlot);
+  return true;
+}
+
+int journalLoad(void* data, int maxSize) {
+  JournalSlot slot;
+  if (journalLatestSlot < 0 || !journalReadSlot(journalLatestSlot, &slot) || !journalSlotIsValid(&slot)) {
+    return -1;
+  }
+  memcpy(data, slot.data, min(int(slot.size), maxSize));
+  return slot.size;
+}
+
+bool journalAppend(const void* data, int size) {
+  if (journalPartition == NULL || size > JOURNAL_DATA_MAX) {
+    return false;
+  }
+  JournalSlot slot;
+  memset(&slot, 0, sizeof(slot));
+  slot.magic = JOURNAL_MAGIC;
+  slot.seq = journalSeq + 1;
+  slot.size = size;
+  memcpy(slot.data, data, size);
+  slot.crc = journalCrc(&slot);
+
+  // Leftovers in the rest of a sector are skipped. The start of a sector is blank unless the
+  // erase-ahead didn't get to run during 16 saves, the save is tried again after it did.
+  while (!journalSlotIsBlank(journalNextSlot)) {
+    if (journalNextSlot % JOURNAL_SLOTS_PER_SECTOR == 0) {
+      return false;
+    }
+    journalNextSlot = (journalNextSlot + 1) % journalSlots;
+  }
+
+  unsigned long startUs = micros();
+  if (esp_partition_write(journalPartition, journalNextSlot * JOURNAL_SLOT_SIZE, &slot, JOURNAL_SLOT_SIZE) != ESP_OK) {
+    return false;
+  }
+  unsigned long durationUs = micros() - startUs;
+  journalStats.saves++;
+  if (durationUs > journalStats.worstWriteUs) journalStats.worstWriteUs = durationUs;
+
+  journalSeq = slot.seq;
+  journalLatestSlot = journalNextSlot;
+  if (journalLatestSlot % JOURNAL_SLOTS_PER_SECTOR == 0) {
+    // Started a new sector, the oldest one has to be ready by the time this one is full.
+    journalEraseDue = journalSectorAfter(journalLatestSlot);
+  }
+  journalNextSlot = (journalNextSlot + 1) % journalSlots;
+  return true;
+}
+
+bool journalEraseAhead() {
+  if (journalPartition == NULL || journalEraseDue < 0) {
+    return false;
+  }
+  int sector = journalEraseDue;
+  journalEraseDue = -1;
+  for (int i = 0; i < JOURNAL_SLOTS_PER_SECTOR; i++) {
+    if (!journalSlotIsBlank(sector * JOURNAL_SLOTS_PER_SECTOR + i)) {
+      journalEraseSector(sector);
+      return true;
+    }
+  }
+  return false;
+}
+
+JournalStats getJournalStats() {
+  return journalStats;
+}
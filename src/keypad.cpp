@@ -4,6 +4,10 @@
 #include "modes.hpp"
 #include "pcb.hpp"
 #include "tasks.hpp"
+#include "macros.hpp"
+#include "motion.hpp"
+#include "preferences.hpp"
+#include "trace.hpp"
 
 #define B_LEFT 57
 #define B_RIGHT 37
@@ -49,6 +53,11 @@
 
 Adafruit_TCA8418 keypad;
 
+const long KEYPAD_POLL_MS = 10; // How often to poll the key event FIFO when KEY_INT isn't connected, also the worst added press latency
+const long KEYPAD_INT_TIMEOUT_MS = 1000; // Re-check the FIFO this often even without INT# in case an edge was missed
+
+TaskHandle_t keypadTaskHandle = NULL; // taskKeypad, woken up by keypadIsr()
+
 unsigned long keypadTimeUs = 0;
 unsigned long resetMillis = 0;
 
@@ -104,6 +113,10 @@ void buttonOnOffPress(bool on) {
   } else if (!isOn && on && setupIndex < getLastSetupIndex()) {
     // Move to the next setup step.
     setupIndex++;
+    if (setupIndex == getLastSetupIndex()) {
+      // Offer to continue a stopped or power-interrupted operation.
+      resumeOpIndex = getResumableOpIndex();
+    }
   } else if (isOn && on && (mode == MODE_TURN || mode == MODE_FACE || mode == MODE_THREAD)) {
     // Move to the next pass.
     opIndexAdvanceFlag = true;
@@ -157,41 +170,44 @@ void setTurnPasses(int value) {
     beep();
   } else {
     turnPasses = value;
+    markSavedDirty(SAVED_TURN_PASSES);
   }
 }
 
 void setLeftStop(Axis* a, long value) {
   // Can't apply changes right away since we might be in the middle of motion logic.
-  a->nextLeftStop = value;
-  a->nextLeftStopFlag = true;
+  postMotionSetting(MOTION_CMD_LEFT_STOP, a, value, 0);
 }
 
 void setRightStop(Axis* a, long value) {
   // Can't apply changes right away since we might be in the middle of motion logic.
-  a->nextRightStop = value;
-  a->nextRightStopFlag = true;
+  postMotionSetting(MOTION_CMD_RIGHT_STOP, a, value, 0);
 }
 
-bool stepTo(Axis* a, long newPos, bool continuous) {
-  if (xSemaphoreTake(a->mutex, 10) == pdTRUE) {
-    a->continuous = continuous;
-    if (newPos == a->pos) {
-      a->pendingPos = 0;
-    } else {
-      a->pendingPos = newPos - a->motorPos - (newPos > a->pos ? 0 : a->backlashSteps);
-    }
-    xSemaphoreGive(a->mutex);
-    return true;
+// Must be called from the motion task, post MOTION_CMD_STEP_TO from other tasks.
+void stepTo(Axis* a, long newPos, bool continuous) {
+  a->continuous = continuous;
+  if (newPos == a->pos) {
+    a->pendingPos = 0;
+  } else {
+    a->pendingPos = newPos - a->motorPos - (newPos > a->pos ? 0 : a->backlashSteps);
   }
-  return false;
 }
 // Moves the stepper so that the tool is located at the newPos.
-bool stepToContinuous(Axis* a, long newPos) {
-  return stepTo(a, newPos, true);
+void stepToContinuous(Axis* a, long newPos) {
+  stepTo(a, newPos, true);
+}
+
+void stepToFinal(Axis* a, long newPos) {
+  stepTo(a, newPos, false);
+}
+
+bool stepToContinuousFromTask(Axis* a, long newPos) {
+  return runMotionCommand(MOTION_CMD_STEP_TO, a, newPos, true);
 }
 
-bool stepToFinal(Axis* a, long newPos) {
-  return stepTo(a, newPos, false);
+bool stepToFinalFromTask(Axis* a, long newPos) {
+  return runMotionCommand(MOTION_CMD_STEP_TO, a, newPos, false);
 }
 
 
@@ -263,7 +279,7 @@ bool processNumpadResult(int keyCode) {
       return true;
     }
     a->speedMax = a->speedManualMove;
-    stepToFinal(a, pos);
+    stepToFinalFromTask(a, pos);
     return true;
   }
 
@@ -282,6 +298,7 @@ bool processNumpadResult(int keyCode) {
   if (keyCode == B_STEP) {
     if (newDu > 0) {
       moveStep = newDu;
+      markSavedDirty(SAVED_MOVE_STEP);
     } else {
       beep();
     }
@@ -353,11 +370,11 @@ void setMeasure(int value) {
   }
   measure = value;
   moveStep = measure == MEASURE_METRIC ? MOVE_STEP_1 : MOVE_STEP_IMP_1;
+  markSavedDirty(SAVED_MEASURE | SAVED_MOVE_STEP);
 }
 
 
 void buttonPlusMinusPress(bool plus) {
-  // Mutex is aquired in setDupr() and setStarts().
   bool minus = !plus;
   if (mode == MODE_THREAD && setupIndex == 2) {
     if (minus && starts > 2) {
@@ -371,6 +388,13 @@ void buttonPlusMinusPress(bool plus) {
     } else if (plus && turnPasses < PASSES_MAX) {
       setTurnPasses(turnPasses + 1);
     }
+  } else if (isPassMode() && !isOn && setupIndex == getLastSetupIndex() && getResumableOpIndex() > 0) {
+    // 0 starts over.
+    if (minus && resumeOpIndex > 0) {
+      resumeOpIndex--;
+    } else if (plus && resumeOpIndex < getResumableOpIndex()) {
+      resumeOpIndex++;
+    }
   } else if (measure != MEASURE_TPI) {
     int delta = measure == MEASURE_METRIC ? MOVE_STEP_3 : MOVE_STEP_IMP_3;
     // Switching between mm/inch/tpi often results in getting non-0 3rd and 4th
@@ -416,6 +440,7 @@ void buttonDisplayPress() {
   } else {
     showTacho = false;
   }
+  markSavedDirty(SAVED_SHOW);
 }
 
 void buttonMoveStepPress() {
@@ -436,6 +461,7 @@ void buttonMoveStepPress() {
       moveStep = MOVE_STEP_IMP_1;
     }
   }
+  markSavedDirty(SAVED_MOVE_STEP);
 }
 
 void buttonModePress() {
@@ -466,13 +492,14 @@ void buttonReversePress() {
   setDupr(-dupr);
 }
 
-void processKeypadEvent() {
-  if (keypad.available() == 0) return;
-  int event = keypad.getEvent();
+void processKeypadEvent(int event) {
   int keyCode = event;
   bitWrite(keyCode, 7, 0);
   bool isPress = bitRead(event, 7) == 1; // 1 - press, 0 - release
   keypadTimeUs = micros();
+  if (isPress) savedStateReset = false; // seen it
+  // Goes into the trace next to the encoder counts, together they can be replayed.
+  traceKey(event);
 
   // Off button always gets handled.
   if (keyCode == B_OFF) {
@@ -494,6 +521,7 @@ void processKeypadEvent() {
   // Setup wizard navigation.
   if (isPress && setupIndex == 2 && (keyCode == B_LEFT || keyCode == B_RIGHT)) {
     auxForward = !auxForward;
+    markSavedDirty(SAVED_AUX_FORWARD);
   } else if (keyCode == B_LEFT) { // Make sure isPress=false propagates to motion flags.
     buttonLeftPressed = isPress;
   } else if (keyCode == B_RIGHT) {
@@ -538,9 +566,11 @@ void processKeypadEvent() {
     markAxis0(&z);
   } else if (keyCode == B_A) {
     x.disabled = !x.disabled;
+    markSavedDirty(savedAxisBits(&x, SAVED_AXIS_DISABLED));
     updateEnable(&x);
   } else if (keyCode == B_B) {
     z.disabled = !z.disabled;
+    markSavedDirty(savedAxisBits(&z, SAVED_AXIS_DISABLED));
     updateEnable(&z);
   } else if (keyCode == B_STEP) {
     buttonMoveStepPress();
@@ -561,6 +591,7 @@ void processKeypadEvent() {
   } else if (keyCode == B_MODE_CUT) {
     if (mode == MODE_A1) {
       a1.disabled = !a1.disabled;
+      markSavedDirty(savedAxisBits(&a1, SAVED_AXIS_DISABLED));
       updateEnable(&a1);
     } else {
       setModeFromTask(MODE_CUT);
@@ -570,6 +601,29 @@ void processKeypadEvent() {
   }
 }
 
+// Reads all events queued in the TCA8418 FIFO in one burst.
+void processKeypadEvents() {
+  if (KEY_INT >= 0) {
+    // Release INT# before draining so that events arriving during the burst assert it again.
+    keypad.writeRegister(TCA8418_REG_INT_STAT, 1);
+  }
+  int count = keypad.available();
+  while (count > 0) {
+    for (; count > 0; count--) {
+      processKeypadEvent(keypad.getEvent());
+    }
+    // Pick up events that were queued while the previous ones were processed.
+    count = keypad.available();
+  }
+}
+
+// Called on a FALLING interrupt of the TCA8418 INT# pin.
+void IRAM_ATTR keypadIsr() {
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(keypadTaskHandle, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
 bool keypadSetup() {
   bool success = Wire.begin(SDA, SCL);
   if (!success) {
@@ -591,9 +645,21 @@ bool keypadAvailable(){
 };
 
 void taskKeypad(void *param) {
+  if (KEY_INT >= 0) {
+    // Attaching interrupt from this task to have it on core 0 and to know whom to notify.
+    keypadTaskHandle = xTaskGetCurrentTaskHandle();
+    pinMode(KEY_INT, INPUT_PULLUP);
+    keypad.enableInterrupts();
+    attachInterrupt(digitalPinToInterrupt(KEY_INT), keypadIsr, FALLING);
+  }
   while (emergencyStop == ESTOP_NONE) {
-    processKeypadEvent();
-    taskYIELD();
+    processKeypadEvents();
+    // Don't keep the I2C bus busy while no keys are pressed.
+    if (KEY_INT >= 0) {
+      ulTaskNotifyTake(pdTRUE, KEYPAD_INT_TIMEOUT_MS / portTICK_PERIOD_MS);
+    } else {
+      DELAY(KEYPAD_POLL_MS);
+    }
   }
-  vTaskDelete(NULL);
+  endTask();
 }
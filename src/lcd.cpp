@@ -0,0 +1,75 @@
+#include "lcd.hpp"
+
+// DDRAM address of the first character of each row on a 20x4 HD44780 screen.
+const int LCD_ROW_ADDRESS[LCD_ROWS] = {0x00, 0x40, 0x14, 0x54};
+
+LcdFrame lcd;
+LiquidCrystal lcdScreen (21, 48, 47, 38, 39, 40, 41, 42, 2, 1);
+unsigned long lcdBusWrites = 0;
+unsigned long lcdFrames = 0;
+unsigned long lcdLineWrites = 0;
+
+char lcdShown[LCD_ROWS][LCD_COLS]; // what's currently on the screen
+int lcdAddress = -1; // DDRAM address the screen will write the next character to, -1 if unknown
+
+void LcdFrame::clear() {
+  memset(cells, ' ', sizeof(cells));
+  col = 0;
+  row = 0;
+}
+
+void LcdFrame::setCursor(int c, int r) {
+  col = c;
+  row = r;
+}
+
+size_t LcdFrame::write(uint8_t c) {
+  // Characters that don't fit are dropped but still counted as printed.
+  if (row < LCD_ROWS && col < LCD_COLS) {
+    cells[row][col] = c;
+  }
+  col++;
+  return 1;
+}
+
+void lcdScreenCleared() {
+  memset(lcdShown, ' ', sizeof(lcdShown));
+  lcdAddress = 0;
+}
+
+void lcdFrameRendered() {
+  lcdFrames++;
+  // A cursor move and the whole row for every row with any change in it.
+  for (int row = 0; row < LCD_ROWS; row++) {
+    if (memcmp(lcdShown[row], lcd.cells[row], LCD_COLS) != 0) lcdLineWrites += LCD_COLS + 1;
+  }
+}
+
+bool lcdFlush(int maxBytes) {
+  int writes = 0;
+  for (int row = 0; row < LCD_ROWS; row++) {
+    for (int col = 0; col < LCD_COLS; col++) {
+      char c = lcd.cells[row][col];
+      if (lcdShown[row][col] == c) {
+        continue;
+      }
+      // Screen advances its address after each character, only move the cursor when skipping cells.
+      int address = LCD_ROW_ADDRESS[row] + col;
+      if (writes + (address != lcdAddress ? 2 : 1) > maxBytes) {
+        // Continue on the next call, changed cells before this one are already on the screen.
+        lcdBusWrites += writes;
+        return false;
+      }
+      if (address != lcdAddress) {
+        lcdScreen.setCursor(col, row);
+        writes++;
+      }
+      lcdScreen.write(c);
+      writes++;
+      lcdShown[row][col] = c;
+      lcdAddress = address + 1;
+    }
+  }
+  lcdBusWrites += writes;
+  return true;
+}
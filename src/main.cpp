@@ -16,6 +16,12 @@
 #include "axis.hpp"
 #include "spindle.hpp"
 #include "gcode.hpp"
+#include "motion.hpp"
+#include "powerfail.hpp"
+#include "encoder.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "bench.hpp"
 
 void taskMoveZ(void *param) {
   while (emergencyStop == ESTOP_NONE) {
@@ -45,23 +51,14 @@ void taskMoveZ(void *param) {
       bool resting = false;
       do {
         z.speedMax = z.speedManualMove;
-        if (xSemaphoreTake(motionMutex, 100) == pdTRUE) {
-          if (!resting) {
-            spindlePos += diff;
-            spindlePosAvg += diff;
-          }
-          // If spindle is moving, it will be changing spindlePos at the same time. Account for it.
-          while (diff > 0 ? (spindlePos < prevSpindlePos) : (spindlePos > prevSpindlePos)) {
-            spindlePos += diff;
-            spindlePosAvg += diff;
-          };
+        // If spindle is moving, it will be changing spindlePos at the same time. Motion task accounts for it.
+        if (runMotionCommand(resting ? MOTION_CMD_SPINDLE_CATCH_UP : MOTION_CMD_SPINDLE_SHIFT, &z, diff, prevSpindlePos)) {
           prevSpindlePos = spindlePos;
-          xSemaphoreGive(motionMutex);
         }
 
-        long newPos = posFromSpindle(&z, prevSpindlePos, true);
+        long newPos = posFromSpindle(&z, prevSpindlePos, 0, true);
         if (newPos != z.pos) {
-          stepToContinuous(&z, newPos);
+          stepToContinuousFromTask(&z, newPos);
           waitForPendingPosNear0(&z);
         } else if (z.pos == (left ? z.leftStop : z.rightStop)) {
           // We're standing on a stop with the L/R move button pressed.
@@ -94,21 +91,18 @@ void taskMoveZ(void *param) {
           delta = z.rightStop - posCopy;
         }
         z.speedMax = getStepMaxSpeed(&z);
-        stepToContinuous(&z, posCopy + delta);
+        stepToContinuousFromTask(&z, posCopy + delta);
         waitForStep(&z);
       } while (delta != 0 && (left ? buttonLeftPressed : buttonRightPressed));
       z.continuous = false;
       waitForPendingPos0(&z);
       if (isOn && mode == MODE_CONE) {
-        if (xSemaphoreTake(motionMutex, 100) != pdTRUE) {
+        if (!runMotionCommand(MOTION_CMD_MARK_ORIGIN, NULL, 0, 0)) {
           setEmergencyStop(ESTOP_MARK_ORIGIN);
-        } else {
-          markOrigin();
-          xSemaphoreGive(motionMutex);
         }
       } else if (isOn && mode == MODE_ASYNC) {
         // Restore async direction.
-        updateAsyncTimerSettings();
+        runMotionCommand(MOTION_CMD_ASYNC_DIRECTION, NULL, 0, 0);
       }
     }
     z.movingManually = false;
@@ -118,7 +112,7 @@ void taskMoveZ(void *param) {
     z.speedMax = LONG_MAX;
     taskYIELD();
   }
-  vTaskDelete(NULL);
+  endTask();
 }
 
 void taskMoveX(void *param) {
@@ -155,18 +149,15 @@ void taskMoveX(void *param) {
       } else if (posCopy + delta < x.rightStop) {
         delta = x.rightStop - posCopy;
       }
-      stepToContinuous(&x, posCopy + delta);
+      stepToContinuousFromTask(&x, posCopy + delta);
       waitForStep(&x);
       pulseDelta = getAndResetPulses(&x);
     } while (delta != 0 && (pulseDelta != 0 || (up ? buttonUpPressed : buttonDownPressed)));
     x.continuous = false;
     waitForPendingPos0(&x);
     if (isOn && mode == MODE_CONE) {
-      if (xSemaphoreTake(motionMutex, 100) != pdTRUE) {
+      if (!runMotionCommand(MOTION_CMD_MARK_ORIGIN, NULL, 0, 0)) {
         setEmergencyStop(ESTOP_MARK_ORIGIN);
-      } else {
-        markOrigin();
-        xSemaphoreGive(motionMutex);
       }
     }
     x.movingManually = false;
@@ -175,7 +166,7 @@ void taskMoveX(void *param) {
 
     taskYIELD();
   }
-  vTaskDelete(NULL);
+  endTask();
 }
 
 void taskMoveA1(void *param) {
@@ -204,56 +195,57 @@ void taskMoveA1(void *param) {
       } else if (posCopy + delta < a1.rightStop) {
         delta = a1.rightStop - posCopy;
       }
-      stepToContinuous(&a1, posCopy + delta);
+      stepToContinuousFromTask(&a1, posCopy + delta);
       waitForStep(&a1);
     } while (plus ? buttonTurnPressed : buttonGearsPressed);
     a1.continuous = false;
     waitForPendingPos0(&a1);
     // Restore async direction.
-    if (isOn && mode == MODE_A1) updateAsyncTimerSettings();
+    if (isOn && mode == MODE_A1) runMotionCommand(MOTION_CMD_ASYNC_DIRECTION, NULL, 0, 0);
     a1.movingManually = false;
     a1.speedMax = LONG_MAX;
     stepperEnable(&a1, false);
     taskYIELD();
   }
-  vTaskDelete(NULL);
+  endTask();
 }
 
 void taskAttachInterrupts(void *param) {
   // Attaching interrupt on core 0 to have more time on core 1 where axes are moved.
-  spindlePosDelta = 0; // Unprocessed encoder ticks.
-  attachInterrupt(digitalPinToInterrupt(ENC_A), spinEnc, FALLING);
+  encoderSetup();
   if (PULSE_1_USE) attachInterrupt(digitalPinToInterrupt(A12), pulse1Enc, CHANGE);
   if (PULSE_2_USE) attachInterrupt(digitalPinToInterrupt(A22), pulse2Enc, CHANGE);
-  vTaskDelete(NULL);
+  endTask();
 }
 
-// Must be called while holding motionMutex.
-void applyDupr() {
-  if (nextDupr == dupr) {
+// Must be called from the motion task.
+void applyDupr(long value) {
+  if (value == dupr) {
     return;
   }
-  dupr = nextDupr;
+  dupr = value;
   markOrigin();
   if (mode == MODE_ASYNC || mode == MODE_A1) {
     updateAsyncTimerSettings();
   }
 }
 
-// Must be called while holding motionMutex.
-void applyStarts() {
-  if (starts == nextStarts) {
+// Must be called from the motion task.
+void applyStarts(int value) {
+  if (starts == value) {
     return;
   }
-  starts = nextStarts;
+  starts = value;
   markOrigin();
 }
 
-void applyConeRatio() {
-  if (nextConeRatio == coneRatio) {
+// Must be called from the motion task.
+void applyConeRatio(float value) {
+  if (value == coneRatio) {
     return;
   }
-  coneRatio = nextConeRatio;
+  coneRatio = value;
+  markSavedDirty(SAVED_CONE_RATIO);
   markOrigin();
 }
 
@@ -273,26 +265,32 @@ void leaveStop(Axis* a, long oldStop) {
   }
 }
 
-void applyLeftStop(Axis* a) {
+void applyLeftStop(Axis* a, long value) {
   // Accept left stop even if it's lower than pos.
   // Stop button press processing takes time during which motor could have moved.
   long oldStop = a->leftStop;
-  a->leftStop = a->nextLeftStop;
+  a->leftStop = value;
   leaveStop(a, oldStop);
 }
 
-void applyRightStop(Axis* a) {
+void applyRightStop(Axis* a, long value) {
   // Accept right stop even if it's higher than pos.
   // Stop button press processing takes time during which motor could have moved.
   long oldStop = a->rightStop;
-  a->rightStop = a->nextRightStop;
+  a->rightStop = value;
   leaveStop(a, oldStop);
 }
 
 void moveAxis(Axis* a) {
+  PROFILE_ZONE(PROFILE_MOVE_AXIS);
+  // Following the spindle, keep the speed the axis accelerated to up to the spindle's rate
+  // rather than slowing down to speedStart between steps. Getting there still takes the
+  // usual acceleration, a stepper can't start at e.g. 8400 steps/s without stalling.
+  long speedMin = max(a->speedStart, min(a->speedFollow, a->speed));
+  recordFollowingError(a);
   // Most of the time a step isn't needed.
   if (a->pendingPos == 0) {
-    if (a->speed > a->speedStart) {
+    if (a->speed > speedMin) {
       a->speed--;
     }
     return;
@@ -300,54 +298,127 @@ void moveAxis(Axis* a) {
 
   unsigned long nowUs = micros();
   float delayUs = 1000000.0 / a->speed;
-  if (nowUs < a->stepStartUs) a->stepStartUs = 0; // micros() overflow
-  if (nowUs < (a->stepStartUs + delayUs - 5)) {
+  // Elapsed time as unsigned difference handles micros() overflow. Adding delayUs to
+  // stepStartUs instead would round to a float that's 64us coarse after 16 minutes.
+  if (nowUs - a->stepStartUs < delayUs - 5) {
     // Not enough time has passed to issue this step.
     return;
   }
 
-  if (xSemaphoreTake(a->mutex, 1) == pdTRUE) {
-    // Check pendingPos again now that we have the mutex.
-    if (a->pendingPos != 0) {
-      bool dir = a->pendingPos > 0;
-      setDir(a, dir);
+  long lateUs = long(nowUs - a->stepStartUs) - long(delayUs);
+  recordStepLate(a, lateUs);
+  bool dir = a->pendingPos > 0;
+  setDir(a, dir);
+
+  DLOW(a->step);
+  int delta = dir ? 1 : -1;
+  a->pendingPos -= delta;
+  if (dir && a->motorPos >= a->pos) {
+    a->pos++;
+  } else if (!dir && a->motorPos <= (a->pos - a->backlashSteps)) {
+    a->pos--;
+  }
+  a->motorPos += delta;
+  a->posGlobal += delta;
+  traceEvent(TRACE_STEP, a->name, a->motorPos);
+
+  bool accelerate = a->continuous || a->pendingPos >= a->decelerateSteps || a->pendingPos <= -a->decelerateSteps;
+  a->speed += (accelerate ? 1 : -1) * a->acceleration * delayUs / 1000000.0;
+  if (a->speed > a->speedMax) {
+    a->speed = a->speedMax;
+  } else if (a->speed < speedMin) {
+    a->speed = speedMin;
+  }
+  // Steps only happen at cycle starts, count the next delay from when this step was due so that
+  // the average rate is a->speed whatever MOTION_CYCLE_US. Later than a cycle means the axis
+  // stood or stalled, the next step then gets its full delay.
+  bool onTime = lateUs > 0 && lateUs < long(MOTION_CYCLE_US);
+  a->stepStartUs = onTime ? nowUs - lateUs : nowUs;
 
-      DLOW(a->step);
-      int delta = dir ? 1 : -1;
-      a->pendingPos -= delta;
-      if (dir && a->motorPos >= a->pos) {
-        a->pos++;
-      } else if (!dir && a->motorPos <= (a->pos - a->backlashSteps)) {
-        a->pos--;
-      }
-      a->motorPos += delta;
-      a->posGlobal += delta;
-
-      bool accelerate = a->continuous || a->pendingPos >= a->decelerateSteps || a->pendingPos <= -a->decelerateSteps;
-      a->speed += (accelerate ? 1 : -1) * a->acceleration * delayUs / 1000000.0;
-      if (a->speed > a->speedMax) {
-        a->speed = a->speedMax;
-      } else if (a->speed < a->speedStart) {
-        a->speed = a->speedStart;
-      }
-      a->stepStartUs = nowUs;
+  DHIGH(a->step);
+}
+
+// Lets moveAxis() run at the step rate the spindle requires right away, so that the axis
+// locks on instead of accelerating from speedStart after every wait for the spindle.
+void followSpindleSpeed(Axis* a) {
+  a->speedFollow = abs(spindleVelocity * a->motorSteps / a->screwPitch / ENCODER_STEPS_FLOAT * dupr * starts) * SPEED_FOLLOW_MARGIN;
+}
 
-      DHIGH(a->step);
+// Returns true if value passed a multiple of ENCODER_STEPS_INT on the way from before, and sets
+// past to how far beyond it the value went. Delta can be several steps per cycle at speed.
+bool passedSpindleTurn(long before, long value, long* past) {
+  if (value > before) {
+    *past = spindleModulo(value);
+    return value - *past > before;
+  }
+  if (value < before) {
+    long turn = value + spindleModulo(-value);
+    *past = value - turn;
+    return turn < before;
+  }
+  return false;
+}
+
+// Stops following the spindle before the axis can fall behind it: beeps once at
+// MAX_RPM_WARNING of getMaxRpm() and holds the feed above it, modes stop moving the axes.
+// Once the spindle is back under MAX_RPM_WARNING the feed continues at the next spindle
+// turn, with the turns made meanwhile taken off spindlePos, so it stays in the same groove.
+bool maxRpmWarned = false;
+long maxRpmHoldPos; // spindlePosAvg when the feed got held
+long maxRpmHoldTurned; // spindlePosAvg - maxRpmHoldPos in the previous cycle
+void checkMaxRpm() {
+  Axis* a = getSpindleFollowingAxis();
+  if (!isOn || dupr == 0 || a == NULL || a->movingManually) {
+    maxRpmWarned = false;
+    return;
+  }
+  float load = abs(getSpindleRpm()) / max(getMaxRpm(dupr, starts), 1L);
+  if (maxRpmExceeded) {
+    long turned = spindlePosAvg - maxRpmHoldPos;
+    long past;
+    if (load < MAX_RPM_WARNING && passedSpindleTurn(maxRpmHoldTurned, turned, &past)) {
+      spindlePos -= turned - past;
+      spindlePosAvg -= turned - past;
+      maxRpmExceeded = false;
     }
-    xSemaphoreGive(a->mutex);
+    maxRpmHoldTurned = turned;
+  } else if (load > 1) {
+    maxRpmExceeded = true;
+    maxRpmHoldPos = spindlePosAvg;
+    maxRpmHoldTurned = 0;
+    beepFlag = true;
+  } else if (load > MAX_RPM_WARNING && !maxRpmWarned) {
+    maxRpmWarned = true;
+    beepFlag = true;
+  } else if (load < MAX_RPM_WARNING - 0.05) {
+    maxRpmWarned = false;
   }
 }
 
 void modeGearbox() {
+  PROFILE_ZONE(PROFILE_MODE_GEARBOX);
   if (z.movingManually) {
     return;
   }
-  z.speedMax = LONG_MAX;
-  stepToContinuous(&z, posFromSpindle(&z, spindlePosAvg, true));
+  z.speedMax = z.speedManualMove;
+  followSpindleSpeed(&z);
+  stepToContinuous(&z, posFromSpindle(&z, spindlePosAvg, spindlePosFraction, true));
+}
+
+// Pass to start with once the operation reached its starting position. Passes done
+// before a stop or power loss are skipped if the user chose to resume. Threads
+// stay in phase since every pass re-syncs spindlePosSync from the saved global positions.
+long takeFirstOpIndex() {
+  long index = max(1L, resumeOpIndex);
+  resumeOpIndex = 0;
+  return index;
 }
 
 long auxSafeDistance, startOffset;
+unsigned long syncStartUs; // micros() when the current pass started waiting for spindlePosSync
+long spindleSyncPast = 0; // Steps the spindle went past the sync point in the cycle spindlePosSync got to 0
 void modeTurn(Axis* main, Axis* aux) {
+  PROFILE_ZONE(PROFILE_MODE_TURN);
   if (main->movingManually || aux->movingManually || turnPasses <= 0 ||
       main->leftStop == LONG_MAX || main->rightStop == LONG_MIN ||
       aux->leftStop == LONG_MAX || aux->rightStop == LONG_MIN ||
@@ -378,7 +449,7 @@ void modeTurn(Axis* main, Axis* aux) {
     stepToFinal(aux, auxPos);
     if (main->pos == mainPos && aux->pos == auxPos) {
       stepToFinal(main, mainStartStop);
-      opIndex = 1;
+      opIndex = takeFirstOpIndex();
       opSubIndex = 0;
     }
   } else if (opIndex <= turnPasses * starts) {
@@ -390,16 +461,24 @@ void modeTurn(Axis* main, Axis* aux) {
     // Bringing X to starting position.
     if (opSubIndex == 0) {
       stepToFinal(aux, auxPos);
-      if (aux->pos == auxPos) {
+      // Main can still be taking up backlash on its way back to the start. The sync below
+      // is computed from where it is and markOrigin() would drop the steps left, so wait.
+      if (aux->pos == auxPos && main->pos == mainStartStop && main->pendingPos == 0) {
         opSubIndex = 1;
         spindlePosSync = spindleModulo(spindlePosGlobal - spindleFromPos(main, main->posGlobal) + startOffset * (opIndex - 1));
+        spindleSyncPast = 0;
+        syncStartUs = micros();
         return; // Instead of jumping to the next step, let spindlePosSync get to 0 first.
       }
     }
     // spindlePosSync counted down to 0, start thread from here.
     if (opSubIndex == 1) {
+      spindleSyncWaitUs = micros() - syncStartUs;
+      spindleSyncWaitMaxUs = max(spindleSyncWaitMaxUs, spindleSyncWaitUs);
       markOrigin();
-      main->speedMax = LONG_MAX;
+      // Spindle could have gone a few steps past the sync point in the last cycle, keep them.
+      spindlePosAvg = spindlePos = spindleSyncPast;
+      main->speedMax = main->speedManualMove;
       opSubIndex = 2;
       // markOrigin() changed Start/EndStop values, re-calculate them.
       return;
@@ -408,7 +487,8 @@ void modeTurn(Axis* main, Axis* aux) {
     if (opSubIndex == 2) {
       // In case we were pushed to the next opIndex before finishing the current one.
       stepToFinal(aux, auxPos);
-      stepToContinuous(main, posFromSpindle(main, spindlePosAvg, true));
+      followSpindleSpeed(main);
+      stepToContinuous(main, posFromSpindle(main, spindlePosAvg, spindlePosFraction, true));
       if (main->pos == mainEndStop) {
         opSubIndex = 3;
       }
@@ -448,6 +528,7 @@ void modeTurn(Axis* main, Axis* aux) {
 }
 
 void modeCone() {
+  PROFILE_ZONE(PROFILE_MODE_CONE);
   if (z.movingManually || x.movingManually || coneRatio == 0) {
     return;
   }
@@ -457,12 +538,14 @@ void modeCone() {
     return;
   }
 
-  // TODO: calculate maximum speeds and accelerations to avoid potential desync.
-  x.speedMax = LONG_MAX;
-  z.speedMax = LONG_MAX;
+  // Going faster than this stalls open-loop steppers, getMaxRpm() keeps the spindle below
+  // what needs it.
+  x.speedMax = x.speedManualMove;
+  z.speedMax = z.speedManualMove;
 
   // Respect limits of both axis by translating them into limits on spindlePos value.
   long spindle = spindlePosAvg;
+  float fraction = spindlePosFraction;
   long spindleMin = LONG_MIN;
   long spindleMax = LONG_MAX;
   if (z.leftStop != LONG_MAX) {
@@ -487,17 +570,20 @@ void modeCone() {
       (dupr > 0 ? spindleMin: spindleMax) = lim;
     }
   }
-  if (spindle > spindleMax) {
+  if (spindle > spindleMax || (spindle == spindleMax && fraction > 0)) {
     spindle = spindleMax;
-  } else if (spindle < spindleMin) {
+    fraction = 0;
+  } else if (spindle < spindleMin || (spindle == spindleMin && fraction < 0)) {
     spindle = spindleMin;
+    fraction = 0;
   }
 
-  stepToContinuous(&z, posFromSpindle(&z, spindle, true));
+  stepToContinuous(&z, posFromSpindle(&z, spindle, fraction, true));
   stepToContinuous(&x, round(z.pos * zToXRatio));
 }
 
 void modeCut() {
+  PROFILE_ZONE(PROFILE_MODE_CUT);
   if (x.movingManually || turnPasses <= 0 || x.leftStop == LONG_MAX || x.rightStop == LONG_MIN || dupr == 0 || dupr * opDuprSign < 0) {
     setIsOnFromLoop(false);
     return;
@@ -512,7 +598,7 @@ void modeCut() {
     long xPos = startStop;
     stepToFinal(&x, xPos);
     if (x.pos == xPos) {
-      opIndex = 1;
+      opIndex = takeFirstOpIndex();
       opSubIndex = 0;
     }
   } else if (opIndex <= turnPasses) {
@@ -523,9 +609,10 @@ void modeCut() {
     }
     // Doing the pass cut.
     if (opSubIndex == 1) {
-      x.speedMax = LONG_MAX;
+      x.speedMax = x.speedManualMove;
+      followSpindleSpeed(&x);
       long endPos = endStop - (endStop - startStop) / turnPasses * (turnPasses - opIndex);
-      long xPos = posFromSpindle(&x, spindlePosAvg, true);
+      long xPos = posFromSpindle(&x, spindlePosAvg, spindlePosFraction, true);
       if (dupr > 0 && xPos > endPos) xPos = endPos;
       else if (dupr < 0 && xPos < endPos) xPos = endPos;
       stepToContinuous(&x, xPos);
@@ -549,6 +636,7 @@ void modeCut() {
 }
 
 void modeEllipse(Axis* main, Axis* aux) {
+  PROFILE_ZONE(PROFILE_MODE_ELLIPSE);
   if (main->movingManually || aux->movingManually || turnPasses <= 0 ||
       main->leftStop == LONG_MAX || main->rightStop == LONG_MIN ||
       aux->leftStop == LONG_MAX || aux->rightStop == LONG_MIN ||
@@ -569,7 +657,7 @@ void modeEllipse(Axis* main, Axis* aux) {
   aux->speedMax = aux->speedManualMove;
 
   if (opIndex == 0) {
-    opIndex = 1;
+    opIndex = takeFirstOpIndex();
     opSubIndex = 0;
     spindlePos = 0;
     spindlePosAvg = 0;
@@ -658,22 +746,42 @@ void discountFullSpindleTurns() {
   }
 }
 
+// The index pulse is spindlePosGlobal 0. First one after boot only sets the phase, after
+// that a difference is encoder steps that were missed or added by noise, so the spindle
+// really is that much further than counted.
+long spindleIndexCorrection(long delta) {
+  long sinceIndex;
+  if (!encoderTakeIndex(&sinceIndex)) {
+    return 0;
+  }
+  long drift = spindleModulo(sinceIndex - spindlePosGlobal - delta);
+  if (drift > ENCODER_STEPS_INT / 2) {
+    drift -= ENCODER_STEPS_INT;
+  }
+  if (!spindleIndexed) {
+    // Passes of an operation that's on sync to the phase the first pass had, setting it now
+    // would start the next pass in another groove. Wait for a pulse while off.
+    if (isOn) return 0;
+    spindleIndexed = true;
+    spindlePosGlobal = spindleModulo(spindlePosGlobal + drift);
+    return 0;
+  }
+  spindleIndexDrift = drift;
+  return drift;
+}
+
 void processSpindlePosDelta() {
-  long delta = spindlePosDelta;
+  PROFILE_ZONE(PROFILE_SPINDLE_DELTA);
+  long delta = encoderTakeDelta();
+  unsigned long microsNow = micros();
+  updateSpindleVelocity(microsNow, delta);
+  delta += spindleIndexCorrection(delta);
   if (delta == 0) {
+    updateSpindlePosFraction(microsNow);
     return;
   }
-  unsigned long microsNow = micros();
-  if (showTacho || mode == MODE_GCODE) {
-    if (spindleEncTimeIndex >= RPM_BULK) {
-      spindleEncTimeDiffBulk = microsNow - spindleEncTimeAtIndex0;
-      spindleEncTimeAtIndex0 = microsNow;
-      spindleEncTimeIndex = 0;
-    }
-    spindleEncTimeIndex += abs(delta);
-  } else {
-    spindleEncTimeDiffBulk = 0;
-  }
+  spindlePosFraction = 0;
+  traceEvent(TRACE_SPINDLE_DELTA, 0, delta);
 
   spindlePos += delta;
   spindlePosGlobal += delta;
@@ -689,63 +797,133 @@ void processSpindlePosDelta() {
   }
   spindleEncTime = microsNow;
 
-  if (spindlePosSync != 0) {
+  long past;
+  if (spindlePosSync != 0 && passedSpindleTurn(spindlePosSync, spindlePosSync + delta, &past)) {
+    spindlePosSync = 0;
+    spindleSyncPast = past;
+    Axis* a = getPitchAxis();
+    spindlePosAvg = spindlePos = spindleFromPos(a, a->pos) + past;
+  } else if (spindlePosSync != 0) {
     spindlePosSync += delta;
-    if (spindlePosSync % ENCODER_STEPS_INT == 0) {
-      spindlePosSync = 0;
-      Axis* a = getPitchAxis();
-      spindlePosAvg = spindlePos = spindleFromPos(a, a->pos);
-    }
   }
-  spindlePosDelta -= delta;
 }
 
-// Apply changes requested by the keyboard thread.
-void applySettings() {
-  if (nextDuprFlag) {
-    applyDupr();
-    nextDuprFlag = false;
-  }
-  if (nextStartsFlag) {
-    applyStarts();
-    nextStartsFlag = false;
-  }
-  if (z.nextLeftStopFlag) {
-    applyLeftStop(&z);
-    z.nextLeftStopFlag = false;
-  }
-  if (z.nextRightStopFlag) {
-    applyRightStop(&z);
-    z.nextRightStopFlag = false;
-  }
-  if (x.nextLeftStopFlag) {
-    applyLeftStop(&x);
-    x.nextLeftStopFlag = false;
+void applySpindleShift(long diff, long prevSpindlePos, bool shift) {
+  if (shift) {
+    spindlePos += diff;
+    spindlePosAvg += diff;
   }
-  if (x.nextRightStopFlag) {
-    applyRightStop(&x);
-    x.nextRightStopFlag = false;
+  while (diff > 0 ? (spindlePos < prevSpindlePos) : (spindlePos > prevSpindlePos)) {
+    spindlePos += diff;
+    spindlePosAvg += diff;
   }
-  if (a1.nextLeftStopFlag) {
-    applyLeftStop(&a1);
-    a1.nextLeftStopFlag = false;
+}
+
+// Apply a command queued by another task, see postMotionCommand().
+void applyMotionCommand(const MotionCommand& command) {
+  traceEvent(TRACE_SETTING, command.type, command.value);
+  if (command.type == MOTION_CMD_MARK_ORIGIN) {
+    markOrigin();
+  } else if (command.type == MOTION_CMD_SPINDLE_SHIFT) {
+    applySpindleShift(command.value, command.value2, true);
+  } else if (command.type == MOTION_CMD_SPINDLE_CATCH_UP) {
+    applySpindleShift(command.value, command.value2, false);
+  } else if (command.type == MOTION_CMD_DUPR) {
+    applyDupr(command.value);
+  } else if (command.type == MOTION_CMD_STARTS) {
+    applyStarts(command.value);
+  } else if (command.type == MOTION_CMD_CONE_RATIO) {
+    applyConeRatio(command.ratio);
+  } else if (command.type == MOTION_CMD_MODE) {
+    setModeFromLoop(command.value);
+  } else if (command.type == MOTION_CMD_IS_ON) {
+    setIsOnFromLoop(command.value);
+  } else if (command.type == MOTION_CMD_LEFT_STOP) {
+    applyLeftStop(command.axis, command.value);
+  } else if (command.type == MOTION_CMD_RIGHT_STOP) {
+    applyRightStop(command.axis, command.value);
+  } else if (command.type == MOTION_CMD_RESET_FOLLOWING) {
+    resetFollowingStats();
+  } else if (command.type == MOTION_CMD_RESET_PROFILE) {
+    resetProfileZones();
+  } else if (command.type == MOTION_CMD_STEP_TO) {
+    stepTo(command.axis, command.value, command.value2 != 0);
+  } else if (command.type == MOTION_CMD_ASYNC_DIRECTION) {
+    updateAsyncTimerSettings();
+  } else if (BENCH && command.type == MOTION_CMD_BENCH) {
+    runMotionBenchmarks();
   }
-  if (a1.nextRightStopFlag) {
-    applyRightStop(&a1);
-    a1.nextRightStopFlag = false;
+}
+
+// Records when waiting for the spindle starts and ends, not every count it goes down by.
+bool spindleSyncTraced = false;
+void traceSpindleSync() {
+  if ((spindlePosSync != 0) != spindleSyncTraced) {
+    spindleSyncTraced = spindlePosSync != 0;
+    traceEvent(TRACE_SYNC, 0, spindlePosSync);
   }
-  if (nextConeRatioFlag) {
-    applyConeRatio();
-    nextConeRatioFlag = false;
+}
+
+// One cycle of the motion logic. Other tasks never block it, they post a MotionCommand instead.
+void motionCycle() {
+  PROFILE_ZONE(PROFILE_MOTION_CYCLE);
+  if (powerFailDetected()) {
+    // Stop moving so that the saved positions are where the axes really are.
+    setEmergencyStop(ESTOP_POWER_FAIL);
+    publishMotionSnapshot();
+    powerFailSave();
+    return;
   }
-  if (nextIsOnFlag) {
-    setIsOnFromLoop(nextIsOn);
-    nextIsOnFlag = false;
+  applyMotionCommands();
+  processSpindlePosDelta();
+  discountFullSpindleTurns();
+  checkMaxRpm();
+  // Modes that follow the spindle set these again.
+  z.speedFollow = 0;
+  x.speedFollow = 0;
+  if (!isOn || dupr == 0 || spindlePosSync != 0 || maxRpmExceeded) {
+    // None of the modes work.
+  } else if (mode == MODE_NORMAL) {
+    modeGearbox();
+  } else if (mode == MODE_TURN) {
+    modeTurn(&z, &x);
+  } else if (mode == MODE_FACE) {
+    modeTurn(&x, &z);
+  } else if (mode == MODE_CUT) {
+    modeCut();
+  } else if (mode == MODE_CONE) {
+    modeCone();
+  } else if (mode == MODE_THREAD) {
+    modeTurn(&z, &x);
+  } else if (mode == MODE_ELLIPSE) {
+    modeEllipse(&z, &x);
   }
-  if (nextModeFlag) {
-    setModeFromLoop(nextMode);
-    nextModeFlag = false;
+  moveAxis(&z);
+  moveAxis(&x);
+  if (ACTIVE_A1) moveAxis(&a1);
+  traceSpindleSync();
+  publishMotionSnapshot();
+}
+
+void taskMotion(void *param) {
+  unsigned long cycleStartUs = micros();
+  while (emergencyStop == ESTOP_NONE) {
+    // Busy-wait for the deadline, nothing else runs on this core.
+    unsigned long nowUs = micros();
+    while (long(nowUs - cycleStartUs) < 0) {
+      nowUs = micros();
+    }
+    recordMotionCycle(nowUs);
+    motionCycle();
+    unsigned long endUs = micros();
+    recordMotionCycleEnd(nowUs, endUs);
+    cycleStartUs += MOTION_CYCLE_US;
+    if (long(endUs - cycleStartUs) > long(MOTION_CYCLE_US)) {
+      // Cycle overran by more than a period, don't try to catch up with a burst of cycles.
+      cycleStartUs = micros();
+    }
   }
+  endTask();
 }
 
 //===============================================================================
@@ -787,14 +965,15 @@ void setup() {
     DLOW(A21);
   }
 
-  setPreferences ();
-
   initAxis(&z, NAME_Z, true, false, MOTOR_STEPS_Z, SCREW_Z_DU, SPEED_START_Z, SPEED_MANUAL_MOVE_Z, ACCELERATION_Z, INVERT_Z, NEEDS_REST_Z, MAX_TRAVEL_MM_Z, BACKLASH_DU_Z, Z_ENA, Z_DIR, Z_STEP);
   initAxis(&x, NAME_X, true, false, MOTOR_STEPS_X, SCREW_X_DU, SPEED_START_X, SPEED_MANUAL_MOVE_X, ACCELERATION_X, INVERT_X, NEEDS_REST_X, MAX_TRAVEL_MM_X, BACKLASH_DU_X, X_ENA, X_DIR, X_STEP);
   initAxis(&a1, NAME_A1, ACTIVE_A1, ROTARY_A1, MOTOR_STEPS_A1, SCREW_A1_DU, SPEED_START_A1, SPEED_MANUAL_MOVE_A1, ACCELERATION_A1, INVERT_A1, NEEDS_REST_A1, MAX_TRAVEL_MM_A1, BACKLASH_DU_A1, A11, A12, A13);
 
+  setPreferences (); // after initAxis() which resets positions and stops
+  powerFailSetup();
+
   isOn = false;
-  motionMutex = xSemaphoreCreateMutex();
+  publishMotionSnapshot(); // other tasks read positions from the snapshot
 
   if (!z.needsRest && !z.disabled) {
     if (INVERT_Z_ENA)
@@ -822,58 +1001,27 @@ void setup() {
   keypadSetup();
 
   // Non-time-sensitive tasks on core 0.
-  xTaskCreatePinnedToCore(taskDisplay, "taskDisplay", 10000 /* stack size */, NULL, 0 /* priority */, NULL, 0 /* core */);
+  startTask(TASK_taskDisplay, taskDisplay);
 
   delay(100);
   if (keypadAvailable()) {
     setEmergencyStop(ESTOP_KEY);
     return;
   } else {
-    xTaskCreatePinnedToCore(taskKeypad, "taskKeypad", 10000 /* stack size */, NULL, 0 /* priority */, NULL, 0 /* core */);
+    startTask(TASK_taskKeypad, taskKeypad);
   }
 
-  xTaskCreatePinnedToCore(taskMoveZ, "taskMoveZ", 10000 /* stack size */, NULL, 0 /* priority */, NULL, 0 /* core */);
-  xTaskCreatePinnedToCore(taskMoveX, "taskMoveX", 10000 /* stack size */, NULL, 0 /* priority */, NULL, 0 /* core */);
-  if (a1.active) xTaskCreatePinnedToCore(taskMoveA1, "taskMoveA1", 10000 /* stack size */, NULL, 0 /* priority */, NULL, 0 /* core */);
-  xTaskCreatePinnedToCore(taskAttachInterrupts, "taskAttachInterrupts", 10000 /* stack size */, NULL, 0 /* priority */, NULL, 0 /* core */);
-  xTaskCreatePinnedToCore(taskGcode, "taskGcode", 10000 /* stack size */, NULL, 0 /* priority */, NULL, 0 /* core */);
+  startTask(TASK_taskMoveZ, taskMoveZ);
+  startTask(TASK_taskMoveX, taskMoveX);
+  if (a1.active) startTask(TASK_taskMoveA1, taskMoveA1);
+  startTask(TASK_taskAttachInterrupts, taskAttachInterrupts);
+  startTask(TASK_taskGcode, taskGcode);
+
+  // Motion gets core 1 to itself at the highest priority.
+  startTask(TASK_taskMotion, taskMotion);
 }
 
 void loop() {
-  if (emergencyStop != ESTOP_NONE) {
-    return;
-  }
-  if (xSemaphoreTake(motionMutex, 1) != pdTRUE) {
-    return;
-  }
-  applySettings();
-  processSpindlePosDelta();
-  discountFullSpindleTurns();
-  if (!isOn || dupr == 0 || spindlePosSync != 0) {
-    // None of the modes work.
-  } else if (mode == MODE_NORMAL) {
-    modeGearbox();
-  } else if (mode == MODE_TURN) {
-    modeTurn(&z, &x);
-  } else if (mode == MODE_FACE) {
-    modeTurn(&x, &z);
-  } else if (mode == MODE_CUT) {
-    modeCut();
-  } else if (mode == MODE_CONE) {
-    modeCone();
-  } else if (mode == MODE_THREAD) {
-    modeTurn(&z, &x);
-  } else if (mode == MODE_ELLIPSE) {
-    modeEllipse(&z, &x);
-  }
-  moveAxis(&z);
-  moveAxis(&x);
-  if (ACTIVE_A1) moveAxis(&a1);
-  xSemaphoreGive(motionMutex);
+  // Motion runs in taskMotion, Arduino loop task isn't needed.
+  vTaskDelete(NULL);
 }
-
-int main () {
-  setup();
-  while (true)
-    loop();
-};
\ No newline at end of file
@@ -6,15 +6,13 @@
 #include "keypad.hpp"
 #include "interrupts.hpp"
 #include "spindle.hpp"
+#include "motion.hpp"
+#include "preferences.hpp"
+#include "trace.hpp"
 
 volatile int mode = -1; // mode of operation (ELS, multi-start ELS, asynchronous)
-int nextMode = 0; // mode value that should be applied asap
-bool nextModeFlag = false; // whether nextMode needs attention
-int savedMode = -1; // mode saved in Preferences
 
 bool isOn = false;
-bool nextIsOn; // isOn value that should be applied asap
-bool nextIsOnFlag; // whether nextIsOn requires attention
 
 bool isPassMode() {
   return mode == MODE_TURN || mode == MODE_FACE || mode == MODE_CUT || mode == MODE_THREAD || mode == MODE_ELLIPSE;
@@ -40,9 +38,71 @@ int getLastSetupIndex() {
   return 0;
 }
 
+long getPassModePasses() {
+  if (mode == MODE_TURN || mode == MODE_FACE || mode == MODE_THREAD) return turnPasses * starts;
+  return turnPasses;
+}
+
+// Pass that a stopped or power-interrupted operation can be continued from, 0 if there is none.
+// Changing pitch since the operation started makes the passes done so far useless.
+long getResumableOpIndex() {
+  if (!isPassMode() || opIndex < 1 || opIndex > getPassModePasses() || dupr != opDupr) return 0;
+  return opIndex;
+}
+
+// Axis that moves with the spindle in the current mode, NULL if none does.
+Axis* getSpindleFollowingAxis() {
+  if (mode == MODE_FACE || mode == MODE_CUT) return &x;
+  if (mode == MODE_NORMAL || mode == MODE_TURN || mode == MODE_THREAD || mode == MODE_CONE || mode == MODE_ELLIPSE) return &z;
+  return NULL;
+}
+
+// Spindle RPM up to which an axis moving turnDu per spindle revolution keeps up. It has to
+// step SPEED_FOLLOW_MARGIN below speedManualMove, and when started into a turning spindle
+// it has to accelerate from speedStart and make up what it fell behind within
+// FOLLOW_CATCH_UP_TURNS without going over speedManualMove.
+float getAxisMaxRpm(Axis* a, float turnDu) {
+  float stepsPerTurn = turnDu * a->motorSteps / a->screwPitch;
+  float catchUpSteps = stepsPerTurn * FOLLOW_CATCH_UP_TURNS;
+  float start = a->speedStart;
+  float top = a->speedManualMove;
+  // Caught up while still accelerating: start * t + acceleration * t^2 / 2 = speed * t,
+  // with t = catchUpSteps / speed. The axis gets to 2 * speed - start by then.
+  float speed = (start + sqrt(start * start + 2 * a->acceleration * catchUpSteps)) / 2;
+  if (2 * speed - start > top) {
+    // Caught up at speedManualMove after accelerating to it.
+    float behindAtTop = (top - start) * (top - start) / 2 / a->acceleration;
+    speed = catchUpSteps * top / (catchUpSteps + behindAtTop);
+  }
+  speed = min(speed, top / SPEED_FOLLOW_MARGIN);
+  return speed * 60 / stepsPerTurn;
+}
+
+// Spindle RPM above which an axis moving with the spindle falls behind and the thread is
+// lost. 0 if nothing follows the spindle.
+long getMaxRpm(long duprValue, int startsValue) {
+  Axis* a = getSpindleFollowingAxis();
+  if (a == NULL || duprValue == 0) return 0;
+  float turnDu = abs(duprValue) * startsValue;
+  if (mode == MODE_CONE) {
+    // X moves coneRatio / 2 of Z.
+    float xTurnDu = turnDu * abs(coneRatio) / 2;
+    return xTurnDu == 0 ? getAxisMaxRpm(a, turnDu) : min(getAxisMaxRpm(a, turnDu), getAxisMaxRpm(&x, xTurnDu));
+  }
+  if (mode == MODE_ELLIPSE) {
+    // Both go along a quarter of a sine, at their steepest HALF_PI times faster than on average.
+    float rpm = getAxisMaxRpm(a, turnDu * HALF_PI);
+    if (z.leftStop != LONG_MAX && z.rightStop != LONG_MIN && x.leftStop != LONG_MAX && x.rightStop != LONG_MIN && z.leftStop != z.rightStop) {
+      float xPerZ = abs(stepsToDu(&x, x.leftStop - x.rightStop) / float(stepsToDu(&z, z.leftStop - z.rightStop)));
+      if (xPerZ > 0) rpm = min(rpm, getAxisMaxRpm(&x, turnDu * xPerZ * HALF_PI));
+    }
+    return rpm;
+  }
+  return getAxisMaxRpm(a, turnDu);
+}
+
 void setModeFromTask(int value) {
-  nextMode = value;
-  nextModeFlag = true;
+  postMotionSetting(MOTION_CMD_MODE, NULL, value, 0);
 }
 
 bool needZStops() {
@@ -51,20 +111,17 @@ bool needZStops() {
 
 void setDupr(long value) {
   // Can't apply changes right away since we might be in the middle of motion logic.
-  nextDupr = value;
-  nextDuprFlag = true;
+  postMotionSetting(MOTION_CMD_DUPR, NULL, value, 0);
 }
 
 void setStarts(int value) {
   // Can't apply changes right away since we might be in the middle of motion logic.
-  nextStarts = value;
-  nextStartsFlag = true;
+  postMotionSetting(MOTION_CMD_STARTS, NULL, value, 0);
 }
 
 void setConeRatio(float value) {
   // Can't apply changes right away since we might be in the middle of motion logic.
-  nextConeRatio = value;
-  nextConeRatioFlag = true;
+  postMotionSetting(MOTION_CMD_CONE_RATIO, NULL, 0, value);
 }
 
 void setIsOnFromLoop(bool on) {
@@ -74,6 +131,7 @@ void setIsOnFromLoop(bool on) {
   if (!on) {
     isOn = false;
     setupIndex = 0;
+    maxRpmExceeded = false;
   }
   stepperEnable(&z, on);
   stepperEnable(&x, on);
@@ -81,12 +139,14 @@ void setIsOnFromLoop(bool on) {
   markOrigin();
   if (on) {
     isOn = true;
+    maxRpmExceeded = false;
     opDuprSign = dupr >= 0 ? 1 : -1;
     opDupr = dupr;
     opIndex = 0;
     opIndexAdvanceFlag = false;
     opSubIndex = 0;
     setupIndex = 0;
+    markSavedDirty(SAVED_OP);
   }
 }
 
@@ -99,11 +159,14 @@ void setModeFromLoop(int value) {
     setIsOnFromLoop(false);
   }
   if (mode == MODE_THREAD) {
-    setStarts(1);
+    applyStarts(1);
   } else if (mode == MODE_ASYNC || mode == MODE_A1) {
     setAsyncTimerEnable(false);
   }
   mode = value;
+  traceEvent(TRACE_MODE, 0, mode);
+  opIndex = 0; // operation of another mode can't be resumed
+  markSavedDirty(SAVED_MODE | SAVED_OP);
   setupIndex = 0;
   if (mode == MODE_ASYNC || mode == MODE_A1) {
     if (!timerAttached) {
@@ -119,8 +182,9 @@ void setModeFromLoop(int value) {
 // encoder and stepper as a new 0. To be called when dupr changes
 // or ELS is turned on/off. Without this, changing dupr will
 // result in stepper rushing across the lathe to the new position.
-// Must be called while holding motionMutex.
+// Must be called from the motion task, post MOTION_CMD_MARK_ORIGIN from other tasks.
 void markOrigin() {
+  traceEvent(TRACE_MARK_ORIGIN, 0, spindlePos);
   markAxisOrigin(&z);
   markAxisOrigin(&x);
   markAxisOrigin(&a1);
@@ -134,7 +198,7 @@ unsigned int getTimerLimit() {
   return min(long(65535), long(1000000 / (z.motorSteps * abs(dupr) / z.screwPitch)) - 1); // 1000000/Hz - 1
 }
 
-
+// Must be called from the motion task, post MOTION_CMD_ASYNC_DIRECTION from other tasks.
 void updateAsyncTimerSettings() {
   // dupr and therefore direction can change while we're in async mode.
   setDir(getAsyncAxis(), dupr > 0);
@@ -0,0 +1,275 @@
+#include <atomic>
+#include "vars.hpp"
+#include "motion.hpp"
+#include "spindle.hpp"
+#include "preferences.hpp"
+#include "profiler.hpp"
+
+MotionCommand motionQueue[MOTION_QUEUE_SIZE];
+std::atomic<unsigned long> motionQueueHead(0); // number of commands ever posted
+std::atomic<unsigned long> motionQueueTail(0); // number of commands ever processed
+portMUX_TYPE motionQueueMux = portMUX_INITIALIZER_UNLOCKED; // serializes producers, the motion task never takes it
+
+// A step is late by up to a cycle, keep that well below the time between steps at full speed.
+static_assert(MOTION_CYCLE_US * 3 * SPEED_MANUAL_MOVE_Z <= 1000000 && MOTION_CYCLE_US * 3 * SPEED_MANUAL_MOVE_X <= 1000000
+    && MOTION_CYCLE_US * 3 * SPEED_MANUAL_MOVE_A1 <= 1000000, "MOTION_CYCLE_US too long for the fastest axis");
+
+MotionSnapshot motionSnapshot;
+std::atomic<unsigned long> motionSnapshotSeq(0); // odd while motionSnapshot is being written
+
+unsigned long motionCycleLastUs = 0; // micros() when the previous cycle started
+unsigned long motionCycleCount = 0; // cycles in the current statistics window
+unsigned long motionCycleTotalUs = 0;
+unsigned long motionCycleMinUs = ULONG_MAX;
+unsigned long motionCycleMaxUs = 0;
+volatile unsigned long motionCycleStatsMinUs = 0;
+volatile unsigned long motionCycleStatsAvgUs = 0;
+volatile unsigned long motionCycleStatsMaxUs = 0;
+volatile unsigned long motionCycleOverruns = 0;
+volatile unsigned long motionCycleBusyMaxUs = 0;
+
+// Following error telemetry, only written by the motion task. Counters are 32-bit so that
+// getFollowingStats() can read them from another core, the 64-bit sum is published as rmsSteps.
+struct FollowingCounters {
+  volatile unsigned long samples;
+  volatile unsigned long maxSteps;
+  volatile float rmsSteps;
+  volatile unsigned long buckets[FOLLOWING_BUCKETS];
+  volatile unsigned long skippedCycles;
+  uint64_t sumSquares;
+  bool stepPending; // pendingPos was non-zero in this cycle
+  bool stepWasPending; // and in the previous one
+};
+FollowingCounters followingZ, followingX, followingA1;
+
+unsigned long postMotionCommand(int type, Axis* axis, long value, long value2, float ratio) {
+  unsigned long ticket = 0;
+  portENTER_CRITICAL(&motionQueueMux);
+  unsigned long head = motionQueueHead.load(std::memory_order_relaxed);
+  if (head - motionQueueTail.load(std::memory_order_acquire) < MOTION_QUEUE_SIZE) {
+    MotionCommand* command = &motionQueue[head & (MOTION_QUEUE_SIZE - 1)];
+    command->type = type;
+    command->axis = axis;
+    command->value = value;
+    command->value2 = value2;
+    command->ratio = ratio;
+    ticket = head + 1;
+    motionQueueHead.store(ticket, std::memory_order_release);
+  }
+  portEXIT_CRITICAL(&motionQueueMux);
+  return ticket;
+}
+
+unsigned long postMotionCommand(int type, Axis* axis, long value, long value2) {
+  return postMotionCommand(type, axis, value, value2, 0);
+}
+
+void postMotionSetting(int type, Axis* axis, long value, float ratio) {
+  // Unlike the old flag per setting, a full queue can't silently overwrite a change, so wait.
+  while (postMotionCommand(type, axis, value, 0, ratio) == 0) {
+    if (emergencyStop != ESTOP_NONE) {
+      return;
+    }
+    taskYIELD();
+  }
+}
+
+bool waitForMotionCommand(unsigned long ticket) {
+  while (long(motionQueueTail.load(std::memory_order_acquire) - ticket) < 0) {
+    if (emergencyStop != ESTOP_NONE) {
+      return false;
+    }
+    taskYIELD();
+  }
+  return true;
+}
+
+bool runMotionCommand(int type, Axis* axis, long value, long value2) {
+  unsigned long ticket = postMotionCommand(type, axis, value, value2);
+  return ticket != 0 && waitForMotionCommand(ticket);
+}
+
+void applyMotionCommands() {
+  PROFILE_ZONE(PROFILE_MOTION_COMMANDS);
+  // Nothing queued is by far the most common case and costs a single atomic load.
+  unsigned long tail = motionQueueTail.load(std::memory_order_relaxed);
+  unsigned long head = motionQueueHead.load(std::memory_order_acquire);
+  for (; tail != head; tail++) {
+    applyMotionCommand(motionQueue[tail & (MOTION_QUEUE_SIZE - 1)]);
+    // Only count the command as processed once it's applied, see waitForMotionCommand().
+    motionQueueTail.store(tail + 1, std::memory_order_release);
+  }
+}
+
+FollowingCounters* getFollowingCounters(Axis* a) {
+  if (a == &z) return &followingZ;
+  if (a == &x) return &followingX;
+  return &followingA1;
+}
+
+void publishFollowingRms(FollowingCounters* f) {
+  if (f->samples > 0) f->rmsSteps = sqrt(float(f->sumSquares) / f->samples);
+}
+
+void recordFollowingError(Axis* a) {
+  FollowingCounters* f = getFollowingCounters(a);
+  f->samples++;
+  f->stepWasPending = f->stepPending;
+  f->stepPending = a->pendingPos != 0;
+  // Standing still or keeping up is the common case, keep it to a couple of increments.
+  if (!f->stepPending) {
+    f->buckets[0]++;
+    return;
+  }
+  unsigned long error = abs(a->pendingPos);
+  if (error > f->maxSteps) f->maxSteps = error;
+  f->sumSquares += uint64_t(error) * error;
+  int bucket = 32 - __builtin_clz(error); // 1 for 1, 2 for 2-3, 3 for 4-7 and so on
+  f->buckets[bucket < FOLLOWING_BUCKETS ? bucket : FOLLOWING_BUCKETS - 1]++;
+}
+
+void recordStepLate(Axis* a, long lateUs) {
+  FollowingCounters* f = getFollowingCounters(a);
+  // A step that just became pending was due whenever the previous one was, that's not a skip.
+  if (f->stepWasPending && lateUs >= long(MOTION_CYCLE_US)) {
+    f->skippedCycles += lateUs / MOTION_CYCLE_US;
+  }
+}
+
+void resetFollowingCounters(FollowingCounters* f) {
+  f->samples = 0;
+  f->maxSteps = 0;
+  f->rmsSteps = 0;
+  for (int i = 0; i < FOLLOWING_BUCKETS; i++) f->buckets[i] = 0;
+  f->skippedCycles = 0;
+  f->sumSquares = 0;
+}
+
+void resetFollowingStats() {
+  resetFollowingCounters(&followingZ);
+  resetFollowingCounters(&followingX);
+  resetFollowingCounters(&followingA1);
+}
+
+FollowingStats getFollowingStats(Axis* a) {
+  FollowingCounters* f = getFollowingCounters(a);
+  FollowingStats stats;
+  stats.samples = f->samples;
+  stats.maxSteps = f->maxSteps;
+  stats.rmsSteps = f->rmsSteps;
+  for (int i = 0; i < FOLLOWING_BUCKETS; i++) stats.buckets[i] = f->buckets[i];
+  stats.skippedCycles = f->skippedCycles;
+  return stats;
+}
+
+void recordMotionCycle(unsigned long startUs) {
+  if (motionCycleLastUs != 0) {
+    unsigned long periodUs = startUs - motionCycleLastUs;
+    if (periodUs < motionCycleMinUs) motionCycleMinUs = periodUs;
+    if (periodUs > motionCycleMaxUs) motionCycleMaxUs = periodUs;
+    if (periodUs >= MOTION_CYCLE_US * 3 / 2) motionCycleOverruns++;
+    motionCycleTotalUs += periodUs;
+    motionCycleCount++;
+  }
+  motionCycleLastUs = startUs;
+  if (motionCycleCount >= MOTION_STATS_CYCLES) {
+    motionCycleStatsMinUs = motionCycleMinUs;
+    motionCycleStatsAvgUs = motionCycleTotalUs / motionCycleCount;
+    motionCycleStatsMaxUs = motionCycleMaxUs;
+    publishFollowingRms(&followingZ);
+    publishFollowingRms(&followingX);
+    publishFollowingRms(&followingA1);
+    motionCycleCount = 0;
+    motionCycleTotalUs = 0;
+    motionCycleMinUs = ULONG_MAX;
+    motionCycleMaxUs = 0;
+  }
+}
+
+void recordMotionCycleEnd(unsigned long startUs, unsigned long endUs) {
+  unsigned long busyUs = endUs - startUs;
+  if (busyUs > motionCycleBusyMaxUs) motionCycleBusyMaxUs = busyUs;
+}
+
+MotionCycleStats getMotionCycleStats() {
+  MotionCycleStats stats;
+  stats.minUs = motionCycleStatsMinUs;
+  stats.avgUs = motionCycleStatsAvgUs;
+  stats.maxUs = motionCycleStatsMaxUs;
+  stats.overruns = motionCycleOverruns;
+  stats.busyMaxUs = motionCycleBusyMaxUs;
+  return stats;
+}
+
+// Returns SAVED_AXIS_* bits of the fields that changed since the previous snapshot.
+uint32_t copyAxisSnapshot(Axis* a, AxisSnapshot* s) {
+  uint32_t dirty = 0;
+  if (s->pos != a->pos || s->posGlobal != a->posGlobal || s->motorPos != a->motorPos) dirty |= SAVED_AXIS_POS;
+  if (s->originPos != a->originPos) dirty |= SAVED_AXIS_ORIGIN;
+  if (s->leftStop != a->leftStop || s->rightStop != a->rightStop) dirty |= SAVED_AXIS_STOPS;
+  s->pos = a->pos;
+  s->originPos = a->originPos;
+  s->posGlobal = a->posGlobal;
+  s->motorPos = a->motorPos;
+  s->leftStop = a->leftStop;
+  s->rightStop = a->rightStop;
+  return savedAxisBits(a, dirty);
+}
+
+void publishMotionSnapshot() {
+  PROFILE_ZONE(PROFILE_SNAPSHOT);
+  unsigned long seq = motionSnapshotSeq.load(std::memory_order_relaxed);
+  motionSnapshotSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  // Comparing with the previous snapshot here saves setting dirty bits on every step.
+  uint32_t dirty = copyAxisSnapshot(&z, &motionSnapshot.z);
+  dirty |= copyAxisSnapshot(&x, &motionSnapshot.x);
+  dirty |= copyAxisSnapshot(&a1, &motionSnapshot.a1);
+  if (motionSnapshot.spindlePos != spindlePos || motionSnapshot.spindlePosAvg != spindlePosAvg ||
+      motionSnapshot.spindlePosGlobal != spindlePosGlobal || motionSnapshot.spindlePosSync != spindlePosSync) dirty |= SAVED_SPINDLE;
+  if (motionSnapshot.dupr != dupr) dirty |= SAVED_DUPR;
+  if (motionSnapshot.starts != starts) dirty |= SAVED_STARTS;
+  if (motionSnapshot.opIndex != opIndex) dirty |= SAVED_OP;
+  motionSnapshot.spindlePos = spindlePos;
+  motionSnapshot.spindlePosAvg = spindlePosAvg;
+  motionSnapshot.spindlePosGlobal = spindlePosGlobal;
+  motionSnapshot.spindlePosSync = spindlePosSync;
+  motionSnapshot.dupr = dupr;
+  motionSnapshot.starts = starts;
+  motionSnapshot.opIndex = opIndex;
+  motionSnapshotSeq.store(seq + 2, std::memory_order_release);
+  // The first snapshot holds what was just loaded, nothing to save.
+  if (seq != 0 && dirty != 0) {
+    markSavedDirty(dirty);
+  }
+}
+
+void readMotionSnapshot(MotionSnapshot* snapshot) {
+  while (true) {
+    unsigned long seq = motionSnapshotSeq.load(std::memory_order_acquire);
+    if ((seq & 1) == 0) {
+      *snapshot = motionSnapshot;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (motionSnapshotSeq.load(std::memory_order_relaxed) == seq) {
+        return;
+      }
+    }
+    // Publishing takes well under a microsecond, no point in yielding.
+  }
+}
+
+void readNextMotionSnapshot(MotionSnapshot* snapshot) {
+  unsigned long seq = motionSnapshotSeq.load(std::memory_order_acquire);
+  // If a snapshot is being written right now, it might have been copied before our call.
+  unsigned long target = (seq & 1) == 0 ? seq + 2 : seq + 3;
+  while (long(motionSnapshotSeq.load(std::memory_order_acquire) - target) < 0 && emergencyStop == ESTOP_NONE) {
+    taskYIELD();
+  }
+  readMotionSnapshot(snapshot);
+}
+
+const AxisSnapshot* getAxisSnapshot(const MotionSnapshot* snapshot, Axis* a) {
+  if (a == &z) return &snapshot->z;
+  if (a == &x) return &snapshot->x;
+  return &snapshot->a1;
+}
@@ -0,0 +1,47 @@
+#include <esp_system.h>
+#include <hal/brownout_hal.h>
+#include <soc/rtc_cntl_reg.h>
+#include "vars.hpp"
+#include "preferences.hpp"
+#include "powerfail.hpp"
+#include "tasks.hpp"
+
+TaskHandle_t powerFailTaskHandle = NULL;
+bool powerFailTriggered = false;
+
+void taskPowerFail(void *param) {
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  // Journal saves never erase, the display task erases ahead while idle and not after a
+  // stop. So this is a single slot write, after waiting for an erase if one is under way.
+  savePreferences();
+  esp_restart();
+}
+
+void powerFailSetup() {
+  // The framework's own brownout interrupt restarts right away and can't be unhooked,
+  // so keep the interrupt off and have the motion task poll the raw status instead.
+  brownout_hal_config_t config;
+  config.threshold = POWER_FAIL_BROWNOUT_LEVEL;
+  config.enabled = true;
+  config.reset_enabled = false;
+  config.flash_power_down = false; // still need to write to it
+  config.rf_power_down = true;
+  brownout_hal_intr_enable(false);
+  brownout_hal_config(&config);
+  brownout_hal_intr_clear();
+  powerFailTaskHandle = startTask(TASK_taskPowerFail, taskPowerFail);
+}
+
+bool powerFailDetected() {
+  if (powerFailTriggered || !REG_GET_BIT(RTC_CNTL_INT_RAW_REG, RTC_CNTL_BROWN_OUT_INT_RAW)) {
+    return false;
+  }
+  powerFailTriggered = true;
+  return true;
+}
+
+void powerFailSave() {
+  if (powerFailTaskHandle != NULL) {
+    xTaskNotifyGive(powerFailTaskHandle);
+  }
+}
@@ -4,6 +4,9 @@
 #include "spindle.hpp"
 #include "display.hpp"
 #include "modes.hpp"
+#include "motion.hpp"
+#include "journal.hpp"
+#include "preferences.hpp"
 
 #define PREF_VERSION "v"
 #define PREF_DUPR "d"
@@ -47,97 +50,229 @@
 #define PREFERENCES_VERSION 1
 #define PREF_NAMESPACE "h4"
 
-void setPreferences() {
+// Version of SavedState, should be changed whenever SAVED_STATE_FIELDS or units of saved values
+// change, along with a step in setPreferences() that brings records of the older version up to date.
+#define SAVED_STATE_VERSION 1
+
+// Everything that survives a restart. Adding a saved value only takes a line here
+// plus markSavedDirty() calls wherever it changes.
+// F(record field, record type, dirty bit, value to save from MotionSnapshot m or globals, variable to load into)
+// Fixed-width types keep the record layout the same regardless of the size of long.
+#define SAVED_STATE_FIELDS(F) \
+  F(dupr,             int32_t, SAVED_DUPR,                               m.dupr,             dupr) \
+  F(starts,           int32_t, SAVED_STARTS,                             m.starts,           starts) \
+  F(zPos,             int32_t, savedAxisBits(&z, SAVED_AXIS_POS),        m.z.pos,            z.pos) \
+  F(zPosGlobal,       int32_t, savedAxisBits(&z, SAVED_AXIS_POS),        m.z.posGlobal,      z.posGlobal) \
+  F(zOriginPos,       int32_t, savedAxisBits(&z, SAVED_AXIS_ORIGIN),     m.z.originPos,      z.originPos) \
+  F(zMotorPos,        int32_t, savedAxisBits(&z, SAVED_AXIS_POS),        m.z.motorPos,       z.motorPos) \
+  F(zLeftStop,        int32_t, savedAxisBits(&z, SAVED_AXIS_STOPS),      m.z.leftStop,       z.leftStop) \
+  F(zRightStop,       int32_t, savedAxisBits(&z, SAVED_AXIS_STOPS),      m.z.rightStop,      z.rightStop) \
+  F(zDisabled,        bool,    savedAxisBits(&z, SAVED_AXIS_DISABLED),   z.disabled,         z.disabled) \
+  F(xPos,             int32_t, savedAxisBits(&x, SAVED_AXIS_POS),        m.x.pos,            x.pos) \
+  F(xPosGlobal,       int32_t, savedAxisBits(&x, SAVED_AXIS_POS),        m.x.posGlobal,      x.posGlobal) \
+  F(xOriginPos,       int32_t, savedAxisBits(&x, SAVED_AXIS_ORIGIN),     m.x.originPos,      x.originPos) \
+  F(xMotorPos,        int32_t, savedAxisBits(&x, SAVED_AXIS_POS),        m.x.motorPos,       x.motorPos) \
+  F(xLeftStop,        int32_t, savedAxisBits(&x, SAVED_AXIS_STOPS),      m.x.leftStop,       x.leftStop) \
+  F(xRightStop,       int32_t, savedAxisBits(&x, SAVED_AXIS_STOPS),      m.x.rightStop,      x.rightStop) \
+  F(xDisabled,        bool,    savedAxisBits(&x, SAVED_AXIS_DISABLED),   x.disabled,         x.disabled) \
+  F(a1Pos,            int32_t, savedAxisBits(&a1, SAVED_AXIS_POS),       m.a1.pos,           a1.pos) \
+  F(a1PosGlobal,      int32_t, savedAxisBits(&a1, SAVED_AXIS_POS),       m.a1.posGlobal,     a1.posGlobal) \
+  F(a1OriginPos,      int32_t, savedAxisBits(&a1, SAVED_AXIS_ORIGIN),    m.a1.originPos,     a1.originPos) \
+  F(a1MotorPos,       int32_t, savedAxisBits(&a1, SAVED_AXIS_POS),       m.a1.motorPos,      a1.motorPos) \
+  F(a1LeftStop,       int32_t, savedAxisBits(&a1, SAVED_AXIS_STOPS),     m.a1.leftStop,      a1.leftStop) \
+  F(a1RightStop,      int32_t, savedAxisBits(&a1, SAVED_AXIS_STOPS),     m.a1.rightStop,     a1.rightStop) \
+  F(a1Disabled,       bool,    savedAxisBits(&a1, SAVED_AXIS_DISABLED),  a1.disabled,        a1.disabled) \
+  F(spindlePos,       int32_t, SAVED_SPINDLE,                            m.spindlePos,       spindlePos) \
+  F(spindlePosAvg,    int32_t, SAVED_SPINDLE,                            m.spindlePosAvg,    spindlePosAvg) \
+  F(spindlePosSync,   int32_t, SAVED_SPINDLE,                            m.spindlePosSync,   spindlePosSync) \
+  F(spindlePosGlobal, int32_t, SAVED_SPINDLE,                            m.spindlePosGlobal, spindlePosGlobal) \
+  F(showAngle,        bool,    SAVED_SHOW,                               showAngle,          showAngle) \
+  F(showTacho,        bool,    SAVED_SHOW,                               showTacho,          showTacho) \
+  F(moveStep,         int32_t, SAVED_MOVE_STEP,                          moveStep,           moveStep) \
+  F(mode,             int32_t, SAVED_MODE,                               mode,               loadedMode) \
+  F(measure,          int32_t, SAVED_MEASURE,                            measure,            measure) \
+  F(coneRatio,        float,   SAVED_CONE_RATIO,                         coneRatio,          coneRatio) \
+  F(turnPasses,       int32_t, SAVED_TURN_PASSES,                        turnPasses,         turnPasses) \
+  F(auxForward,       bool,    SAVED_AUX_FORWARD,                        auxForward,         auxForward) \
+  F(opIndex,          int32_t, SAVED_OP,                                 m.opIndex,          loadedOpIndex) \
+  F(opDupr,           int32_t, SAVED_OP,                                 opDupr,             opDupr)
+
+#define SAVED_STATE_MEMBER(field, type, bit, save, load) type field;
+#define SAVED_STATE_BIT(field, type, bit, save, load) | (bit)
+#define SAVED_STATE_SAVE(field, type, bit, save, load) state->field = savedValue<type>(save);
+#define SAVED_STATE_LOAD(field, type, bit, save, load) load = state->field;
+
+struct SavedState {
+  int32_t version;
+  SAVED_STATE_FIELDS(SAVED_STATE_MEMBER)
+};
+static_assert(sizeof(SavedState) <= JOURNAL_DATA_MAX, "SavedState must fit into a journal record");
+
+// Where long is wider than int32_t (the host build), unset stops have to stay at the limits.
+template <class T, class V> T savedValue(V value) {
+  return value;
+}
+template <> int32_t savedValue<int32_t, long>(long value) {
+  return max(long(INT32_MIN), min(long(INT32_MAX), value));
+}
+
+std::atomic<uint32_t> savedStateDirty(0);
+SemaphoreHandle_t saveMutex = NULL; // the power fail task can interrupt a save of the display task
+
+uint32_t savedStateAllBits() {
+  return 0 SAVED_STATE_FIELDS(SAVED_STATE_BIT);
+}
+
+void fillSavedState(const MotionSnapshot& m, SavedState* state) {
+  memset(state, 0, sizeof(SavedState)); // padding goes into the record's CRC
+  state->version = SAVED_STATE_VERSION;
+  SAVED_STATE_FIELDS(SAVED_STATE_SAVE)
+}
+
+// NVS counted one encoder edge per line, see ENCODER_STEPS_INT.
+const int SAVED_SPINDLE_SCALE = ENCODER_STEPS_INT / ENCODER_PPR;
+
+void loadSavedState(const SavedState* state) {
+  int loadedMode;
+  long loadedOpIndex;
+  SAVED_STATE_FIELDS(SAVED_STATE_LOAD)
+  // Unset stops were saved as the int32_t limits, see savedValue().
+  Axis* axes[] = {&z, &x, &a1};
+  for (Axis* a : axes) {
+    if (a->leftStop == INT32_MAX) a->leftStop = LONG_MAX;
+    if (a->rightStop == INT32_MIN) a->rightStop = LONG_MIN;
+  }
+  starts = min(STARTS_MAX, max(1, starts));
+  setModeFromLoop(loadedMode);
+  opIndex = loadedOpIndex; // after the mode since changing it drops the operation
+  opDuprSign = opDupr >= 0 ? 1 : -1;
+  savedStateDirty.store(0); // loading isn't a change
+}
+
+// Forgets positions, stops and the spindle phase when the saved ones can't be trusted,
+// moving to them could crash the carriage. The user is told on screen.
+void resetSavedPositions() {
+  Axis* axes[] = {&z, &x, &a1};
+  for (Axis* a : axes) {
+    a->pos = 0;
+    a->posGlobal = 0;
+    a->originPos = 0;
+    a->motorPos = 0;
+    a->leftStop = LONG_MAX;
+    a->rightStop = LONG_MIN;
+  }
+  spindlePos = 0;
+  spindlePosAvg = 0;
+  spindlePosSync = 0;
+  spindlePosGlobal = 0;
+  opIndex = 0;
+  savedStateReset = true;
+  beepFlag = true;
+}
+
+bool preferencesToRetire = false; // NVS still holds state that the next journal save replaces
+
+// State used to be kept in Preferences, only read now to carry it over on the first start
+// with the journal. Nothing writes it any more, so it's cleared once the journal has it.
+void loadPreferencesFromNvs() {
   Preferences pref;
   pref.begin(PREF_NAMESPACE);
   if (pref.getInt(PREF_VERSION) != PREFERENCES_VERSION) {
     pref.clear();
     pref.putInt(PREF_VERSION, PREFERENCES_VERSION);
   }
-  savedDupr = dupr = pref.getLong(PREF_DUPR);
-  savedStarts = starts = min(STARTS_MAX, max(1, pref.getInt(PREF_STARTS)));
-  z.savedPos = z.pos = pref.getLong(PREF_POS_Z);
-  z.savedPosGlobal = z.posGlobal = pref.getLong(PREF_POS_GLOBAL_Z);
-  z.savedOriginPos = z.originPos = pref.getLong(PREF_ORIGIN_POS_Z);
-  z.savedMotorPos = z.motorPos = pref.getLong(PREF_MOTOR_POS_Z);
-  z.savedLeftStop = z.leftStop = pref.getLong(PREF_LEFT_STOP_Z, LONG_MAX);
-  z.savedRightStop = z.rightStop = pref.getLong(PREF_RIGHT_STOP_Z, LONG_MIN);
-  z.savedDisabled = z.disabled = pref.getBool(PREF_DISABLED_Z, false);
-  x.savedPos = x.pos = pref.getLong(PREF_POS_X);
-  x.savedPosGlobal = x.posGlobal = pref.getLong(PREF_POS_GLOBAL_X);
-  x.savedOriginPos = x.originPos = pref.getLong(PREF_ORIGIN_POS_X);
-  x.savedMotorPos = x.motorPos = pref.getLong(PREF_MOTOR_POS_X);
-  x.savedLeftStop = x.leftStop = pref.getLong(PREF_LEFT_STOP_X, LONG_MAX);
-  x.savedRightStop = x.rightStop = pref.getLong(PREF_RIGHT_STOP_X, LONG_MIN);
-  x.savedDisabled = x.disabled = pref.getBool(PREF_DISABLED_X, false);
-  a1.savedPos = a1.pos = pref.getLong(PREF_POS_A1);
-  a1.savedPosGlobal = a1.posGlobal = pref.getLong(PREF_POS_GLOBAL_A1);
-  a1.savedOriginPos = a1.originPos = pref.getLong(PREF_ORIGIN_POS_A1);
-  a1.savedMotorPos = a1.motorPos = pref.getLong(PREF_MOTOR_POS_A1);
-  a1.savedLeftStop = a1.leftStop = pref.getLong(PREF_LEFT_STOP_A1, LONG_MAX);
-  a1.savedRightStop = a1.rightStop = pref.getLong(PREF_RIGHT_STOP_A1, LONG_MIN);
-  a1.savedDisabled = a1.disabled = pref.getBool(PREF_DISABLED_A1, false);
-  savedSpindlePos = spindlePos = pref.getLong(PREF_SPINDLE_POS);
-  savedSpindlePosAvg = spindlePosAvg = pref.getLong(PREF_SPINDLE_POS_AVG);
-  savedSpindlePosSync = spindlePosSync = pref.getInt(PREF_OUT_OF_SYNC);
-  savedSpindlePosGlobal = spindlePosGlobal = pref.getLong(PREF_SPINDLE_POS_GLOBAL);
-  savedShowAngle = showAngle = pref.getBool(PREF_SHOW_ANGLE);
-  savedShowTacho = showTacho = pref.getBool(PREF_SHOW_TACHO);
-  savedMoveStep = moveStep = pref.getLong(PREF_MOVE_STEP, MOVE_STEP_1);
-  setModeFromLoop(savedMode = pref.getInt(PREF_MODE));
-  savedMeasure = measure = pref.getInt(PREF_MEASURE);
-  savedConeRatio = coneRatio = pref.getFloat(PREF_CONE_RATIO, coneRatio);
-  savedTurnPasses = turnPasses = pref.getInt(PREF_TURN_PASSES, turnPasses);
-  savedAuxForward = auxForward = pref.getBool(PREF_AUX_FORWARD, true);
+  dupr = pref.getLong(PREF_DUPR);
+  starts = min(STARTS_MAX, max(1, pref.getInt(PREF_STARTS)));
+  z.pos = pref.getLong(PREF_POS_Z);
+  z.posGlobal = pref.getLong(PREF_POS_GLOBAL_Z);
+  z.originPos = pref.getLong(PREF_ORIGIN_POS_Z);
+  z.motorPos = pref.getLong(PREF_MOTOR_POS_Z);
+  z.leftStop = pref.getLong(PREF_LEFT_STOP_Z, LONG_MAX);
+  z.rightStop = pref.getLong(PREF_RIGHT_STOP_Z, LONG_MIN);
+  z.disabled = pref.getBool(PREF_DISABLED_Z, false);
+  x.pos = pref.getLong(PREF_POS_X);
+  x.posGlobal = pref.getLong(PREF_POS_GLOBAL_X);
+  x.originPos = pref.getLong(PREF_ORIGIN_POS_X);
+  x.motorPos = pref.getLong(PREF_MOTOR_POS_X);
+  x.leftStop = pref.getLong(PREF_LEFT_STOP_X, LONG_MAX);
+  x.rightStop = pref.getLong(PREF_RIGHT_STOP_X, LONG_MIN);
+  x.disabled = pref.getBool(PREF_DISABLED_X, false);
+  a1.pos = pref.getLong(PREF_POS_A1);
+  a1.posGlobal = pref.getLong(PREF_POS_GLOBAL_A1);
+  a1.originPos = pref.getLong(PREF_ORIGIN_POS_A1);
+  a1.motorPos = pref.getLong(PREF_MOTOR_POS_A1);
+  a1.leftStop = pref.getLong(PREF_LEFT_STOP_A1, LONG_MAX);
+  a1.rightStop = pref.getLong(PREF_RIGHT_STOP_A1, LONG_MIN);
+  a1.disabled = pref.getBool(PREF_DISABLED_A1, false);
+  spindlePos = pref.getLong(PREF_SPINDLE_POS) * SAVED_SPINDLE_SCALE;
+  spindlePosAvg = pref.getLong(PREF_SPINDLE_POS_AVG) * SAVED_SPINDLE_SCALE;
+  spindlePosSync = pref.getInt(PREF_OUT_OF_SYNC) * SAVED_SPINDLE_SCALE;
+  spindlePosGlobal = pref.getLong(PREF_SPINDLE_POS_GLOBAL) * SAVED_SPINDLE_SCALE;
+  showAngle = pref.getBool(PREF_SHOW_ANGLE);
+  showTacho = pref.getBool(PREF_SHOW_TACHO);
+  moveStep = pref.getLong(PREF_MOVE_STEP, MOVE_STEP_1);
+  setModeFromLoop(pref.getInt(PREF_MODE));
+  measure = pref.getInt(PREF_MEASURE);
+  coneRatio = pref.getFloat(PREF_CONE_RATIO, coneRatio);
+  turnPasses = pref.getInt(PREF_TURN_PASSES, turnPasses);
+  auxForward = pref.getBool(PREF_AUX_FORWARD, true);
   pref.end();
-};
+  // Carry everything over into the journal with the next save.
+  markSavedDirty(savedStateAllBits());
+}
 
-bool savePreferences () {
-  // Should avoid calling Preferences whenever possible to reduce memory wear and avoid ~20ms write delay that blocks interrupts.
-  if (dupr == savedDupr && starts == savedStarts && z.pos == z.savedPos && z.originPos == z.savedOriginPos && z.posGlobal == z.savedPosGlobal && z.motorPos == z.savedMotorPos && z.leftStop == z.savedLeftStop && z.rightStop == z.savedRightStop && z.disabled == z.savedDisabled &&
-      spindlePos == savedSpindlePos && spindlePosAvg == savedSpindlePosAvg && spindlePosSync == savedSpindlePosSync && savedSpindlePosGlobal == spindlePosGlobal && showAngle == savedShowAngle && showTacho == savedShowTacho && moveStep == savedMoveStep &&
-      mode == savedMode && measure == savedMeasure && x.pos == x.savedPos && x.originPos == x.savedOriginPos && x.posGlobal == x.savedPosGlobal && x.motorPos == x.savedMotorPos && x.leftStop == x.savedLeftStop && x.rightStop == x.savedRightStop && x.disabled == x.savedDisabled &&
-      a1.pos == a1.savedPos && a1.originPos == a1.savedOriginPos && a1.posGlobal == a1.savedPosGlobal && a1.motorPos == a1.savedMotorPos && a1.leftStop == a1.savedLeftStop && a1.rightStop == a1.savedRightStop && a1.disabled == a1.savedDisabled &&
-      coneRatio == savedConeRatio && turnPasses == savedTurnPasses && savedAuxForward == auxForward) return false;
+void setPreferences() {
+  saveMutex = xSemaphoreCreateMutex();
+  if (!journalSetup()) {
+    // Nowhere to save, whatever NVS has is from before the journal and positions are stale.
+    loadPreferencesFromNvs();
+    resetSavedPositions();
+    return;
+  }
+  SavedState state;
+  int size = journalLoad(&state, sizeof(state));
+  if (size < 0) {
+    loadPreferencesFromNvs();
+    preferencesToRetire = true;
+  } else if (state.version == SAVED_STATE_VERSION && size == int(sizeof(state))) {
+    loadSavedState(&state);
+  } else {
+    // Written by a newer firmware or broken, write a fresh record so that it's only reported once.
+    resetSavedPositions();
+    markSavedDirty(savedStateAllBits());
+  }
+}
 
+bool erasePreferencesAhead() {
+  xSemaphoreTake(saveMutex, portMAX_DELAY);
+  // Once stopped, e.g. by a power failure, the power fail save mustn't wait for an erase.
+  bool erased = emergencyStop == ESTOP_NONE && journalEraseAhead();
+  xSemaphoreGive(saveMutex);
+  return erased;
+}
 
-  Preferences pref;
-  pref.begin(PREF_NAMESPACE);
-  if (dupr != savedDupr) pref.putLong(PREF_DUPR, savedDupr = dupr);
-  if (starts != savedStarts) pref.putInt(PREF_STARTS, savedStarts = starts);
-  if (z.pos != z.savedPos) pref.putLong(PREF_POS_Z, z.savedPos = z.pos);
-  if (z.posGlobal != z.savedPosGlobal) pref.putLong(PREF_POS_GLOBAL_Z, z.savedPosGlobal = z.posGlobal);
-  if (z.originPos != z.savedOriginPos) pref.putLong(PREF_ORIGIN_POS_Z, z.savedOriginPos = z.originPos);
-  if (z.motorPos != z.savedMotorPos) pref.putLong(PREF_MOTOR_POS_Z, z.savedMotorPos = z.motorPos);
-  if (z.leftStop != z.savedLeftStop) pref.putLong(PREF_LEFT_STOP_Z, z.savedLeftStop = z.leftStop);
-  if (z.rightStop != z.savedRightStop) pref.putLong(PREF_RIGHT_STOP_Z, z.savedRightStop = z.rightStop);
-  if (z.disabled != z.savedDisabled) pref.putBool(PREF_DISABLED_Z, z.savedDisabled = z.disabled);
-  if (spindlePos != savedSpindlePos) pref.putLong(PREF_SPINDLE_POS, savedSpindlePos = spindlePos);
-  if (spindlePosAvg != savedSpindlePosAvg) pref.putLong(PREF_SPINDLE_POS_AVG, savedSpindlePosAvg = spindlePosAvg);
-  if (spindlePosSync != savedSpindlePosSync) pref.putInt(PREF_OUT_OF_SYNC, savedSpindlePosSync = spindlePosSync);
-  if (spindlePosGlobal != savedSpindlePosGlobal) pref.putLong(PREF_SPINDLE_POS_GLOBAL, savedSpindlePosGlobal = spindlePosGlobal);
-  if (showAngle != savedShowAngle) pref.putBool(PREF_SHOW_ANGLE, savedShowAngle = showAngle);
-  if (showTacho != savedShowTacho) pref.putBool(PREF_SHOW_TACHO, savedShowTacho = showTacho);
-  if (moveStep != savedMoveStep) pref.putLong(PREF_MOVE_STEP, savedMoveStep = moveStep);
-  if (mode != savedMode) pref.putInt(PREF_MODE, savedMode = mode);
-  if (measure != savedMeasure) pref.putInt(PREF_MEASURE, savedMeasure = measure);
-  if (x.pos != x.savedPos) pref.putLong(PREF_POS_X, x.savedPos = x.pos);
-  if (x.posGlobal != x.savedPosGlobal) pref.putLong(PREF_POS_GLOBAL_X, x.savedPosGlobal = x.posGlobal);
-  if (x.originPos != x.savedOriginPos) pref.putLong(PREF_ORIGIN_POS_X, x.savedOriginPos = x.originPos);
-  if (x.motorPos != x.savedMotorPos) pref.putLong(PREF_MOTOR_POS_X, x.savedMotorPos = x.motorPos);
-  if (x.leftStop != x.savedLeftStop) pref.putLong(PREF_LEFT_STOP_X, x.savedLeftStop = x.leftStop);
-  if (x.rightStop != x.savedRightStop) pref.putLong(PREF_RIGHT_STOP_X, x.savedRightStop = x.rightStop);
-  if (x.disabled != x.savedDisabled) pref.putBool(PREF_DISABLED_X, x.savedDisabled = x.disabled);
-  if (a1.pos != a1.savedPos) pref.putLong(PREF_POS_A1, a1.savedPos = a1.pos);
-  if (a1.posGlobal != a1.savedPosGlobal) pref.putLong(PREF_POS_GLOBAL_A1, a1.savedPosGlobal = a1.posGlobal);
-  if (a1.originPos != a1.savedOriginPos) pref.putLong(PREF_ORIGIN_POS_A1, a1.savedOriginPos = a1.originPos);
-  if (a1.motorPos != a1.savedMotorPos) pref.putLong(PREF_MOTOR_POS_A1, a1.savedMotorPos = a1.motorPos);
-  if (a1.leftStop != a1.savedLeftStop) pref.putLong(PREF_LEFT_STOP_A1, a1.savedLeftStop = a1.leftStop);
-  if (a1.rightStop != a1.savedRightStop) pref.putLong(PREF_RIGHT_STOP_A1, a1.savedRightStop = a1.rightStop);
-  if (a1.disabled != a1.savedDisabled) pref.putBool(PREF_DISABLED_A1, a1.savedDisabled = a1.disabled);
-  if (coneRatio != savedConeRatio) pref.putFloat(PREF_CONE_RATIO, savedConeRatio = coneRatio);
-  if (turnPasses != savedTurnPasses) pref.putInt(PREF_TURN_PASSES, savedTurnPasses = turnPasses);
-  if (auxForward != savedAuxForward) pref.putBool(PREF_AUX_FORWARD, savedAuxForward = auxForward);
-  pref.end();
-  return true;
-}
\ No newline at end of file
+bool savePreferences () {
+  // Nothing to do most of the time, flash erases block interrupts for tens of ms and wear it out.
+  if (savedStateDirty.load(std::memory_order_acquire) == 0) {
+    return false;
+  }
+  xSemaphoreTake(saveMutex, portMAX_DELAY);
+  // Clear before reading so that changes made from now on are saved next time.
+  uint32_t dirty = savedStateDirty.exchange(0, std::memory_order_acquire);
+  MotionSnapshot m;
+  readNextMotionSnapshot(&m);
+  SavedState state;
+  fillSavedState(m, &state);
+  bool saved = journalAppend(&state, sizeof(state));
+  if (!saved) {
+    markSavedDirty(dirty);
+  } else if (preferencesToRetire) {
+    preferencesToRetire = false;
+    Preferences pref;
+    pref.begin(PREF_NAMESPACE);
+    pref.clear();
+    pref.end();
+  }
+  xSemaphoreGive(saveMutex);
+  return saved;
+}
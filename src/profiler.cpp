@@ -0,0 +1,53 @@
+#include <Arduino.h>
+#include "profiler.hpp"
+
+// Each zone is written by one context only. The 64-bit total can't be read atomically
+// from the other core, getProfileZoneStats() retries until count didn't change around it.
+struct ProfileZone {
+  volatile uint32_t count;
+  volatile uint32_t minCycles;
+  volatile uint32_t maxCycles;
+  volatile uint64_t totalCycles;
+};
+
+ProfileZone profileZones[PROFILE_ZONES];
+
+const char* PROFILE_ZONE_NAMES[PROFILE_ZONES] = {"cycle", "commands", "spindle", "gearbox", "turn", "cut", "cone",
+    "ellipse", "moveAxis", "snapshot", "asyncTimer", "spinEnc", "indexIsr"};
+
+void IRAM_ATTR recordProfileZone(int zone, uint32_t startCycles) {
+  uint32_t cycles = profilerCycles() - startCycles; // unsigned difference handles the counter wrapping
+  ProfileZone* p = &profileZones[zone];
+  if (p->count == 0 || cycles < p->minCycles) p->minCycles = cycles;
+  if (cycles > p->maxCycles) p->maxCycles = cycles;
+  p->totalCycles += cycles;
+  p->count++;
+}
+
+void resetProfileZones() {
+  for (int i = 0; i < PROFILE_ZONES; i++) {
+    ProfileZone* p = &profileZones[i];
+    p->count = 0;
+    p->minCycles = 0;
+    p->maxCycles = 0;
+    p->totalCycles = 0;
+  }
+}
+
+ProfileZoneStats getProfileZoneStats(int zone) {
+  ProfileZone* p = &profileZones[zone];
+  ProfileZoneStats stats;
+  uint64_t totalCycles;
+  do {
+    stats.count = p->count;
+    totalCycles = p->totalCycles;
+    stats.minCycles = p->minCycles;
+    stats.maxCycles = p->maxCycles;
+  } while (stats.count != p->count);
+  stats.avgCycles = stats.count == 0 ? 0 : totalCycles / stats.count;
+  return stats;
+}
+
+const char* getProfileZoneName(int zone) {
+  return PROFILE_ZONE_NAMES[zone];
+}
@@ -3,23 +3,22 @@
 #include "config.hpp"
 #include "pcb.hpp"
 #include "spindle.hpp"
+#include "profiler.hpp"
 
 unsigned long spindleEncTime = 0; // micros() of the previous spindle update
-unsigned long spindleEncTimeDiffBulk = 0; // micros() between RPM_BULK spindle updates
-unsigned long spindleEncTimeAtIndex0 = 0; // micros() when spindleEncTimeIndex was 0
-int spindleEncTimeIndex = 0; // counter going between 0 and RPM_BULK - 1
+std::atomic<float> spindleVelocity(0); // Encoder steps per second, negative in reverse. Always kept up to date by the motion task.
+std::atomic<float> spindleAcceleration(0); // Encoder steps per second^2
 long spindlePos = 0; // Spindle position
 long spindlePosAvg = 0; // Spindle position accounting for encoder backlash
-long savedSpindlePosAvg = 0; // spindlePosAvg saved in Preferences
-long savedSpindlePos = 0; // spindlePos value saved in Preferences
+float spindlePosFraction = 0; // Part of an encoder step turned since the last count, add to spindlePosAvg for a smooth position
 std::atomic<long> spindlePosDelta; // Unprocessed encoder ticks. see https://forum.arduino.cc/t/does-c-std-atomic-work-with-dual-core-esp32/690214
 int spindlePosSync = 0; // Non-zero if gearbox is on and a soft limit was removed while axis was on it
-int savedSpindlePosSync = 0; // spindlePosSync saved in Preferences
 long spindlePosGlobal = 0; // global spindle position that is unaffected by e.g. zeroing
-long savedSpindlePosGlobal = 0; // spindlePosGlobal saved in Preferences
+bool spindleIndexed = false; // Whether spindlePosGlobal has been lined up with the encoder index pulse since boot
+long spindleIndexDrift = 0; // Encoder steps corrected at the last index pulse after the first one
+unsigned long spindleSyncWaitUs = 0; // How long the last thread pass waited for the spindle to reach its phase
+unsigned long spindleSyncWaitMaxUs = 0; // Longest such wait since boot
 
-bool savedShowAngle = false; // showAngle value saved in Preferences
-bool savedShowTacho = false; // showTacho value saved in Preferences
 int shownRpm = 0;
 unsigned long shownRpmTime = 0; // micros() when shownRpm was set
 
@@ -39,26 +38,112 @@ const bool PULSE_2_INVERT = true; // Set to false to change the direction in whi
 void zeroSpindlePos() {
   spindlePos = 0;
   spindlePosAvg = 0;
+  spindlePosFraction = 0;
   spindlePosSync = 0;
 }
 
+// Only touched by the motion task.
+unsigned long spindleSampleUs[SPINDLE_SAMPLES]; // micros() of the sample
+long spindleSampleCount[SPINDLE_SAMPLES]; // spindleCount at the sample
+int spindleSampleNext = 0; // ring index to write the next sample to
+int spindleSampleSize = 0; // number of valid samples in the ring
+long spindleCount = 0; // all encoder steps ever, unlike spindlePos it's never reset
+unsigned long spindleCountUs = 0; // micros() of the last spindleCount change
+
+// Least squares fit of count = a + b*t + c*t^2 over the recent samples with t in ms
+// relative to the newest sample, so that b is the velocity right now. Counts are exact
+// and times are off by at most a motion cycle, a quadratic has too little data with
+// fewer than 4 samples so a line is used then.
+void fitSpindleVelocity() {
+  int newest = (spindleSampleNext + SPINDLE_SAMPLES - 1) % SPINDLE_SAMPLES;
+  unsigned long newestUs = spindleSampleUs[newest];
+  long newestCount = spindleSampleCount[newest];
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0, y0 = 0, y1 = 0, y2 = 0;
+  for (int i = 0; i < spindleSampleSize; i++) {
+    int index = (newest + SPINDLE_SAMPLES - i) % SPINDLE_SAMPLES;
+    unsigned long ageUs = newestUs - spindleSampleUs[index];
+    // Always keep 2 samples to have a velocity even if the spindle is very slow.
+    if (i >= 2 && ageUs > SPINDLE_WINDOW_US) break;
+    float t = -(ageUs / 1000.0f);
+    float y = spindleSampleCount[index] - newestCount;
+    float t2 = t * t;
+    s0 += 1; s1 += t; s2 += t2; s3 += t2 * t; s4 += t2 * t2;
+    y0 += y; y1 += t * y; y2 += t2 * y;
+  }
+  float velocity = 0, acceleration = 0;
+  if (s0 >= 4) {
+    float det = s0 * (s2 * s4 - s3 * s3) - s1 * (s1 * s4 - s3 * s2) + s2 * (s1 * s3 - s2 * s2);
+    if (det != 0) {
+      velocity = (s0 * (y1 * s4 - s3 * y2) - y0 * (s1 * s4 - s3 * s2) + s2 * (s1 * y2 - y1 * s2)) / det;
+      acceleration = 2 * (s0 * (s2 * y2 - y1 * s3) - s1 * (s1 * y2 - y1 * s2) + y0 * (s1 * s3 - s2 * s2)) / det;
+    }
+  } else if (s0 >= 2) {
+    float det = s0 * s2 - s1 * s1;
+    if (det != 0) velocity = (s0 * y1 - s1 * y0) / det;
+  }
+  spindleVelocity = velocity * 1000; // per ms to per s
+  spindleAcceleration = acceleration * 1000000;
+}
+
+void updateSpindleVelocity(unsigned long microsNow, long delta) {
+  if (delta == 0) {
+    unsigned long idleUs = microsNow - spindleCountUs;
+    if (spindleSampleSize == 0 || idleUs < SPINDLE_SAMPLE_US) return;
+    if (idleUs > SPINDLE_STOP_US) {
+      spindleSampleSize = 0;
+      spindleVelocity = 0;
+      spindleAcceleration = 0;
+      return;
+    }
+    // Slowing down: the next count is late, so it's slower than the fit says.
+    float maxVelocity = 1000000.0f / idleUs;
+    float velocity = spindleVelocity;
+    if (abs(velocity) > maxVelocity) {
+      spindleVelocity = velocity > 0 ? maxVelocity : -maxVelocity;
+    }
+    return;
+  }
+  spindleCount += delta;
+  spindleCountUs = microsNow;
+  if (spindleSampleSize > 0) {
+    int newest = (spindleSampleNext + SPINDLE_SAMPLES - 1) % SPINDLE_SAMPLES;
+    if (microsNow - spindleSampleUs[newest] < SPINDLE_SAMPLE_US) return;
+  }
+  spindleSampleUs[spindleSampleNext] = microsNow;
+  spindleSampleCount[spindleSampleNext] = spindleCount;
+  spindleSampleNext = (spindleSampleNext + 1) % SPINDLE_SAMPLES;
+  spindleSampleSize = min(spindleSampleSize + 1, SPINDLE_SAMPLES);
+  fitSpindleVelocity();
+}
+
+// Moves spindlePosAvg forward between counts at the estimated velocity, so that axes
+// following the spindle step evenly instead of in bursts on every count. Stays under
+// one step to never run past the next count, and 0 while backlash is being taken up.
+void updateSpindlePosFraction(unsigned long microsNow) {
+  float velocity = spindleVelocity;
+  bool following = velocity > 0 ? spindlePosAvg == spindlePos : spindlePosAvg == spindlePos + ENCODER_BACKLASH;
+  if (velocity == 0 || !following) {
+    spindlePosFraction = 0;
+    return;
+  }
+  float fraction = velocity * (microsNow - spindleCountUs) / 1000000.0f;
+  spindlePosFraction = constrain(fraction, -SPINDLE_FRACTION_MAX, SPINDLE_FRACTION_MAX);
+}
+
+float getSpindleRpm() {
+  return spindleVelocity * 60 / ENCODER_STEPS_FLOAT;
+}
+
 int getApproxRpm() {
   unsigned long t = micros();
-  if (t > spindleEncTime + 100000) {
-    // RPM less than 10.
-    return 0;
-  }
   if (t < shownRpmTime + RPM_UPDATE_INTERVAL_MICROS) {
     // Don't update RPM too often to avoid flickering.
     return shownRpm;
   }
-  int rpm = 0;
-  if (spindleEncTimeDiffBulk > 0) {
-    rpm = 60000000 / spindleEncTimeDiffBulk;
-    if (abs(rpm - shownRpm) < (rpm < 1000 ? 2 : 5)) {
-      // Don't update RPM with insignificant differences.
-      rpm = shownRpm;
-    }
+  int rpm = round(abs(getSpindleRpm()));
+  if (abs(rpm - shownRpm) < (rpm < 1000 ? 2 : 5)) {
+    // Don't update RPM with insignificant differences.
+    rpm = shownRpm;
   }
   return rpm;
 }
@@ -73,6 +158,7 @@ long spindleModulo(long value) {
 
 // Called on a FALLING interrupt for the spindle rotary encoder pin.
 void IRAM_ATTR spinEnc() {
+  PROFILE_ZONE(PROFILE_SPIN_ENC);
   spindlePosDelta += DREAD(ENC_B) ? -1 : 1;
 }
 
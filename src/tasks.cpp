@@ -1,6 +1,8 @@
 #include "modes.hpp"
 #include "tasks.hpp"
 #include "vars.hpp"
+#include "motion.hpp"
+#include "alloc.hpp"
 
 hw_timer_t *async_timer = timerBegin(0, 80, true);
 
@@ -12,16 +14,108 @@ void setAsyncTimerEnable(bool value) {
   }
 }
 
+// The motion task stops stepping by itself at the start of its next cycle.
 void setEmergencyStop(int kind) {
   emergencyStop = kind;
   setAsyncTimerEnable(false);
-  xSemaphoreTake(z.mutex, 10);
-  xSemaphoreTake(x.mutex, 10);
-  xSemaphoreTake(a1.mutex, 10);
 }
 
 void setIsOnFromTask(bool on) {
-  nextIsOn = on;
-  nextIsOnFlag = true;
+  postMotionSetting(MOTION_CMD_IS_ON, NULL, on, 0);
 }
 
+struct TaskSlot {
+  const char* name;
+  uint32_t stackBytes;
+  UBaseType_t priority;
+  BaseType_t core;
+  StackType_t* stack;
+  StaticTask_t* tcb;
+  TaskFunction_t function;
+  TaskHandle_t handle; // NULL until started
+  bool ended;
+  unsigned long endFreeBytes; // high-water mark when it ended, its TCB isn't valid after that
+};
+
+#define TASK_STORAGE(function, stackBytes, priority, core) \
+  alignas(16) StackType_t function##Stack[stackBytes]; \
+  StaticTask_t function##Tcb;
+TASKS(TASK_STORAGE)
+
+#define TASK_SLOT(function, stackBytes, priority, core) {#function, stackBytes, priority, core, function##Stack, &function##Tcb, NULL, NULL, false, 0},
+TaskSlot taskSlots[TASK_COUNT] = {TASKS(TASK_SLOT)};
+
+#define TASK_STACK_SUM(function, stackBytes, priority, core) + stackBytes
+const unsigned long TASK_STACK_TOTAL = 0 TASKS(TASK_STACK_SUM);
+static_assert(TASK_STACK_TOTAL <= TASK_STACK_BUDGET, "Task stacks don't fit TASK_STACK_BUDGET");
+static_assert(TASK_COUNT + 1 <= ALLOC_TAGS, "Not enough allocation tags for all tasks");
+
+__thread int currentTaskId = -1; // TaskId of the calling task, -1 for others
+
+void runTask(void* param) {
+  TaskSlot* slot = (TaskSlot*) param;
+  currentTaskId = slot - taskSlots;
+  setAllocationTag(currentTaskId + 1);
+  slot->function(NULL);
+  endTask(); // FreeRTOS tasks must not return
+}
+
+TaskHandle_t startTask(int id, TaskFunction_t function) {
+  TaskSlot* slot = &taskSlots[id];
+  slot->function = function;
+  slot->handle = xTaskCreateStaticPinnedToCore(runTask, slot->name, slot->stackBytes, slot, slot->priority, slot->stack, slot->tcb, slot->core);
+  return slot->handle;
+}
+
+void endTask() {
+  if (currentTaskId >= 0) {
+    TaskSlot* slot = &taskSlots[currentTaskId];
+    slot->endFreeBytes = uxTaskGetStackHighWaterMark(NULL);
+    slot->ended = true;
+  }
+  vTaskDelete(NULL);
+}
+
+// [TSK:name,stack bytes,never used stack bytes or -1 if not started,allocations,bytes allocated] per task,
+// then [HEAP:free,lowest free since boot,largest free block,static stacks total], then
+// [STACK_LOW:name,never used stack bytes] for every task with less than TASK_STACK_LOW_BYTES left.
+void printTaskStats() {
+  long freeBytes[TASK_COUNT];
+  for (int i = 0; i <= TASK_COUNT; i++) {
+    TaskSlot* slot = i < TASK_COUNT ? &taskSlots[i] : NULL;
+    AllocationStats allocations = getAllocationStats(i < TASK_COUNT ? i + 1 : 0);
+    Serial.print("[TSK:");
+    Serial.print(slot == NULL ? "other" : slot->name);
+    Serial.print(",");
+    Serial.print(slot == NULL ? 0 : slot->stackBytes);
+    Serial.print(",");
+    if (slot == NULL) {
+      Serial.print(-1);
+    } else {
+      freeBytes[i] = slot->handle == NULL ? -1 : slot->ended ? (long) slot->endFreeBytes : (long) uxTaskGetStackHighWaterMark(slot->handle);
+      Serial.print(freeBytes[i]);
+    }
+    Serial.print(",");
+    Serial.print(allocations.count);
+    Serial.print(",");
+    Serial.print(allocations.bytes);
+    Serial.println("]");
+  }
+  Serial.print("[HEAP:");
+  Serial.print(ESP.getFreeHeap());
+  Serial.print(",");
+  Serial.print(ESP.getMinFreeHeap());
+  Serial.print(",");
+  Serial.print(ESP.getMaxAllocHeap());
+  Serial.print(",");
+  Serial.print(TASK_STACK_TOTAL);
+  Serial.println("]");
+  for (int i = 0; i < TASK_COUNT; i++) {
+    if (freeBytes[i] < 0 || freeBytes[i] >= long(TASK_STACK_LOW_BYTES)) continue;
+    Serial.print("[STACK_LOW:");
+    Serial.print(taskSlots[i].name);
+    Serial.print(",");
+    Serial.print(freeBytes[i]);
+    Serial.println("]");
+  }
+}
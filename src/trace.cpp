@@ -0,0 +1,55 @@
+#include <Arduino.h>
+#include <atomic>
+#include "trace.hpp"
+
+TraceEvent traceRing[TRACE_EVENTS];
+std::atomic<uint32_t> traceHead(0); // number of events ever recorded
+TraceEvent traceKeyRing[TRACE_KEY_EVENTS];
+std::atomic<uint32_t> traceKeyHead(0); // number of keypad events ever recorded
+
+void traceRecord(TraceEvent* ring, uint32_t size, std::atomic<uint32_t>* ringHead, uint8_t type, uint8_t arg, int32_t value) {
+  uint32_t head = ringHead->load(std::memory_order_relaxed);
+  TraceEvent* e = &ring[head & (size - 1)];
+  e->timeUs = micros();
+  e->type = type;
+  e->arg = arg;
+  e->reserved = 0;
+  e->value = value;
+  ringHead->store(head + 1, std::memory_order_release);
+}
+
+void traceEvent(uint8_t type, uint8_t arg, int32_t value) {
+  traceRecord(traceRing, TRACE_EVENTS, &traceHead, type, arg, value);
+}
+
+void traceKey(int event) {
+  traceRecord(traceKeyRing, TRACE_KEY_EVENTS, &traceKeyHead, TRACE_KEY, 0, event);
+}
+
+void traceDumpRing(const char* magic, const TraceEvent* ring, uint32_t size, const std::atomic<uint32_t>* ringHead) {
+  uint32_t head = ringHead->load(std::memory_order_acquire);
+  uint32_t first = head > size ? head - size : 0;
+  // Sending takes long enough for the recording task to wrap around, so check every event
+  // after copying it. Overwritten ones are still sent to keep the count in the header.
+  TraceEvent events[32];
+  int n = 0;
+  TraceDumpHeader header = {{magic[0], magic[1], magic[2], magic[3]}, TRACE_DUMP_VERSION, sizeof(TraceEvent), 0, first, head - first};
+  Serial.write((const uint8_t*) &header, sizeof(header));
+  for (uint32_t i = first; i != head; i++) {
+    TraceEvent e = ring[i & (size - 1)];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (ringHead->load(std::memory_order_relaxed) - i >= size) {
+      e.type = 0; // overwritten while we were sending, tell the decoder to drop it
+    }
+    events[n++] = e;
+    if (n == 32 || i + 1 == head) {
+      Serial.write((const uint8_t*) events, n * sizeof(TraceEvent));
+      n = 0;
+    }
+  }
+}
+
+void traceDump() {
+  traceDumpRing("H4TR", traceRing, TRACE_EVENTS, &traceHead);
+  traceDumpRing("H4KY", traceKeyRing, TRACE_KEY_EVENTS, &traceKeyHead);
+}
@@ -19,20 +19,9 @@
 #define ESTOP_ON_OFF 4
 int emergencyStop = 0;
 bool beepFlag = false; // allows time-critical code to ask for a beep on another core
-long savedDupr = 0; // dupr saved in Preferences
-long nextDupr = dupr; // dupr value that should be applied asap
-bool nextDuprFlag = false; // whether nextDupr requires attention
-SemaphoreHandle_t motionMutex; // controls blocks of code where variables affecting the motion loop() are changed
-int savedStarts = 0; // starts saved in Preferences
-int nextStarts = starts; // number of starts that should be used asap
-bool nextStartsFlag = false; // whether nextStarts requires attention
+bool maxRpmExceeded = false; // Feed held because the spindle went faster than the axis could follow, see checkMaxRpm()
+bool savedStateReset = false; // Saved positions couldn't be loaded and were reset, shown until a key is pressed
 unsigned long saveTime = 0; // micros() of the previous Prefs write
-int savedMeasure = MEASURE_METRIC; // measure value saved in Preferences
-float savedConeRatio = 0; // value of coneRatio saved in Preferences
-float nextConeRatio = 0; // coneRatio that should be applied asap
-bool nextConeRatioFlag = false; // whether nextConeRatio requires attention
-int savedTurnPasses = 0; // value of turnPasses saved in Preferences
-bool savedAuxForward = false; // value of auxForward saved in Preferences
 long opSubIndex = 0; // Sub-index of an automation operation
 int opDuprSign = 1; // 1 if dupr was positive when operation started, -1 if negative
 long opDupr = 0; // dupr that the multi-pass operation started with
@@ -43,13 +32,15 @@ bool gcodeInBrace = false;
 bool gcodeInSemicolon = false;
 bool timerAttached = false;
 
-String gcodeCommand = "";
+char gcodeCommand[GCODE_COMMAND_MAX + 1] = "";
+int gcodeCommandLength = 0;
 bool auxForward = true; // True for external, false for external thread
 int starts = 1; // number of starts in a multi-start thread
 long dupr = 0; // pitch, tenth of a micron per rotation
 float coneRatio = 1; // In cone mode, how much X moves for 1 step of Z
 int turnPasses = 3; // In turn mode, how many turn passes to make
 long opIndex = 0; // Index of an automation operation
+long resumeOpIndex = 0; // Pass to continue a stopped operation from, 0 to start over
 long moveStep = 0; // thousandth of a mm
 int measure = MEASURE_METRIC; // Whether to show distances in inches
 bool showAngle = false; // Whether to show 0-359 spindle angle on screen
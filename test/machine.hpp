@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "native.hpp"
+#include "config.hpp"
+#include "pcb.hpp"
+#include "vars.hpp"
+#include "axis.hpp"
+#include "modes.hpp"
+#include "motion.hpp"
+#include "spindle.hpp"
+#include "encoder.hpp"
+#include "preferences.hpp"
+#include "plant.hpp"
+
+// Shared by the native tests (pio test -e test): boots the firmware logic like setup() does
+// but without its tasks, and runs the motion core cycle by cycle in virtual time on the
+// test's own thread against the plant models of sim/plant.hpp.
+
+inline const SpindleProfile* machineSpindle = NULL; // turns the spindle during cycles if set
+inline SpindleProfile machineProfile; // the one machineSpindle points at, outlives the test
+
+// Empties machineProfile and turns the spindle with it from the next cycle.
+inline SpindleProfile* newMachineSpindle() {
+  machineProfile = {};
+  machineSpindle = &machineProfile;
+  return &machineProfile;
+}
+
+// One motion cycle. Also run while firmware code waits for the motion task, see
+// nativeVirtualWaitHook, so that e.g. savePreferences() can be called from a test.
+inline void machineCycle() {
+  if (machineSpindle != NULL) plantAdvance(machineSpindle, MOTION_CYCLE_US);
+  nativeAdvanceMicros(MOTION_CYCLE_US);
+  recordMotionCycle(micros());
+  // Waits in the cycle, e.g. the direction setup delay, busy-wait on the lathe. They have
+  // to jump the clock rather than run another cycle in the middle of this one.
+  void (*waitHook)() = nativeVirtualWaitHook;
+  nativeVirtualWaitHook = NULL;
+  motionCycle();
+  nativeVirtualWaitHook = waitHook;
+}
+
+inline void runCycles(unsigned long cycles) {
+  for (unsigned long i = 0; i < cycles; i++) machineCycle();
+}
+
+inline void runSeconds(float seconds) {
+  runCycles(seconds * 1000000 / MOTION_CYCLE_US);
+}
+
+// Points the state partition at a new empty file, like a freshly erased one.
+inline void eraseMachineFlash() {
+  static char path[64];
+  if (path[0] != 0) unlink(path);
+  strcpy(path, "/tmp/h4-test-flash-XXXXXX");
+  close(mkstemp(path));
+  setenv("H4_NATIVE_FLASH", path, 1);
+}
+
+// Powers the machine up: fresh axes, saved state loaded from flash, off. Z can get a
+// different acceleration than the configured one.
+inline void bootMachine(long accelerationZ = ACCELERATION_Z) {
+  nativeUseVirtualTime();
+  nativeVirtualWaitHook = machineCycle;
+  machineSpindle = NULL;
+  emergencyStop = ESTOP_NONE;
+  initAxis(&z, NAME_Z, true, false, MOTOR_STEPS_Z, SCREW_Z_DU, SPEED_START_Z, SPEED_MANUAL_MOVE_Z, accelerationZ, INVERT_Z, NEEDS_REST_Z, MAX_TRAVEL_MM_Z, BACKLASH_DU_Z, Z_ENA, Z_DIR, Z_STEP);
+  initAxis(&x, NAME_X, true, false, MOTOR_STEPS_X, SCREW_X_DU, SPEED_START_X, SPEED_MANUAL_MOVE_X, ACCELERATION_X, INVERT_X, NEEDS_REST_X, MAX_TRAVEL_MM_X, BACKLASH_DU_X, X_ENA, X_DIR, X_STEP);
+  initAxis(&a1, NAME_A1, ACTIVE_A1, ROTARY_A1, MOTOR_STEPS_A1, SCREW_A1_DU, SPEED_START_A1, SPEED_MANUAL_MOVE_A1, ACCELERATION_A1, INVERT_A1, NEEDS_REST_A1, MAX_TRAVEL_MM_A1, BACKLASH_DU_A1, A11, A12, A13);
+  plantSetup(BACKLASH_DU_Z, BACKLASH_DU_X);
+  setPreferences();
+  isOn = false;
+  encoderSetup();
+  publishMotionSnapshot();
+}
+
+// Applies a setting the way the keypad would, without the queue.
+inline void machineCommand(int type, Axis* a, long value, float ratio = 0) {
+  MotionCommand command = {type, a, value, 0, ratio};
+  applyMotionCommand(command);
+}
+
+inline long duToSteps(Axis* a, long du) {
+  return du * a->motorSteps / a->screwPitch;
+}
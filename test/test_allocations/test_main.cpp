@@ -0,0 +1,68 @@
+#include <unity.h>
+#include "alloc.hpp"
+#include "display.hpp"
+#include "gcode.hpp"
+#include "../machine.hpp"
+
+// Nothing that runs over and over during a job may allocate, or the heap fragments over
+// hours of cutting. Built with ALLOC_COUNTER (pio test -e test is), every malloc is counted.
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+  lcdSetup();
+}
+
+void tearDown() {
+}
+
+// A second of motion with the screen updated every millisecond and the state saved.
+void runWithDisplay() {
+  for (int i = 0; i < 1000; i++) {
+    runCycles(1000 / MOTION_CYCLE_US);
+    updateDisplay();
+  }
+  savePreferences();
+}
+
+void test_gearbox_job_does_not_allocate() {
+  TEST_ASSERT_TRUE(getAllocationCount() >= 0);
+  showTacho = true;
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_NORMAL);
+  machineCommand(MOTION_CMD_DUPR, NULL, 10000);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, 0);
+  addSpindleProfilePoint(profile, 1, 200);
+  addSpindleProfilePoint(profile, 3, 200);
+  addSpindleProfilePoint(profile, 4, 0);
+  runWithDisplay(); // anything allocated once, e.g. output buffers, is allocated by now
+
+  long before = getAllocationCount();
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  for (int i = 0; i < 4; i++) runWithDisplay();
+  machineCommand(MOTION_CMD_IS_ON, NULL, false);
+  runWithDisplay();
+  TEST_ASSERT_EQUAL(0, getAllocationCount() - before);
+}
+
+void test_gcode_job_does_not_allocate() {
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_GCODE);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  const char* program[] = {"G21", "G91", "N10 G1 Z1 F200", "N20 G1 X-0.5", "N30 G1 Z-1 X0.5", "G90", "G0 Z0 X0", "M0"};
+  for (const char* line : program) handleGcodeCommand(line);
+  runWithDisplay();
+
+  long before = getAllocationCount();
+  for (int pass = 0; pass < 3; pass++) {
+    for (const char* line : program) TEST_ASSERT_TRUE(handleGcodeCommand(line));
+    runWithDisplay();
+  }
+  TEST_ASSERT_EQUAL(0, getAllocationCount() - before);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_gearbox_job_does_not_allocate);
+  RUN_TEST(test_gcode_job_does_not_allocate);
+  return UNITY_END();
+}
@@ -0,0 +1,76 @@
+#include <unity.h>
+#include "display.hpp"
+#include "lcd.hpp"
+#include "../machine.hpp"
+
+// The screen only gets the characters that changed since the last frame. Bytes on the bus
+// per frame are compared to rewriting every changed line in full, which is what the display
+// code did before.
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+  lcdSetup();
+}
+
+void tearDown() {
+}
+
+// Renders and flushes frames for the given time, one updateDisplay() per millisecond like taskDisplay
+// gets to. Returns bus writes and whole-line writes per frame.
+void displayTraffic(float seconds, float* busPerFrame, float* linePerFrame) {
+  unsigned long frames = lcdFrames, bus = lcdBusWrites, line = lcdLineWrites;
+  unsigned long cyclesPerCall = 1000 / MOTION_CYCLE_US;
+  for (unsigned long i = 0; i < seconds * 1000; i++) {
+    runCycles(cyclesPerCall);
+    updateDisplay();
+  }
+  frames = max(lcdFrames - frames, 1UL);
+  *busPerFrame = float(lcdBusWrites - bus) / frames;
+  *linePerFrame = float(lcdLineWrites - line) / frames;
+}
+
+void assertScreenShowsFrame() {
+  for (int row = 0; row < LCD_ROWS; row++) {
+    TEST_ASSERT_EQUAL_STRING(std::string(lcd.cells[row], LCD_COLS).c_str(), nativeLcdRow(row).c_str());
+  }
+}
+
+void test_unchanged_screen_sends_nothing() {
+  float bus, line;
+  displayTraffic(1, &bus, &line); // first frame and the ones right after it
+  displayTraffic(1, &bus, &line);
+  TEST_ASSERT_TRUE(bus == 0);
+  TEST_ASSERT_TRUE(line == 0);
+  assertScreenShowsFrame();
+}
+
+// Spindle at 300 RPM with the tacho shown, Z following at 1mm per revolution: the position
+// and RPM digits change.
+void test_running_sends_a_fraction_of_the_lines() {
+  float bus, line;
+  displayTraffic(1, &bus, &line);
+  showTacho = true;
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_NORMAL);
+  machineCommand(MOTION_CMD_DUPR, NULL, 10000);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, 0);
+  addSpindleProfilePoint(profile, 1, 300);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  displayTraffic(3, &bus, &line);
+  char message[80];
+  snprintf(message, sizeof(message), "bus writes per frame: %.2f, %.2f rewriting changed lines", bus, line);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(line > 0);
+  TEST_ASSERT_TRUE(bus * 3 < line);
+  machineCommand(MOTION_CMD_IS_ON, NULL, false);
+  displayTraffic(0.1, &bus, &line);
+  assertScreenShowsFrame();
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_unchanged_screen_sends_nothing);
+  RUN_TEST(test_running_sends_a_fraction_of_the_lines);
+  return UNITY_END();
+}
@@ -0,0 +1,106 @@
+#include <unity.h>
+#include "../machine.hpp"
+
+// Following the spindle, an axis steps at the spindle's rate once it got there, but it
+// gets there with its own acceleration. Open-loop steppers stall when asked to start
+// at full speed.
+
+const long DUPR = 10000; // 1mm per revolution
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_NORMAL);
+  machineCommand(MOTION_CMD_DUPR, NULL, DUPR);
+}
+
+void tearDown() {
+}
+
+float stepsPerSecond(Axis* a, float rpm) {
+  return rpm / 60 * DUPR * a->motorSteps / a->screwPitch;
+}
+
+void test_axis_accelerates_into_running_spindle() {
+  float rpm = 0.95 * getMaxRpm(DUPR, 1);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, rpm);
+  runSeconds(1); // spindle velocity estimate settles while off
+  TEST_ASSERT_TRUE(stepsPerSecond(&z, rpm) > 2 * SPEED_START_Z);
+
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  unsigned long startUs = micros();
+  long maxSpeed = 0;
+  for (int i = 0; i < 50000; i++) {
+    machineCycle();
+    float seconds = (micros() - startUs) / 1000000.0;
+    // The first step from rest accelerates as if it came after a step at speedStart.
+    TEST_ASSERT_TRUE(z.speed <= SPEED_START_Z + ACCELERATION_Z * (seconds + 1.0 / SPEED_START_Z));
+    if (z.speed > maxSpeed) maxSpeed = z.speed;
+  }
+  // Caught up with the spindle after the ramp and kept up.
+  TEST_ASSERT_TRUE(maxSpeed >= stepsPerSecond(&z, rpm));
+  TEST_ASSERT_TRUE(maxSpeed <= z.speedManualMove);
+  TEST_ASSERT_TRUE(abs(z.pendingPos) <= 2);
+}
+
+// Spindle standing for 1s, speeding up over 1s to RPM, then steady for 1s. Counted once the tool moves,
+// before that the axis takes up backlash.
+void followingError(float rpm, long* rampMax, long* steadyMax) {
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 1, 0);
+  addSpindleProfilePoint(profile, 2, rpm);
+  runSeconds(1); // velocity estimate left from a previous test drops to 0
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  *rampMax = *steadyMax = 0;
+  unsigned long cycles = 1000000 / MOTION_CYCLE_US;
+  for (unsigned long i = 0; i < 2 * cycles; i++) {
+    machineCycle();
+    if (z.pos == 0) continue;
+    long* m = i < cycles ? rampMax : steadyMax;
+    if (abs(z.pendingPos) > *m) *m = abs(z.pendingPos);
+  }
+}
+
+void test_following_error_vs_rpm() {
+  const float loads[] = {0.25, 0.5, 0.95};
+  for (float load : loads) {
+    setUp();
+    float rpm = load * getMaxRpm(DUPR, 1);
+    long rampMax, steadyMax;
+    followingError(rpm, &rampMax, &steadyMax);
+    char message[64];
+    snprintf(message, sizeof(message), "%.0f RPM: %ld steps ramping, %ld steady", rpm, rampMax, steadyMax);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(rampMax <= 2);
+    TEST_ASSERT_TRUE(steadyMax <= 2);
+  }
+}
+
+// A heavy carriage set to accelerate slower than an idle axis slows down, which is 1 step/s
+// per cycle: without the spindle's rate as a floor the speed drops between steps faster than
+// the steps bring it back, and the axis falls behind the spindle ramping up.
+void test_feed_forward_keeps_slow_axis_up() {
+  const long acceleration = ACCELERATION_Z / 10;
+  TEST_ASSERT_TRUE(acceleration < 1000000 / MOTION_CYCLE_US);
+  eraseMachineFlash();
+  bootMachine(acceleration);
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_NORMAL);
+  machineCommand(MOTION_CMD_DUPR, NULL, DUPR);
+  long rampMax, steadyMax;
+  followingError(0.95 * getMaxRpm(DUPR, 1), &rampMax, &steadyMax);
+  char message[64];
+  snprintf(message, sizeof(message), "%ld steps/s^2: %ld steps ramping, %ld steady", acceleration, rampMax, steadyMax);
+  TEST_MESSAGE(message);
+  // 15 steps ramping and 17 steady without the floor.
+  TEST_ASSERT_TRUE(rampMax <= 2);
+  TEST_ASSERT_TRUE(steadyMax <= 2);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_axis_accelerates_into_running_spindle);
+  RUN_TEST(test_following_error_vs_rpm);
+  RUN_TEST(test_feed_forward_keeps_slow_axis_up);
+  return UNITY_END();
+}
@@ -0,0 +1,80 @@
+#include <unity.h>
+#include "../machine.hpp"
+
+// Encoder index pulse, built in with env:test_index where the plant spindle pulses ENC_Z
+// once per revolution. The first pulse after boot lines spindlePosGlobal up with it.
+// Passes of a thread that is already being cut sync to spindlePosGlobal, so all of them
+// have to start at the same spindle angle also when the first pulse comes mid-thread.
+
+#if ENC_Z < 0
+#error "build with -D ENC_Z=<pin>, see env:test_index"
+#endif
+
+const long DUPR = 2500;
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+}
+
+void tearDown() {
+}
+
+// Where the spindle really is, in encoder steps from the index.
+long spindleAngle() {
+  return lround((spindleRevs - floor(spindleRevs)) * ENCODER_STEPS_FLOAT) % ENCODER_STEPS_INT;
+}
+
+void test_passes_keep_phase_when_spindle_starts_after_on() {
+  const int passes = 4;
+  // Saved phase from before a power loss, the spindle was turned by hand since.
+  spindlePosGlobal = ENCODER_STEPS_INT / 3;
+  float rpm = 0.5 * getMaxRpm(DUPR, 1);
+  turnPasses = passes;
+  z.leftStop = duToSteps(&z, 20000);
+  z.rightStop = 0;
+  x.leftStop = duToSteps(&x, 5000);
+  x.rightStop = 0;
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_TURN);
+  machineCommand(MOTION_CMD_DUPR, NULL, DUPR);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  // Spindle only started once the operation is on and waiting for the first pass sync.
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0.5, 0);
+  addSpindleProfilePoint(profile, 1, rpm);
+
+  long angles[passes];
+  int started = 0;
+  long previousSubIndex = opSubIndex;
+  for (long i = 0; i < 30000000 && isOn; i++) {
+    machineCycle();
+    if (previousSubIndex == 1 && opSubIndex == 2 && started < passes) {
+      angles[started] = spindleAngle();
+      char message[64];
+      snprintf(message, sizeof(message), "pass %ld starts at %ld of %d", opIndex, angles[started], ENCODER_STEPS_INT);
+      TEST_MESSAGE(message);
+      started++;
+    }
+    previousSubIndex = opSubIndex;
+  }
+  TEST_ASSERT_FALSE(isOn);
+  TEST_ASSERT_EQUAL(passes, started);
+  // Same groove: within the counts the spindle makes per cycle.
+  long tolerance = ceil(rpm / 60 * ENCODER_STEPS_FLOAT * MOTION_CYCLE_US / 1000000) + 1;
+  for (int p = 1; p < passes; p++) {
+    long diff = abs(angles[p] - angles[0]);
+    TEST_ASSERT_TRUE(min(diff, ENCODER_STEPS_INT - diff) <= tolerance);
+  }
+
+  // Off, the next pulse lines the phase up with the index.
+  runSeconds(0.5);
+  TEST_ASSERT_TRUE(spindleIndexed);
+  long diff = abs(spindlePosGlobal - spindleAngle());
+  TEST_ASSERT_TRUE(min(diff, ENCODER_STEPS_INT - diff) <= tolerance);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_passes_keep_phase_when_spindle_starts_after_on);
+  return UNITY_END();
+}
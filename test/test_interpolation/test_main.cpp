@@ -0,0 +1,90 @@
+#include <unity.h>
+#include "../machine.hpp"
+
+// Axes following the spindle move on the interpolated spindle position, not only when
+// an encoder count comes in, and stay exact however far the spindle has turned.
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+}
+
+void tearDown() {
+}
+
+long referencePos(Axis* a, long s, float fraction) {
+  return (s + double(fraction)) * a->motorSteps / a->screwPitch / ENCODER_STEPS_INT * dupr * starts;
+}
+
+void test_position_exact_past_float_precision() {
+  dupr = 15000;
+  starts = 3;
+  const long counts[] = {1 << 24, (1 << 24) + 1, (1 << 26) + 3, (1L << 30) + 7, -(1 << 25) - 5, 12345};
+  const float fractions[] = {0, 0.5, 0.99, -0.5};
+  for (long s : counts) {
+    for (float f : fractions) {
+      char message[64];
+      snprintf(message, sizeof(message), "s=%ld fraction=%.2f", s, f);
+      TEST_ASSERT_EQUAL_MESSAGE(referencePos(&z, s, f), posFromSpindle(&z, s, f, false), message);
+    }
+  }
+}
+
+struct Intervals {
+  long last;
+  unsigned long lastUs;
+  unsigned long count;
+  double sum, sumSquares;
+};
+
+void addInterval(Intervals* i, long pos, unsigned long us) {
+  if (pos == i->last) return;
+  if (i->lastUs != 0) {
+    double interval = us - i->lastUs;
+    i->count++;
+    i->sum += interval;
+    i->sumSquares += interval * interval;
+  }
+  i->last = pos;
+  i->lastUs = us;
+}
+
+// Coefficient of variation of the time between steps, 0 for perfectly even steps.
+double variation(const Intervals* i) {
+  double mean = i->sum / i->count;
+  return sqrt(i->sumSquares / i->count - mean * mean) / mean;
+}
+
+// Spindle at a steady 30 RPM, 3mm per revolution: a step about every 2 encoder counts.
+void test_steps_even_with_interpolation() {
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_NORMAL);
+  machineCommand(MOTION_CMD_DUPR, NULL, 30000);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, 30);
+  runSeconds(1);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  runSeconds(1);
+
+  Intervals with = {}, without = {}, carriage = {};
+  for (int i = 0; i < 200000; i++) {
+    machineCycle();
+    unsigned long us = micros();
+    addInterval(&with, posFromSpindle(&z, spindlePosAvg, spindlePosFraction, false), us);
+    addInterval(&without, posFromSpindle(&z, spindlePosAvg, 0, false), us);
+    addInterval(&carriage, carriageZ.motorPos, us);
+  }
+  char message[96];
+  snprintf(message, sizeof(message), "step interval variation: %.3f with, %.3f without interpolation, %.3f carriage",
+      variation(&with), variation(&without), variation(&carriage));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(carriage.count > 1000);
+  TEST_ASSERT_TRUE(variation(&with) * 5 < variation(&without));
+  TEST_ASSERT_TRUE(variation(&carriage) * 5 < variation(&without));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_position_exact_past_float_precision);
+  RUN_TEST(test_steps_even_with_interpolation);
+  return UNITY_END();
+}
@@ -0,0 +1,66 @@
+#include <unity.h>
+#include <atomic>
+#include "keypad.hpp"
+#include "trace.hpp"
+#include "../machine.hpp"
+
+// The keypad task wakes on the TCA8418 interrupt and drains the chip's FIFO in one burst.
+// The FIFO holds 10 events, a burst of more has to come out whole and in order, and with
+// nothing queued a wake-up only reads the FIFO count.
+
+extern TraceEvent traceKeyRing[TRACE_KEY_EVENTS];
+extern std::atomic<uint32_t> traceKeyHead;
+
+// Digit keys as in src/keypad.cpp.
+#define B_1 41
+#define B_2 61
+#define B_3 31
+#define B_4 2
+#define B_5 21
+#define B_6 12
+#define B_7 11
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+}
+
+void tearDown() {
+}
+
+void test_burst_longer_than_fifo_drained_in_order() {
+  const uint8_t digits[] = {B_1, B_2, B_3, B_4, B_5, B_6, B_7};
+  uint32_t firstKey = traceKeyHead.load();
+  for (uint8_t key : digits) {
+    nativeKeypadEvent(key | 0x80);
+    nativeKeypadEvent(key);
+  }
+  unsigned long transactions = nativeKeypadTransactions;
+  processKeypadEvents();
+  transactions = nativeKeypadTransactions - transactions;
+
+  TEST_ASSERT_FALSE(keypadAvailable());
+  TEST_ASSERT_EQUAL(1234567, getNumpadResult());
+  TEST_ASSERT_EQUAL(2 * sizeof(digits), traceKeyHead.load() - firstKey);
+  for (size_t i = 0; i < 2 * sizeof(digits); i++) {
+    int expected = digits[i / 2] | (i % 2 == 0 ? 0x80 : 0);
+    TEST_ASSERT_EQUAL(expected, traceKeyRing[(firstKey + i) & (TRACE_KEY_EVENTS - 1)].value);
+  }
+  // One read per event, plus the FIFO count before the first 10, the remaining 4 and the empty
+  // FIFO, plus releasing INT# if there is one.
+  TEST_ASSERT_EQUAL(2 * sizeof(digits) + 3 + (KEY_INT >= 0 ? 1 : 0), transactions);
+}
+
+void test_idle_wake_up_only_reads_fifo_count() {
+  unsigned long transactions = nativeKeypadTransactions;
+  processKeypadEvents();
+  // The FIFO count, plus releasing INT# if there is one.
+  TEST_ASSERT_EQUAL(KEY_INT >= 0 ? 2 : 1, nativeKeypadTransactions - transactions);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_longer_than_fifo_drained_in_order);
+  RUN_TEST(test_idle_wake_up_only_reads_fifo_count);
+  return UNITY_END();
+}
@@ -0,0 +1,111 @@
+#include <unity.h>
+#include "../machine.hpp"
+
+// Below getMaxRpm() an axis started into a turning spindle catches up within
+// FOLLOW_CATCH_UP_TURNS without stepping faster than speedManualMove. Above it the feed
+// is held and continues in the same groove once the spindle slows down.
+
+const long DUPR = 10000;
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_NORMAL);
+  machineCommand(MOTION_CMD_DUPR, NULL, DUPR);
+}
+
+void tearDown() {
+}
+
+// Tool position minus where the true spindle angle puts it, modulo the pitch, in steps.
+float leadErrorSteps() {
+  float error = carriageZ.pos - spindleRevs * DUPR * z.motorSteps / z.screwPitch;
+  float pitch = DUPR * z.motorSteps / z.screwPitch;
+  return error - round(error / pitch) * pitch;
+}
+
+void test_model_at_increasing_rpm() {
+  long maxRpm = getMaxRpm(DUPR, 1);
+  TEST_ASSERT_TRUE(maxRpm > 0);
+  const float loads[] = {0.3, 0.6, 0.85, 0.99, 1.1};
+  for (float load : loads) {
+    setUp();
+    float rpm = maxRpm * load;
+    SpindleProfile* profile = newMachineSpindle();
+    addSpindleProfilePoint(profile, 0, rpm);
+    runSeconds(1);
+    machineCommand(MOTION_CMD_IS_ON, NULL, true);
+    float catchUpSeconds = FOLLOW_CATCH_UP_TURNS * 60 / rpm;
+    long fastest = 0, behind = 0;
+    bool held = false;
+    for (float t = 0; t < catchUpSeconds + 1; t += MOTION_CYCLE_US / 1000000.0) {
+      machineCycle();
+      fastest = max(fastest, z.speed);
+      held = held || maxRpmExceeded;
+      if (t > catchUpSeconds * 1.05) behind = max(behind, long(abs(z.pendingPos)));
+    }
+    char message[96];
+    snprintf(message, sizeof(message), "%.0f RPM (%.0f%% of max): fastest %ld steps/s, %ld steps behind after catching up%s",
+        rpm, load * 100, fastest, behind, held ? ", held" : "");
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(isOn);
+    TEST_ASSERT_TRUE(fastest <= z.speedManualMove);
+    if (load < 1) {
+      TEST_ASSERT_FALSE(held);
+      TEST_ASSERT_TRUE(behind <= 2);
+    } else {
+      TEST_ASSERT_TRUE(held);
+    }
+  }
+}
+
+void test_held_feed_continues_in_the_same_groove() {
+  long maxRpm = getMaxRpm(DUPR, 1);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, 0.5 * maxRpm);
+  addSpindleProfilePoint(profile, 3, 0.5 * maxRpm);
+  addSpindleProfilePoint(profile, 3.5, 1.2 * maxRpm);
+  addSpindleProfilePoint(profile, 5, 1.2 * maxRpm);
+  addSpindleProfilePoint(profile, 5.5, 0.5 * maxRpm);
+  runSeconds(1);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  runSeconds(1.5);
+  float before = leadErrorSteps();
+  bool held = false;
+  for (int i = 0; i < 300000; i++) {
+    machineCycle();
+    held = held || maxRpmExceeded;
+  }
+  TEST_ASSERT_TRUE(held);
+  TEST_ASSERT_FALSE(maxRpmExceeded);
+  TEST_ASSERT_TRUE(isOn);
+  float after = leadErrorSteps();
+  char message[64];
+  snprintf(message, sizeof(message), "lead error %.1f steps before hold, %.1f after", before, after);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(fabs(after - before) <= 2);
+}
+
+void test_cone_and_ellipse_limited_by_x() {
+  long gearbox = getMaxRpm(DUPR, 1);
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_CONE);
+  machineCommand(MOTION_CMD_CONE_RATIO, NULL, 0, 0.5);
+  TEST_ASSERT_EQUAL(gearbox, getMaxRpm(DUPR, 1)); // X moves a quarter of Z
+  machineCommand(MOTION_CMD_CONE_RATIO, NULL, 0, 8);
+  TEST_ASSERT_TRUE(getMaxRpm(DUPR, 1) < gearbox / 2); // X moves 4 times as far as Z
+
+  z.leftStop = duToSteps(&z, 10000);
+  z.rightStop = 0;
+  x.leftStop = duToSteps(&x, 30000);
+  x.rightStop = 0;
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_ELLIPSE);
+  TEST_ASSERT_TRUE(getMaxRpm(DUPR, 1) < gearbox / HALF_PI / 2);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_model_at_increasing_rpm);
+  RUN_TEST(test_held_feed_continues_in_the_same_groove);
+  RUN_TEST(test_cone_and_ellipse_limited_by_x);
+  return UNITY_END();
+}
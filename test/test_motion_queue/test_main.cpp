@@ -0,0 +1,71 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "motion.hpp"
+#include "trace.hpp"
+
+// Settings from the keypad, G-code and display tasks go through one queue that the motion
+// task drains. With several producers on real threads and a small queue that keeps filling
+// up, every command has to come out exactly once, whole, and in the order its producer
+// posted it. Applied commands are read back from the trace, applyMotionCommand() records
+// each one.
+
+extern TraceEvent traceRing[TRACE_EVENTS];
+extern std::atomic<uint32_t> traceHead;
+extern std::atomic<unsigned long> motionQueueHead;
+extern std::atomic<unsigned long> motionQueueTail;
+
+const int PRODUCERS = 4;
+const long COMMANDS = 400; // per producer, all of them fit the trace ring
+const long PRODUCER_SHIFT = 1000000;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void produce(int producer) {
+  for (long i = 0; i < COMMANDS; i++) {
+    // Resetting the profiler doesn't look at the value, it only goes into the trace.
+    postMotionSetting(MOTION_CMD_RESET_PROFILE, NULL, producer * PRODUCER_SHIFT + i, 0);
+  }
+}
+
+void test_no_lost_or_reordered_commands_across_producers() {
+  static_assert(PRODUCERS * COMMANDS <= TRACE_EVENTS, "trace ring too small for the test");
+  unsigned long total = PRODUCERS * COMMANDS;
+  unsigned long mostQueued = 0;
+  std::thread motion([&]() {
+    while (motionQueueTail.load() < total) {
+      mostQueued = max(mostQueued, motionQueueHead.load() - motionQueueTail.load());
+      applyMotionCommands();
+    }
+  });
+  std::thread producers[PRODUCERS];
+  for (int p = 0; p < PRODUCERS; p++) producers[p] = std::thread(produce, p);
+  for (int p = 0; p < PRODUCERS; p++) producers[p].join();
+  motion.join();
+
+  TEST_ASSERT_EQUAL(total, traceHead.load());
+  long next[PRODUCERS] = {};
+  for (unsigned long i = 0; i < total; i++) {
+    TraceEvent* e = &traceRing[i];
+    TEST_ASSERT_EQUAL(TRACE_SETTING, e->type);
+    TEST_ASSERT_EQUAL(MOTION_CMD_RESET_PROFILE, e->arg);
+    long producer = e->value / PRODUCER_SHIFT;
+    TEST_ASSERT_TRUE(producer >= 0 && producer < PRODUCERS);
+    TEST_ASSERT_EQUAL(next[producer], e->value % PRODUCER_SHIFT);
+    next[producer]++;
+  }
+  for (int p = 0; p < PRODUCERS; p++) TEST_ASSERT_EQUAL(COMMANDS, next[p]);
+  char message[64];
+  snprintf(message, sizeof(message), "%lu commands, up to %lu of %d queued at once", total, mostQueued, MOTION_QUEUE_SIZE);
+  TEST_MESSAGE(message);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_lost_or_reordered_commands_across_producers);
+  return UNITY_END();
+}
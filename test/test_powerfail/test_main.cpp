@@ -0,0 +1,107 @@
+#include <unity.h>
+#include "powerfail.hpp"
+#include "journal.hpp"
+#include "tasks.hpp"
+#include "../machine.hpp"
+
+// While cutting, positions are only saved when the supply goes down. A brownout in the
+// middle of a pass has to leave the journal with where the axes stopped, and the next
+// boot has to come back to exactly that with the pass offered for resuming. Saving takes
+// a single slot write, even when that fills up a sector.
+
+extern TaskHandle_t powerFailTaskHandle;
+extern bool powerFailTriggered;
+void taskPowerFail(void* param);
+
+bool restarted = false;
+
+void onRestart() {
+  restarted = true;
+}
+
+void setUp() {
+  eraseMachineFlash();
+  nativeRestartHook = onRestart;
+  restarted = false;
+}
+
+void tearDown() {
+}
+
+// Like a partition that held something else: every sector has to be erased before use.
+void fillMachineFlash() {
+  static uint8_t zeros[0x10000]; // see partitions.csv
+  FILE* f = fopen(getenv("H4_NATIVE_FLASH"), "wb");
+  fwrite(zeros, 1, sizeof(zeros), f);
+  fclose(f);
+}
+
+void test_brownout_mid_pass_saves_positions_and_reboots_from_them() {
+  fillMachineFlash();
+  bootMachine();
+  turnPasses = 3;
+  z.leftStop = duToSteps(&z, 200000);
+  z.rightStop = 0;
+  x.leftStop = duToSteps(&x, 10000);
+  x.rightStop = 0;
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_TURN);
+  machineCommand(MOTION_CMD_DUPR, NULL, 15000);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, 300);
+
+  // Well into the cut of the second pass.
+  long zStart = 0;
+  for (long i = 0; i < 30000000 && !(opIndex == 2 && opSubIndex == 2 && z.pos - zStart > 1000); i++) {
+    if (opSubIndex != 2) zStart = z.pos;
+    machineCycle();
+  }
+  TEST_ASSERT_EQUAL(2, opIndex);
+  TEST_ASSERT_EQUAL(2, opSubIndex);
+  // Boot erased the first sector, the power fail save goes to its last slot. The next sector
+  // isn't erased yet.
+  const int SLOTS_PER_SECTOR = JOURNAL_SECTOR_SIZE / JOURNAL_SLOT_SIZE;
+  while (getJournalStats().saves % SLOTS_PER_SECTOR != SLOTS_PER_SECTOR - 1) {
+    markSavedDirty(SAVED_DUPR);
+    TEST_ASSERT_TRUE(savePreferences());
+  }
+
+  powerFailTaskHandle = xTaskGetCurrentTaskHandle();
+  nativeSetBrownout(true);
+  machineCycle();
+  TEST_ASSERT_EQUAL(ESTOP_POWER_FAIL, emergencyStop);
+  // The power fail task got woken up.
+  TEST_ASSERT_EQUAL(1, ulTaskNotifyTake(pdFALSE, 0));
+  xTaskNotifyGive(powerFailTaskHandle);
+
+  long zPos = z.pos, zMotorPos = z.motorPos, zPosGlobal = z.posGlobal, zOriginPos = z.originPos;
+  long xPos = x.pos, xMotorPos = x.motorPos;
+  long savedSpindlePosGlobal = spindlePosGlobal;
+  JournalStats journal = getJournalStats();
+  erasePreferencesAhead(); // the display task might try while the save waits
+  taskPowerFail(NULL); // runs on this thread, the notification is already there
+  TEST_ASSERT_TRUE(restarted);
+  TEST_ASSERT_EQUAL(journal.saves + 1, getJournalStats().saves);
+  TEST_ASSERT_EQUAL(journal.erases, getJournalStats().erases);
+
+  nativeSetBrownout(false);
+  powerFailTriggered = false;
+  z.pos = x.pos = 0; // nothing survives but the journal
+  bootMachine();
+  TEST_ASSERT_FALSE(savedStateReset);
+  TEST_ASSERT_EQUAL(zPos, z.pos);
+  TEST_ASSERT_EQUAL(zMotorPos, z.motorPos);
+  TEST_ASSERT_EQUAL(zPosGlobal, z.posGlobal);
+  TEST_ASSERT_EQUAL(zOriginPos, z.originPos);
+  TEST_ASSERT_EQUAL(xPos, x.pos);
+  TEST_ASSERT_EQUAL(xMotorPos, x.motorPos);
+  TEST_ASSERT_EQUAL(savedSpindlePosGlobal, spindlePosGlobal);
+  TEST_ASSERT_EQUAL(MODE_TURN, mode);
+  TEST_ASSERT_EQUAL(2, getResumableOpIndex());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_brownout_mid_pass_saves_positions_and_reboots_from_them);
+  return UNITY_END();
+}
@@ -0,0 +1,151 @@
+#include <unity.h>
+#include <Preferences.h>
+#include "journal.hpp"
+#include "../machine.hpp"
+
+// Saved state survives restarts and firmware upgrades: the old NVS state is carried over
+// once, anything that can't be read resets positions with a warning instead of restoring
+// stale ones, and saves never wait for a flash erase.
+
+// Any record that isn't the current SavedState.
+struct OtherRecord {
+  int32_t version;
+  int32_t values[8];
+};
+
+void setUp() {
+  eraseMachineFlash();
+  Preferences pref;
+  pref.begin("h4");
+  pref.clear();
+  pref.end();
+  savedStateReset = false;
+}
+
+void tearDown() {
+}
+
+void writeRecord(const void* data, int size) {
+  TEST_ASSERT_TRUE(journalSetup());
+  TEST_ASSERT_TRUE(journalAppend(data, size));
+}
+
+void test_saved_state_is_restored() {
+  bootMachine();
+  dupr = 15000;
+  starts = 2;
+  z.pos = 1234;
+  z.motorPos = 1300;
+  z.leftStop = 5000;
+  x.disabled = true;
+  spindlePosGlobal = 1000;
+  turnPasses = 5;
+  publishMotionSnapshot();
+  markSavedDirty(SAVED_DUPR);
+  TEST_ASSERT_TRUE(savePreferences());
+
+  z.pos = x.pos = 0; // nothing survives but the journal
+  bootMachine();
+  TEST_ASSERT_FALSE(savedStateReset);
+  TEST_ASSERT_EQUAL(15000, dupr);
+  TEST_ASSERT_EQUAL(2, starts);
+  TEST_ASSERT_EQUAL(1234, z.pos);
+  TEST_ASSERT_EQUAL(1300, z.motorPos);
+  TEST_ASSERT_EQUAL(5000, z.leftStop);
+  TEST_ASSERT_EQUAL(LONG_MIN, z.rightStop);
+  TEST_ASSERT_TRUE(x.disabled);
+  TEST_ASSERT_EQUAL(1000, spindlePosGlobal);
+  TEST_ASSERT_EQUAL(5, turnPasses);
+}
+
+void test_unreadable_record_resets_positions_once() {
+  OtherRecord s = {99}; // e.g. written by a newer firmware before a downgrade
+  writeRecord(&s, sizeof(s));
+  bootMachine();
+  TEST_ASSERT_TRUE(savedStateReset);
+  TEST_ASSERT_EQUAL(0, z.pos);
+  TEST_ASSERT_EQUAL(0, z.motorPos);
+  TEST_ASSERT_EQUAL(LONG_MAX, z.leftStop);
+  TEST_ASSERT_EQUAL(LONG_MIN, z.rightStop);
+
+  TEST_ASSERT_TRUE(savePreferences());
+  savedStateReset = false;
+  bootMachine();
+  TEST_ASSERT_FALSE(savedStateReset);
+}
+
+void test_size_not_matching_version_resets() {
+  OtherRecord s = {1};
+  writeRecord(&s, sizeof(s));
+  bootMachine();
+  TEST_ASSERT_TRUE(savedStateReset);
+  TEST_ASSERT_EQUAL(0, z.pos);
+}
+
+void test_nvs_is_carried_over_once_then_cleared() {
+  Preferences pref;
+  pref.begin("h4");
+  pref.putInt("v", 1);
+  pref.putLong("zp", 4321);
+  pref.putLong("zpm", 4400);
+  pref.putLong("zls", 9000);
+  pref.putLong("d", 2500);
+  pref.putLong("spg", 1000);
+  pref.end();
+
+  bootMachine();
+  TEST_ASSERT_FALSE(savedStateReset);
+  TEST_ASSERT_EQUAL(4321, z.pos);
+  TEST_ASSERT_EQUAL(9000, z.leftStop);
+  TEST_ASSERT_EQUAL(2500, dupr);
+  TEST_ASSERT_EQUAL(1000 * ENCODER_STEPS_INT / ENCODER_PPR, spindlePosGlobal);
+
+  TEST_ASSERT_TRUE(savePreferences());
+  pref.begin("h4");
+  TEST_ASSERT_EQUAL(0, pref.getLong("zp"));
+  pref.end();
+
+  bootMachine();
+  TEST_ASSERT_EQUAL(4321, z.pos);
+  TEST_ASSERT_EQUAL(9000, z.leftStop);
+}
+
+// Saves never erase. Without the erase-ahead they go on until they'd need a sector that
+// wasn't erased yet, then wait for it.
+void test_saves_only_write() {
+  const int SLOTS_PER_SECTOR = JOURNAL_SECTOR_SIZE / JOURNAL_SLOT_SIZE;
+  const int PARTITION_SLOTS = 0x10000 / JOURNAL_SLOT_SIZE; // see partitions.csv
+  bootMachine();
+  // Around the partition once so that every sector holds records, back at the first slot.
+  for (int i = 0; i < PARTITION_SLOTS; i++) {
+    erasePreferencesAhead();
+    unsigned long erases = getJournalStats().erases;
+    markSavedDirty(SAVED_DUPR);
+    TEST_ASSERT_TRUE(savePreferences());
+    TEST_ASSERT_EQUAL(erases, getJournalStats().erases);
+  }
+  TEST_ASSERT_TRUE(getJournalStats().erases > 0);
+
+  unsigned long erases = getJournalStats().erases;
+  int saves = 0;
+  for (; saves < 3 * SLOTS_PER_SECTOR; saves++) {
+    markSavedDirty(SAVED_DUPR);
+    if (!savePreferences()) break;
+  }
+  TEST_ASSERT_EQUAL(erases, getJournalStats().erases);
+  TEST_ASSERT_EQUAL(SLOTS_PER_SECTOR, saves);
+  TEST_ASSERT_TRUE(savedStateDirty.load() != 0); // kept for the next try
+
+  TEST_ASSERT_TRUE(erasePreferencesAhead());
+  TEST_ASSERT_TRUE(savePreferences());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_saved_state_is_restored);
+  RUN_TEST(test_unreadable_record_resets_positions_once);
+  RUN_TEST(test_size_not_matching_version_resets);
+  RUN_TEST(test_nvs_is_carried_over_once_then_cleared);
+  RUN_TEST(test_saves_only_write);
+  return UNITY_END();
+}
@@ -0,0 +1,56 @@
+#include <unity.h>
+#include "profiler.hpp"
+#include "../machine.hpp"
+
+// Profiler zones of the motion cycle, built in with env:test_profiler. Every zone on the
+// path of a gearbox cycle is recorded once per cycle, and its time comes from the host
+// clock since virtual time doesn't move while a cycle runs.
+
+#if !PROFILER
+#error "build with -D PROFILER=true, see env:test_profiler"
+#endif
+
+const unsigned long CYCLES = 20000;
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+}
+
+void tearDown() {
+}
+
+void test_gearbox_cycle_zones_have_counts_and_cycles() {
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_NORMAL);
+  machineCommand(MOTION_CMD_DUPR, NULL, 10000);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, 300);
+  machineCommand(MOTION_CMD_RESET_PROFILE, NULL, 0);
+  runCycles(CYCLES);
+
+  const int zones[] = {PROFILE_MOTION_CYCLE, PROFILE_MOTION_COMMANDS, PROFILE_SPINDLE_DELTA, PROFILE_MODE_GEARBOX, PROFILE_MOVE_AXIS, PROFILE_SNAPSHOT};
+  for (int zone : zones) {
+    unsigned long perCycle = zone == PROFILE_MOVE_AXIS ? (ACTIVE_A1 ? 3 : 2) : 1;
+    ProfileZoneStats stats = getProfileZoneStats(zone);
+    char message[96];
+    snprintf(message, sizeof(message), "%s: %lu times, %lu/%lu/%lu cycles", getProfileZoneName(zone), stats.count,
+        stats.minCycles, stats.avgCycles, stats.maxCycles);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(CYCLES * perCycle, stats.count);
+    TEST_ASSERT_TRUE(stats.maxCycles > 0);
+    TEST_ASSERT_TRUE(stats.minCycles <= stats.avgCycles && stats.avgCycles <= stats.maxCycles);
+  }
+  // The whole cycle includes all of the others.
+  ProfileZoneStats cycle = getProfileZoneStats(PROFILE_MOTION_CYCLE);
+  TEST_ASSERT_TRUE(cycle.avgCycles > 0);
+  TEST_ASSERT_TRUE(cycle.avgCycles >= getProfileZoneStats(PROFILE_MODE_GEARBOX).avgCycles);
+  // Not in a gearbox cycle.
+  TEST_ASSERT_EQUAL(0, getProfileZoneStats(PROFILE_MODE_TURN).count);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_gearbox_cycle_zones_have_counts_and_cycles);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+#include <unity.h>
+#include "motion.hpp"
+#include "spindle.hpp"
+
+// The spindle velocity estimator against synthetic encoder streams: counts at the exact
+// times a spindle at the given speed would make them, each one jittered, and seen by the
+// motion task at the start of the next cycle like on the lathe. Sample times are off by up
+// to MOTION_CYCLE_US, that's most of the error.
+
+const float JITTER_US = 3;
+
+unsigned long nowUs = 1000000;
+
+void setUp() {
+  srand(1);
+  // Long enough without counts for the estimator to forget the previous stream.
+  nowUs += 2 * SPINDLE_STOP_US;
+  updateSpindleVelocity(nowUs, 0);
+}
+
+void tearDown() {
+}
+
+float jitterUs() {
+  return (rand() / float(RAND_MAX) * 2 - 1) * JITTER_US;
+}
+
+struct Errors {
+  float rpmMax; // relative to the true RPM
+  float accelerationSum; // RPM/s
+  unsigned long samples;
+};
+
+// Spindle at startRpm speeding up by rpmPerSecond for the given time. Errors are taken every
+// cycle after the first settleSeconds.
+Errors runStream(float startRpm, float rpmPerSecond, float seconds, float settleSeconds) {
+  Errors errors = {};
+  float countsPerRpmSecond = ENCODER_STEPS_FLOAT / 60;
+  unsigned long startUs = nowUs;
+  long counted = 0;
+  float nextCountUs = NAN;
+  for (float t = 0; t < seconds; t += MOTION_CYCLE_US / 1000000.0) {
+    nowUs = startUs + lround(t * 1000000);
+    // Counts at fractional times: position is startRpm*t + rpmPerSecond*t^2/2 in revolutions.
+    long delta = 0;
+    for (;;) {
+      if (isnan(nextCountUs)) {
+        long next = counted + (startRpm + rpmPerSecond * t >= 0 ? 1 : -1);
+        float a = rpmPerSecond / 2 * countsPerRpmSecond, b = startRpm * countsPerRpmSecond, c = -next;
+        float root = a == 0 ? -c / b : (-b + (b > 0 ? 1 : -1) * sqrt(b * b - 4 * a * c)) / (2 * a);
+        nextCountUs = startUs + root * 1000000 + jitterUs();
+      }
+      if (nextCountUs > nowUs) break;
+      long step = startRpm >= 0 ? 1 : -1;
+      counted += step;
+      delta += step;
+      nextCountUs = NAN;
+    }
+    updateSpindleVelocity(nowUs, delta);
+    if (t < settleSeconds) continue;
+    float trueRpm = startRpm + rpmPerSecond * t;
+    errors.rpmMax = max(errors.rpmMax, float(fabs(getSpindleRpm() - trueRpm) / fabs(trueRpm)));
+    errors.accelerationSum += fabs(spindleAcceleration * 60 / ENCODER_STEPS_FLOAT - rpmPerSecond);
+    errors.samples++;
+  }
+  return errors;
+}
+
+void test_steady_speeds() {
+  const float rpms[] = {0.2, 10, 300, 3000, -300};
+  for (float rpm : rpms) {
+    setUp();
+    // Slow streams need a couple of counts before there's a fit.
+    Errors e = runStream(rpm, 0, 3, 1);
+    char message[64];
+    snprintf(message, sizeof(message), "%.1f RPM: error up to %.3f%%", rpm, e.rpmMax * 100);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(e.samples > 0);
+    TEST_ASSERT_TRUE(e.rpmMax < 0.01);
+  }
+}
+
+void test_speeding_up() {
+  Errors e = runStream(100, 1500, 1.9, 0.3);
+  float accelerationError = e.accelerationSum / e.samples;
+  char message[80];
+  snprintf(message, sizeof(message), "100 to 2950 RPM at 1500 RPM/s: error up to %.3f%%, acceleration off by %.0f RPM/s",
+      e.rpmMax * 100, accelerationError);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(e.rpmMax < 0.01);
+  TEST_ASSERT_TRUE(accelerationError < 150);
+}
+
+void test_stopping_spindle_reads_zero() {
+  runStream(30, 0, 1, 1);
+  TEST_ASSERT_TRUE(fabs(getSpindleRpm() - 30) < 0.1);
+  unsigned long stopUs = nowUs;
+  // Once a sample is due, the velocity can't be more than one count over the time since the last.
+  for (; nowUs - stopUs <= SPINDLE_STOP_US; nowUs += MOTION_CYCLE_US) {
+    updateSpindleVelocity(nowUs, 0);
+    if (nowUs - stopUs >= SPINDLE_SAMPLE_US) TEST_ASSERT_TRUE(spindleVelocity <= 1000000.0 / (nowUs - stopUs));
+  }
+  nowUs += MOTION_CYCLE_US;
+  updateSpindleVelocity(nowUs, 0);
+  TEST_ASSERT_TRUE(spindleVelocity == 0);
+  TEST_ASSERT_TRUE(spindleAcceleration == 0);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_speeds);
+  RUN_TEST(test_speeding_up);
+  RUN_TEST(test_stopping_spindle_reads_zero);
+  return UNITY_END();
+}
@@ -0,0 +1,59 @@
+#include <unity.h>
+#include "../machine.hpp"
+
+// Every thread pass waits for the spindle to come round to the phase of the first one. That
+// wait can't be longer than a revolution, also when the spindle moves several encoder counts
+// per motion cycle and jumps over the exact phase.
+
+const long DUPR = 2500;
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+}
+
+void tearDown() {
+}
+
+void test_sync_wait_per_pass_under_a_revolution() {
+  const int passes = 5;
+  float rpm = 0.9 * getMaxRpm(DUPR, 1);
+  float countsPerCycle = rpm / 60 * ENCODER_STEPS_FLOAT * MOTION_CYCLE_US / 1000000;
+  TEST_ASSERT_TRUE(countsPerCycle > 2);
+
+  turnPasses = passes;
+  z.leftStop = duToSteps(&z, 20000);
+  z.rightStop = 0;
+  x.leftStop = duToSteps(&x, 5000);
+  x.rightStop = 0;
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_TURN);
+  machineCommand(MOTION_CMD_DUPR, NULL, DUPR);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, rpm);
+  runSeconds(1);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+
+  unsigned long revolutionUs = 60000000 / rpm;
+  int synced = 0;
+  long previousSubIndex = opSubIndex;
+  for (long i = 0; i < 30000000 && isOn; i++) {
+    machineCycle();
+    if (previousSubIndex == 1 && opSubIndex == 2) {
+      synced++;
+      char message[64];
+      snprintf(message, sizeof(message), "pass %ld at %.0f RPM: waited %.1fms", opIndex, rpm, spindleSyncWaitUs / 1000.0);
+      TEST_MESSAGE(message);
+      TEST_ASSERT_TRUE(spindleSyncWaitUs <= revolutionUs + 2 * MOTION_CYCLE_US);
+    }
+    previousSubIndex = opSubIndex;
+  }
+  TEST_ASSERT_FALSE(isOn);
+  TEST_ASSERT_EQUAL(passes, synced);
+  TEST_ASSERT_TRUE(spindleSyncWaitMaxUs <= revolutionUs + 2 * MOTION_CYCLE_US);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_sync_wait_per_pass_under_a_revolution);
+  return UNITY_END();
+}
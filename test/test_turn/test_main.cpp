@@ -0,0 +1,66 @@
+#include <unity.h>
+#include "../machine.hpp"
+
+// Every pass of a thread has to land in the same groove. Below speedStart the axis needs
+// no acceleration, so whatever lead error there is comes from the pass start phase.
+
+const long DUPR = 15000;
+
+void setUp() {
+  eraseMachineFlash();
+  bootMachine();
+}
+
+void tearDown() {
+}
+
+// Carriage position minus where the true spindle angle puts it, modulo the pitch, relative
+// to the first sample. Largest error per pass in du.
+void turnLeadErrors(float rpm, int passes, double* errors) {
+  turnPasses = passes;
+  z.leftStop = duToSteps(&z, 50000);
+  z.rightStop = 0;
+  x.leftStop = duToSteps(&x, 10000);
+  x.rightStop = 0;
+  machineCommand(MOTION_CMD_MODE, NULL, MODE_TURN);
+  machineCommand(MOTION_CMD_DUPR, NULL, DUPR);
+  machineCommand(MOTION_CMD_IS_ON, NULL, true);
+  SpindleProfile* profile = newMachineSpindle();
+  addSpindleProfilePoint(profile, 0, 0);
+  addSpindleProfilePoint(profile, 1, rpm);
+
+  bool referenced = false;
+  double reference = 0;
+  for (int i = 0; i < passes; i++) errors[i] = 0;
+  for (long i = 0; i < 60000000 && isOn; i++) {
+    machineCycle();
+    if (opIndex < 1 || opIndex > passes || opSubIndex != 2) continue;
+    double error = carriageDu(&carriageZ) - spindleRevs * dupr * starts;
+    if (!referenced) reference = error;
+    referenced = true;
+    error -= reference;
+    error -= round(error / DUPR) * DUPR;
+    errors[opIndex - 1] = max(errors[opIndex - 1], fabs(error));
+  }
+  TEST_ASSERT_FALSE(isOn);
+}
+
+void test_passes_cut_the_same_groove() {
+  const int passes = 3;
+  double errors[passes];
+  turnLeadErrors(100, passes, errors);
+  TEST_ASSERT_TRUE(stepsToDu(&z, SPEED_START_Z) > DUPR * 100 / 60);
+  for (int i = 0; i < passes; i++) {
+    char message[64];
+    snprintf(message, sizeof(message), "pass %d: %.1fum", i + 1, errors[i] / 10);
+    TEST_MESSAGE(message);
+    // Within a couple of steps of the first pass.
+    TEST_ASSERT_TRUE(errors[i] <= 2 * z.screwPitch / z.motorSteps);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_passes_cut_the_same_groove);
+  return UNITY_END();
+}
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""Compares the $B benchmark output of two builds, e.g. before and after a change.
+
+Usage: benchcmp.py base.txt new.txt [threshold_percent]
+
+Both files are serial captures containing [BN:name,iterations,ns per op,allocations]
+lines, see include/bench.hpp. Prints one row per benchmark and exits with 1 if any of
+them got slower by more than threshold_percent (default 10) or allocates more.
+"""
+import re
+import sys
+
+LINE = re.compile(r'\[BN:([^,\]]+),(\d+),([\d.]+),(-?\d+)\]')
+
+
+def parse(path):
+    results = {}
+    with open(path, 'rb') as f:
+        for match in LINE.finditer(f.read().decode('ascii', 'replace')):
+            name, iterations, ns, allocations = match.groups()
+            allocations = int(allocations)
+            results[name] = (float(ns), allocations / int(iterations) if allocations >= 0 else None)
+    return results
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.exit(__doc__)
+    base = parse(sys.argv[1])
+    new = parse(sys.argv[2])
+    threshold = float(sys.argv[3]) if len(sys.argv) == 4 else 10
+    regressed = False
+    print('%-24s %12s %12s %8s %10s %10s' % ('benchmark', 'base ns', 'new ns', 'change', 'base alloc', 'new alloc'))
+    for name in list(base) + [n for n in new if n not in base]:
+        if name not in base or name not in new:
+            print('%-24s %s' % (name, 'only in ' + ('base' if name in base else 'new')))
+            continue
+        (base_ns, base_alloc), (new_ns, new_alloc) = base[name], new[name]
+        change = (new_ns - base_ns) / base_ns * 100 if base_ns > 0 else 0
+        more_allocs = base_alloc is not None and new_alloc is not None and new_alloc > base_alloc
+        flag = ' <' if change > threshold or more_allocs else ''
+        regressed = regressed or flag != ''
+        print('%-24s %12.1f %12.1f %+7.1f%% %10s %10s%s' % (name, base_ns, new_ns, change,
+              '-' if base_alloc is None else '%g' % base_alloc, '-' if new_alloc is None else '%g' % new_alloc, flag))
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Converts $T trace dumps captured from the serial port into CSV.
+
+Usage: trace2csv.py capture.bin [out.csv]
+
+The capture may contain other serial output around the dumps, they're found by the
+"H4TR" (motion ring) and "H4KY" (key ring) magic of TraceDumpHeader in include/trace.hpp.
+Sending $T repeatedly while the rings don't wrap between dumps gives a longer trace,
+overlapping events are merged by their index. Key events are sorted in by time, their
+index column counts keys only. With the spindle_delta and key events this is the input
+of replay/replay.cpp.
+"""
+import csv
+import struct
+import sys
+
+HEADER = struct.Struct('<4sBBHII')
+EVENT = struct.Struct('<IBBHi')
+
+TYPES = {1: 'step', 2: 'dir', 3: 'spindle_delta', 4: 'mode', 5: 'mark_origin', 6: 'sync', 7: 'setting', 8: 'key'}
+SETTINGS = {1: 'mark_origin', 2: 'spindle_shift', 3: 'spindle_catch_up', 4: 'dupr', 5: 'starts', 6: 'cone_ratio',
+            7: 'mode', 8: 'is_on', 9: 'left_stop', 10: 'right_stop', 11: 'reset_following', 12: 'reset_profile',
+            13: 'bench'}
+
+
+def read_dumps(data, magic):
+    """Returns raw events of all dumps with magic in data by index since boot."""
+    events = {}
+    start = data.find(magic)
+    while start >= 0:
+        _, version, event_size, _, first, count = HEADER.unpack_from(data, start)
+        if version != 1 or event_size != EVENT.size:
+            raise ValueError('unsupported dump version %d with %d byte events' % (version, event_size))
+        offset = start + HEADER.size
+        if len(data) < offset + count * EVENT.size:
+            raise ValueError('dump truncated, expected %d events' % count)
+        for i in range(count):
+            event = EVENT.unpack_from(data, offset + i * EVENT.size)
+            if event[1] != 0:  # type 0 was overwritten while it was being sent
+                events[first + i] = event
+        start = data.find(magic, offset + count * EVENT.size)
+    return events
+
+
+def unwrap(events, name):
+    """Yields index, time in us since boot and the raw event, in index order."""
+    wraps = 0
+    last = 0
+    previous = None
+    for index in sorted(events):
+        if previous is not None and index != previous + 1:
+            sys.stderr.write('%s events %d to %d are missing, the ring wrapped between dumps\n' % (name, previous + 1, index - 1))
+        previous = index
+        time_us = events[index][0]
+        if time_us < last:
+            wraps += 1  # micros() wraps every ~71 minutes
+        last = time_us
+        yield index, time_us + (wraps << 32), events[index]
+
+
+def decode(data):
+    motion = read_dumps(data, b'H4TR')
+    if not motion:
+        raise ValueError('no trace dump found')
+    rows = list(unwrap(motion, 'motion'))
+    base = rows[0][1]
+    # The key ring goes back much further. Keys from before the oldest motion event can't be replayed
+    # against it, the rest is placed by its distance from that event, which handles a micros() wrap.
+    keys = []
+    for index, time_us, event in unwrap(read_dumps(data, b'H4KY'), 'key'):
+        since_base = (time_us - base) & 0xffffffff
+        if since_base < 1 << 31:
+            keys.append((index, base + since_base, event))
+    # Stable, so at the same time a key comes after the motion events: the motion task only saw it later.
+    for index, time_us, (_, type, arg, _, value) in sorted(rows + keys, key=lambda row: row[1]):
+        if type in (1, 2):
+            arg = chr(arg)
+        elif type == 7:
+            arg = SETTINGS.get(arg, arg)
+        yield index, time_us - base, TYPES.get(type, type), arg, value
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit(__doc__)
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    out = open(sys.argv[2], 'w', newline='') if len(sys.argv) == 3 else sys.stdout
+    writer = csv.writer(out)
+    writer.writerow(['index', 'time_us', 'event', 'arg', 'value'])
+    for row in decode(data):
+        writer.writerow(row)
+
+
+if __name__ == '__main__':
+    main()